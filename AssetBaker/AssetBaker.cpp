@@ -0,0 +1,291 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "CompressedTexture.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "Skybox.h"
+#include "Text.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <unordered_map>
+
+// Offline asset baker. Walks the game's asset folders and builds every runtime cache the game would otherwise
+// build on its first launch: .meshbin for every obj, .ktx2 for every image and the skybox cubemap, and the
+// distance field glyphs of the font. Assets are baked in parallel on the thread pool, and a manifest of content
+// hashes skips the ones whose sources and baker versions haven't changed since the last run.
+//
+// Usage: AssetBaker [game directory] [--rebuild]
+// The game directory defaults to the one next to this project. Impostors need a GL context, so they're still
+// baked by the game the first time it runs.
+
+namespace
+{
+    const char* MANIFEST_PATH = "assets.manifest";
+
+    // Codepoints whose distance fields are baked, printable ASCII and Latin-1
+    const uint32_t GLYPH_RANGES[][2] = { { 0x20, 0x7E }, { 0xA0, 0xFF } };
+
+    struct BakeJob
+    {
+        const char* kind;
+        std::vector<std::string> sources;
+        std::string output;
+        uint32_t version;
+        std::function<bool()> bake;
+
+        // Filled in once the job ran
+        uint64_t hash = 0;
+        bool skipped = false;
+        bool succeeded = false;
+        double ms = 0.0;
+    };
+
+    std::vector<std::string> FindFiles(const std::vector<std::string>& directories, const std::vector<std::string>& extensions)
+    {
+        std::vector<std::string> files;
+
+        for (const auto& directory : directories)
+        {
+            std::error_code error;
+            for (auto it = std::filesystem::recursive_directory_iterator(directory, error); it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+            {
+                if (error)
+                {
+                    break;
+                }
+
+                std::string extension = it->path().extension().string();
+                std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+                if (it->is_regular_file() && std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+                {
+                    files.push_back(it->path().generic_string());
+                }
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    // Hash of the kind, the baker version and every source, 0 if a source can't be read
+    uint64_t HashJob(const BakeJob& job)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (const char* c = job.kind; *c; c++)
+        {
+            hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+        }
+        hash = (hash ^ job.version) * 1099511628211ULL;
+
+        for (const auto& source : job.sources)
+        {
+            uint64_t sourceHash = MeshCache::HashFile(source);
+            if (sourceHash == 0)
+            {
+                return 0;
+            }
+            hash = (hash ^ sourceHash) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // One "hash output" line per baked file
+    std::unordered_map<std::string, uint64_t> ReadManifest()
+    {
+        std::unordered_map<std::string, uint64_t> manifest;
+
+        std::ifstream in(MANIFEST_PATH);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            size_t space = line.find(' ');
+            if (space == std::string::npos)
+            {
+                continue;
+            }
+            manifest[line.substr(space + 1)] = std::strtoull(line.substr(0, space).c_str(), nullptr, 16);
+        }
+        return manifest;
+    }
+
+    bool WriteManifest(const std::unordered_map<std::string, uint64_t>& manifest)
+    {
+        std::vector<std::string> outputs;
+        for (const auto& entry : manifest)
+        {
+            outputs.push_back(entry.first);
+        }
+        std::sort(outputs.begin(), outputs.end());
+
+        // Write to a temporary file so a crash never leaves a half written manifest behind
+        std::string tempPath = std::string(MANIFEST_PATH) + ".tmp";
+        std::ofstream out(tempPath, std::ios::trunc);
+        for (const auto& output : outputs)
+        {
+            char hash[17];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)manifest.at(output));
+            out << hash << ' ' << output << '\n';
+        }
+        out.close();
+
+        if (!out)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(MANIFEST_PATH);
+        return std::rename(tempPath.c_str(), MANIFEST_PATH) == 0;
+    }
+
+    std::vector<BakeJob> CollectJobs()
+    {
+        std::vector<BakeJob> jobs;
+
+        for (const auto& obj : FindFiles({ "models" }, { ".obj" }))
+        {
+            // Its materials are sources too, the cache holds what they say
+            std::vector<std::string> sources = { obj };
+            for (const auto& material : MeshCache::MaterialPaths(obj))
+            {
+                sources.push_back(material);
+            }
+
+            jobs.push_back({ "mesh", sources, MeshCache::CachePath(obj), MeshCache::VERSION, [obj]()
+            {
+                uint64_t source_hash = MeshCache::HashSource(obj);
+                if (source_hash == 0)
+                {
+                    return false;
+                }
+
+                // The game may have written it already
+                MeshCache existing;
+                if (existing.Open(MeshCache::CachePath(obj), source_hash))
+                {
+                    return true;
+                }
+
+                ModelData model;
+                std::vector<std::string> texture_names;
+                return Model::BuildMeshCache(obj, source_hash, model, texture_names);
+            } });
+        }
+
+        for (const auto& image : FindFiles({ "models", "textures" }, { ".png", ".jpg", ".jpeg" }))
+        {
+            std::string ktxPath = CompressedTexture::KtxPath(image);
+            jobs.push_back({ "texture", { image }, ktxPath, CompressedTexture::VERSION, [image, ktxPath]()
+            {
+                return CompressedTexture::Convert({ image }, ktxPath);
+            } });
+        }
+
+        std::string cubemapPath = CompressedTexture::CubemapPath(SKYBOX_FACES);
+        jobs.push_back({ "cubemap", SKYBOX_FACES, cubemapPath, CompressedTexture::VERSION, [cubemapPath]()
+        {
+            return CompressedTexture::Convert(SKYBOX_FACES, cubemapPath);
+        } });
+
+        jobs.push_back({ "glyphs", { Text::FONT_PATH }, Text::SDF_CACHE_PATH, Text::SDF_VERSION, []()
+        {
+            Text text;
+            for (const auto& range : GLYPH_RANGES)
+            {
+                if (!text.BakeDistanceFields(range[0], range[1]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        } });
+
+        return jobs;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string root = "../CSU44052_SeriousGame";
+    bool rebuild = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--rebuild")
+        {
+            rebuild = true;
+        }
+        else
+        {
+            root = argv[i];
+        }
+    }
+
+    // Every path the game uses is relative to its own directory, the caches are keyed the same way
+    std::error_code error;
+    std::filesystem::current_path(root, error);
+    if (error)
+    {
+        printf("Can't open the game directory %s\n", root.c_str());
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<BakeJob> jobs = CollectJobs();
+    std::unordered_map<std::string, uint64_t> manifest = rebuild ? std::unordered_map<std::string, uint64_t>() : ReadManifest();
+
+    ThreadPool::GetInstance()->ParallelFor(jobs.size(), [&](size_t index)
+    {
+        BakeJob& job = jobs[index];
+        auto jobStart = std::chrono::steady_clock::now();
+
+        job.hash = HashJob(job);
+        auto known = manifest.find(job.output);
+        job.skipped = job.hash != 0 && known != manifest.end() && known->second == job.hash && std::filesystem::exists(job.output);
+        job.succeeded = job.hash != 0 && (job.skipped || job.bake());
+
+        job.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+    });
+
+    printf("%-8s %-52s %-8s %10s\n", "kind", "output", "status", "time (ms)");
+
+    size_t baked = 0;
+    size_t failed = 0;
+    for (const auto& job : jobs)
+    {
+        const char* status = job.skipped ? "current" : job.succeeded ? "baked" : "FAILED";
+        printf("%-8s %-52s %-8s %10.1f\n", job.kind, job.output.c_str(), status, job.ms);
+
+        if (job.succeeded)
+        {
+            manifest[job.output] = job.hash;
+            baked += job.skipped ? 0 : 1;
+        }
+        else
+        {
+            manifest.erase(job.output);
+            failed++;
+        }
+    }
+
+    if (!WriteManifest(manifest))
+    {
+        printf("Failed to write %s\n", MANIFEST_PATH);
+    }
+
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu assets, %zu baked, %zu up to date, %zu failed in %.0f ms on %u threads\n", jobs.size(), baked, jobs.size() - baked - failed, failed,
+        totalMs, ThreadPool::GetInstance()->ThreadCount() + 1);
+    return failed == 0 ? 0 : 1;
+}
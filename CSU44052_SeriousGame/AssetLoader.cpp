@@ -0,0 +1,81 @@
+#include "AssetLoader.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+
+AssetLoader::AssetLoader()
+{
+    totalCount = 0;
+    completedCount = 0;
+    decodedCount = 0;
+    cancelled = false;
+}
+
+void AssetLoader::Load(const std::string& name, std::function<bool()> decode, std::function<void()> upload)
+{
+    totalCount++;
+
+    ThreadPool::GetInstance()->Submit([this, name, decode, upload]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool succeeded = !cancelled && decode();
+        auto stop = std::chrono::steady_clock::now();
+
+        Completion completion;
+        completion.name = name;
+        completion.succeeded = succeeded;
+        completion.decodeMs = std::chrono::duration<double, std::milli>(stop - start).count();
+        completion.upload = upload;
+
+        std::lock_guard<std::mutex> lock(completionsMutex);
+        completions.push(completion);
+        decodedCount++;
+        decodedCondition.notify_all();
+    });
+}
+
+void AssetLoader::Cancel()
+{
+    cancelled = true;
+
+    std::unique_lock<std::mutex> lock(completionsMutex);
+    decodedCondition.wait(lock, [this]() { return decodedCount == totalCount; });
+    completions = std::queue<Completion>();
+}
+
+int AssetLoader::ProcessCompleted()
+{
+    std::queue<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(completionsMutex);
+        std::swap(ready, completions);
+    }
+
+    int processed = 0;
+
+    while (!ready.empty())
+    {
+        Completion& completion = ready.front();
+
+        if (completion.succeeded)
+        {
+            auto start = std::chrono::steady_clock::now();
+            completion.upload();
+            auto stop = std::chrono::steady_clock::now();
+
+            printf("Loaded %s (decode %.1f ms, upload %.1f ms)\n", completion.name.c_str(), completion.decodeMs, std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+        else
+        {
+            printf("Failed to load %s\n", completion.name.c_str());
+            failures.push_back(completion.name);
+        }
+
+        ready.pop();
+        completedCount++;
+        processed++;
+    }
+
+    return processed;
+}
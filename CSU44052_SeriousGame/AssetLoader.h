@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+// Loads assets in two halves: the decode step (file reads, obj parsing, image and font decoding) runs on
+// the thread pool, and the upload step is queued back to the GL thread, which runs it from ProcessCompleted.
+class AssetLoader
+{
+public:
+    AssetLoader();
+
+    // decode runs on a worker thread and must not touch GL, upload runs on the GL thread if decode succeeded
+    void Load(const std::string& name, std::function<bool()> decode, std::function<void()> upload);
+
+    // Run the uploads of every asset that has finished decoding, call once per frame from the GL thread
+    int ProcessCompleted();
+
+    int TotalCount() const { return totalCount; }
+
+    int CompletedCount() const { return completedCount; }
+
+    bool IsDone() const { return completedCount == totalCount; }
+
+    const std::vector<std::string>& Failures() const { return failures; }
+
+    // Skip the decodes that haven't started yet and wait for the running ones, nothing more gets uploaded. For
+    // quitting mid load, the workers mustn't outlive what they decode into.
+    void Cancel();
+
+private:
+    struct Completion
+    {
+        std::string name;
+        bool succeeded;
+        double decodeMs;
+        std::function<void()> upload;
+    };
+
+    std::queue<Completion> completions;
+    std::mutex completionsMutex;
+
+    // Decodes that finished or were skipped, under completionsMutex
+    int decodedCount;
+    std::condition_variable decodedCondition;
+    std::atomic<bool> cancelled;
+
+    int totalCount;
+    int completedCount;
+    std::vector<std::string> failures;
+};
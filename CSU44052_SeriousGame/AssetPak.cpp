@@ -0,0 +1,301 @@
+#include "AssetPak.h"
+#include "Lz4.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    const char PAK_MAGIC[8] = { 'A', 'S', 'S', 'E', 'T', 'P', 'A', 'K' };
+
+    const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+    // Entries are only stored compressed when it saves at least this fraction of their size
+    const float MIN_COMPRESSION_SAVING = 0.1f;
+
+    // Entries, slots and path strings follow the header, then the data of every entry
+    struct PakHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t slotCount;
+        uint32_t pathsSize;
+    };
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+AssetPak::AssetPak()
+{
+    entries = nullptr;
+    entryCount = 0;
+    slots = nullptr;
+    slotCount = 0;
+    paths = nullptr;
+}
+
+AssetPak* AssetPak::GetInstance()
+{
+    static AssetPak* pAssetPak = new AssetPak();
+    return pAssetPak;
+}
+
+std::string AssetPak::NormalizePath(const std::string& path)
+{
+    std::string normalized = path;
+    std::replace(normalized.begin(), normalized.end(), '\\', '/');
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+    while (normalized.compare(0, 2, "./") == 0)
+    {
+        normalized.erase(0, 2);
+    }
+    return normalized;
+}
+
+// 64 bit FNV-1a
+uint64_t AssetPak::HashBytes(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool AssetPak::Mount(const std::string& pakPath)
+{
+    if (!file.Open(pakPath) || file.Size() < sizeof(PakHeader))
+    {
+        file.Close();
+        return false;
+    }
+
+    PakHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+
+    size_t tableSize = sizeof(PakHeader) + (size_t)header.entryCount * sizeof(Entry) + (size_t)header.slotCount * sizeof(uint32_t) + header.pathsSize;
+
+    // The slot count has to be a power of two for the probe to wrap with a mask
+    if (memcmp(header.magic, PAK_MAGIC, sizeof(PAK_MAGIC)) != 0 || header.version != VERSION || header.slotCount == 0 ||
+        (header.slotCount & (header.slotCount - 1)) != 0 || header.slotCount <= header.entryCount || tableSize > file.Size())
+    {
+        printf("Invalid asset archive: %s\n", pakPath.c_str());
+        file.Close();
+        return false;
+    }
+
+    const unsigned char* table = file.Data() + sizeof(PakHeader);
+    const Entry* mappedEntries = (const Entry*)table;
+    const uint32_t* mappedSlots = (const uint32_t*)(table + (size_t)header.entryCount * sizeof(Entry));
+
+    for (uint32_t slot = 0; slot < header.slotCount; slot++)
+    {
+        if (mappedSlots[slot] != EMPTY_SLOT && mappedSlots[slot] >= header.entryCount)
+        {
+            printf("Invalid asset archive: %s\n", pakPath.c_str());
+            file.Close();
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.entryCount; i++)
+    {
+        const Entry& entry = mappedEntries[i];
+        if (entry.offset + entry.storedSize > file.Size() || (size_t)entry.pathOffset + entry.pathLength > header.pathsSize ||
+            (entry.compression != NONE && entry.compression != LZ4))
+        {
+            printf("Invalid asset archive: %s\n", pakPath.c_str());
+            file.Close();
+            return false;
+        }
+    }
+
+    entries = mappedEntries;
+    entryCount = header.entryCount;
+    slots = mappedSlots;
+    slotCount = header.slotCount;
+    paths = (const char*)(mappedSlots + header.slotCount);
+
+    // Edited loose files shouldn't need a rebuild of the archive to show up, checked once here so Find stays a probe
+    std::error_code error;
+    std::filesystem::file_time_type pakTime = std::filesystem::last_write_time(pakPath, error);
+    overridden.assign(entryCount, false);
+    for (uint32_t i = 0; !error && i < entryCount; i++)
+    {
+        std::string path(paths + entries[i].pathOffset, entries[i].pathLength);
+
+        std::error_code looseError;
+        std::filesystem::file_time_type looseTime = std::filesystem::last_write_time(path, looseError);
+        if (!looseError && looseTime > pakTime)
+        {
+            printf("Loading %s from disk, it's newer than %s\n", path.c_str(), pakPath.c_str());
+            overridden[i] = true;
+        }
+    }
+    return true;
+}
+
+const AssetPak::Entry* AssetPak::Find(const std::string& path) const
+{
+    if (entryCount == 0)
+    {
+        return nullptr;
+    }
+
+    std::string normalized = NormalizePath(path);
+    uint64_t hash = HashBytes((const unsigned char*)normalized.data(), normalized.size());
+
+    // Linear probe until the path or an empty slot turns up, the table is never full
+    for (uint32_t slot = (uint32_t)hash & (slotCount - 1);; slot = (slot + 1) & (slotCount - 1))
+    {
+        uint32_t index = slots[slot];
+        if (index == EMPTY_SLOT)
+        {
+            return nullptr;
+        }
+
+        const Entry& entry = entries[index];
+        if (entry.pathHash == hash && entry.pathLength == normalized.size() && memcmp(paths + entry.pathOffset, normalized.data(), normalized.size()) == 0)
+        {
+            return overridden[index] ? nullptr : &entry;
+        }
+    }
+}
+
+bool AssetPak::Read(const Entry& entry, const unsigned char*& data, size_t& size, std::vector<unsigned char>& buffer) const
+{
+    const unsigned char* stored = file.Data() + entry.offset;
+
+    if (entry.compression == NONE)
+    {
+        data = stored;
+        size = (size_t)entry.size;
+        return true;
+    }
+
+    buffer.resize((size_t)entry.size);
+    if (!Lz4::Decompress(stored, (size_t)entry.storedSize, buffer.data(), buffer.size()))
+    {
+        printf("Corrupt entry in asset archive: %.*s\n", (int)entry.pathLength, paths + entry.pathOffset);
+        buffer = std::vector<unsigned char>();
+        return false;
+    }
+
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+bool AssetPak::Build(const std::vector<std::string>& paths, const std::string& pakPath)
+{
+    std::vector<Entry> entries(paths.size());
+    std::vector<std::vector<unsigned char>> stored(paths.size());
+    std::string pathStrings;
+
+    uint32_t slotCount = 1;
+    while (slotCount < paths.size() * 2)
+    {
+        slotCount *= 2;
+    }
+    std::vector<uint32_t> slots(slotCount, EMPTY_SLOT);
+
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        MappedFile source;
+        if (!source.Open(paths[i]))
+        {
+            printf("Failed to read %s\n", paths[i].c_str());
+            return false;
+        }
+
+        std::string normalized = NormalizePath(paths[i]);
+
+        Entry& entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        entry.pathHash = HashBytes((const unsigned char*)normalized.data(), normalized.size());
+        entry.size = source.Size();
+        entry.contentHash = HashBytes(source.Data(), source.Size());
+        entry.pathOffset = (uint32_t)pathStrings.size();
+        entry.pathLength = (uint32_t)normalized.size();
+        pathStrings += normalized;
+
+        // Images are already compressed, text and fonts usually shrink a lot
+        std::vector<unsigned char> compressed(Lz4::CompressBound(source.Size()));
+        compressed.resize(Lz4::Compress(source.Data(), source.Size(), compressed.data()));
+
+        if (compressed.size() < source.Size() * (1.0f - MIN_COMPRESSION_SAVING))
+        {
+            entry.compression = LZ4;
+            stored[i] = std::move(compressed);
+        }
+        else
+        {
+            entry.compression = NONE;
+            stored[i].assign(source.Data(), source.Data() + source.Size());
+        }
+        entry.storedSize = stored[i].size();
+
+        uint32_t slot = (uint32_t)entry.pathHash & (slotCount - 1);
+        while (slots[slot] != EMPTY_SLOT)
+        {
+            const Entry& other = entries[slots[slot]];
+            if (other.pathHash == entry.pathHash && other.pathLength == entry.pathLength &&
+                pathStrings.compare(other.pathOffset, other.pathLength, normalized) == 0)
+            {
+                printf("%s is in the archive twice\n", paths[i].c_str());
+                return false;
+            }
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = (uint32_t)i;
+    }
+
+    PakHeader header;
+    memcpy(header.magic, PAK_MAGIC, sizeof(PAK_MAGIC));
+    header.version = VERSION;
+    header.entryCount = (uint32_t)entries.size();
+    header.slotCount = slotCount;
+    header.pathsSize = (uint32_t)pathStrings.size();
+
+    size_t offset = AlignUp(sizeof(PakHeader) + entries.size() * sizeof(Entry) + slots.size() * sizeof(uint32_t) + pathStrings.size(), ALIGNMENT);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        entries[i].offset = offset;
+        offset = AlignUp(offset + stored[i].size(), ALIGNMENT);
+    }
+
+    // Write to a temporary file so a crash never leaves a half written archive behind
+    std::string tempPath = pakPath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+    out.write((const char*)slots.data(), slots.size() * sizeof(uint32_t));
+    out.write(pathStrings.data(), pathStrings.size());
+
+    const char padding[ALIGNMENT] = {};
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        out.write(padding, (std::streamsize)(entries[i].offset - (uint64_t)out.tellp()));
+        out.write((const char*)stored[i].data(), stored[i].size());
+    }
+    out.close();
+
+    if (!out)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(pakPath.c_str());
+    return std::rename(tempPath.c_str(), pakPath.c_str()) == 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Single file archive of the game's source assets (.pak), mapped once and read in place. The table of contents
+// is an open addressing table of path hashes, so finding a file is a hash and a probe or two instead of a trip
+// through the file system. Entry data starts on ALIGNMENT so every file keeps the alignment a mapped loose file
+// would have. Entries that pack well are LZ4 compressed, the rest are stored as they are and read without a copy.
+//
+// Once Mount has worked MappedFile looks here before the disk, so every loader reads from the archive without
+// knowing about it. Loose files modified after the archive was written still win, so assets can be edited without
+// rebuilding it. Without an archive everything loads from loose files as before.
+class AssetPak
+{
+public:
+    // Bump when the layout changes, old archives are refused
+    static const uint32_t VERSION = 1;
+
+    static const size_t ALIGNMENT = 4096;
+
+    enum Compression : uint32_t
+    {
+        NONE = 0,
+        LZ4 = 1
+    };
+
+    struct Entry
+    {
+        uint64_t pathHash;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t storedSize;
+        // 64 bit FNV-1a of the uncompressed data, the same as MeshCache::HashFile
+        uint64_t contentHash;
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        uint32_t compression;
+        uint32_t reserved;
+    };
+
+    static AssetPak* GetInstance();
+
+    // Call before anything is loaded, the archive stays mapped until exit. Prints every loose file that's newer.
+    bool Mount(const std::string& pakPath);
+
+    bool IsMounted() const { return file.IsOpen(); }
+
+    // Entry of a path relative to the working directory, nullptr when it isn't in the archive or the loose file is
+    // newer
+    const Entry* Find(const std::string& path) const;
+
+    // Points data at the entry inside the mapping, or decompresses it into buffer first
+    bool Read(const Entry& entry, const unsigned char*& data, size_t& size, std::vector<unsigned char>& buffer) const;
+
+    // Pack the files into a new archive, they're stored under the paths as given
+    static bool Build(const std::vector<std::string>& paths, const std::string& pakPath);
+
+    // Forward slashes, no leading ./ and lower case, so lookups match the way Windows treats loose paths
+    static std::string NormalizePath(const std::string& path);
+
+    static uint64_t HashBytes(const unsigned char* data, size_t size);
+
+private:
+    AssetPak();
+
+    MappedFile file;
+
+    const Entry* entries;
+    uint32_t entryCount;
+
+    // Index into entries of every slot of the table, EMPTY_SLOT where there is none
+    const uint32_t* slots;
+    uint32_t slotCount;
+
+    const char* paths;
+
+    // Per entry, the loose file was modified after the archive and is read instead
+    std::vector<bool> overridden;
+};
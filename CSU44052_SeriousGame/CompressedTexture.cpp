@@ -0,0 +1,246 @@
+#include "CompressedTexture.h"
+#include "ImageDecoder.h"
+#include "MeshCache.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+
+namespace
+{
+    // Written once on the GL thread before any loading starts
+    bool s3tcSupported = false;
+}
+
+CompressedTexture::CompressedTexture()
+{
+}
+
+bool CompressedTexture::Load(const std::string& sourcePath)
+{
+    return LoadOrConvert({ sourcePath }, KtxPath(sourcePath));
+}
+
+bool CompressedTexture::LoadCubemap(const std::vector<std::string>& facePaths)
+{
+    return facePaths.size() == 6 && LoadOrConvert(facePaths, CubemapPath(facePaths));
+}
+
+GLuint CompressedTexture::Upload()
+{
+    if (!file.IsOpen())
+    {
+        return 0;
+    }
+
+    bool cubemap = file.FaceCount() == 6;
+    GLenum target = cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    GLenum format = file.VkFormat() == Ktx2File::FORMAT_BC3_UNORM ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+
+    for (int i = 0; i < file.LevelCount(); i++)
+    {
+        const Ktx2File::Level& level = file.GetLevel(i);
+        int width = std::max(1, file.Width() >> i);
+        int height = std::max(1, file.Height() >> i);
+        size_t faceSize = level.size / file.FaceCount();
+
+        for (int face = 0; face < file.FaceCount(); face++)
+        {
+            GLenum faceTarget = cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+            glCompressedTexImage2D(faceTarget, i, format, width, height, 0, (GLsizei)faceSize, level.data + face * faceSize);
+        }
+    }
+
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, file.LevelCount() - 1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    file.Close();
+    return texture;
+}
+
+bool CompressedTexture::Convert(const std::vector<std::string>& sourcePaths, const std::string& ktxPath)
+{
+    uint64_t sourceHash = HashSources(sourcePaths);
+    if (sourceHash == 0)
+    {
+        return false;
+    }
+
+    Ktx2File existing;
+    if (existing.Open(ktxPath) && existing.SourceHash() == sourceHash && existing.FaceCount() == (int)sourcePaths.size())
+    {
+        return true;
+    }
+    existing.Close();
+
+    return Build(sourcePaths, ktxPath, sourceHash);
+}
+
+std::string CompressedTexture::KtxPath(const std::string& sourcePath)
+{
+    size_t dot = sourcePath.find_last_of('.');
+    size_t slash = sourcePath.find_last_of("/\\");
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return sourcePath + ".ktx2";
+    }
+    return sourcePath.substr(0, dot) + ".ktx2";
+}
+
+// The cubemap lives next to its first face
+std::string CompressedTexture::CubemapPath(const std::vector<std::string>& facePaths)
+{
+    size_t slash = facePaths[0].find_last_of("/\\");
+    if (slash == std::string::npos)
+    {
+        return "cubemap.ktx2";
+    }
+    return facePaths[0].substr(0, slash + 1) + "cubemap.ktx2";
+}
+
+void CompressedTexture::DetectSupport()
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+        {
+            s3tcSupported = true;
+            return;
+        }
+    }
+
+    printf("S3TC texture compression isn't supported, textures will be uploaded uncompressed\n");
+}
+
+bool CompressedTexture::IsSupported()
+{
+    return s3tcSupported;
+}
+
+bool CompressedTexture::LoadOrConvert(const std::vector<std::string>& sourcePaths, const std::string& ktxPath)
+{
+    if (!s3tcSupported)
+    {
+        return false;
+    }
+
+    uint64_t sourceHash = HashSources(sourcePaths);
+    if (sourceHash == 0)
+    {
+        return false;
+    }
+
+    if (file.Open(ktxPath) && file.SourceHash() == sourceHash && file.FaceCount() == (int)sourcePaths.size())
+    {
+        return true;
+    }
+    file.Close();
+
+    return Build(sourcePaths, ktxPath, sourceHash) && file.Open(ktxPath) && file.SourceHash() == sourceHash;
+}
+
+// Combined hash of the encoder version and every source file, 0 if any of them can't be read
+uint64_t CompressedTexture::HashSources(const std::vector<std::string>& sourcePaths)
+{
+    uint64_t hash = 14695981039346656037ULL ^ VERSION;
+
+    for (const auto& sourcePath : sourcePaths)
+    {
+        uint64_t fileHash = MeshCache::HashFile(sourcePath);
+        if (fileHash == 0)
+        {
+            return 0;
+        }
+        hash = (hash ^ fileHash) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool CompressedTexture::Build(const std::vector<std::string>& sourcePaths, const std::string& ktxPath, uint64_t sourceHash)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::future<DecodedImage>> decoding = ImageDecoder::GetInstance()->DecodeBatch(sourcePaths, 4);
+    std::vector<DecodedImage> images;
+    for (auto& future : decoding)
+    {
+        images.push_back(future.get());
+    }
+
+    bool valid = true;
+    for (const auto& image : images)
+    {
+        valid = valid && image.pixels && image.width == images[0].width && image.height == images[0].height;
+    }
+
+    if (!valid)
+    {
+        printf("Failed to compress %s\n", ktxPath.c_str());
+        for (auto& image : images)
+        {
+            image.Release();
+        }
+        return false;
+    }
+
+    int width = images[0].width;
+    int height = images[0].height;
+    int levelCount = TextureCompressor::MipLevelCount(width, height);
+
+    // One alpha channel anywhere means the whole texture needs BC3
+    TextureCompressor::Format format = TextureCompressor::BC1;
+    for (const auto& image : images)
+    {
+        if (TextureCompressor::ChooseFormat(image.pixels, width, height) == TextureCompressor::BC3)
+        {
+            format = TextureCompressor::BC3;
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> levels(levelCount);
+    for (auto& image : images)
+    {
+        std::vector<uint8_t> mip;
+        const uint8_t* pixels = image.pixels;
+        int levelWidth = width;
+        int levelHeight = height;
+
+        for (int i = 0; i < levelCount; i++)
+        {
+            std::vector<uint8_t> blocks = TextureCompressor::Compress(format, pixels, levelWidth, levelHeight);
+            levels[i].insert(levels[i].end(), blocks.begin(), blocks.end());
+
+            if (i + 1 < levelCount)
+            {
+                mip = TextureCompressor::Downsample(pixels, levelWidth, levelHeight, levelWidth, levelHeight);
+                pixels = mip.data();
+            }
+        }
+
+        image.Release();
+    }
+
+    uint32_t vkFormat = format == TextureCompressor::BC3 ? Ktx2File::FORMAT_BC3_UNORM : Ktx2File::FORMAT_BC1_RGB_UNORM;
+    if (!Ktx2File::Write(ktxPath, vkFormat, width, height, (int)sourcePaths.size(), levels, sourceHash))
+    {
+        return false;
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    printf("Compressed %s (%s, %d levels) in %.1f ms\n", ktxPath.c_str(), format == TextureCompressor::BC3 ? "BC3" : "BC1", levelCount, std::chrono::duration<double, std::milli>(stop - start).count());
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include "Ktx2File.h"
+
+// EXT_texture_compression_s3tc, not part of the core profile glad was generated for
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Texture or cubemap stored as a block compressed .ktx2 file with a full mip chain next to its source image.
+// The first time a source is loaded, or after it changes, it's decoded, mipmapped, compressed and written out.
+// After that the .ktx2 file is mapped and handed to glCompressedTexImage2D as is.
+class CompressedTexture
+{
+public:
+    // Bump when the encoder changes so old files get rebuilt
+    static const uint32_t VERSION = 1;
+
+    CompressedTexture();
+
+    // Load and LoadCubemap don't touch GL. They return false when compressed textures aren't supported or the
+    // file can't be built, callers should fall back to the source image.
+    bool Load(const std::string& sourcePath);
+
+    bool LoadCubemap(const std::vector<std::string>& facePaths);
+
+    // Create the GL texture with every mip level and unmap the file. Leaves the texture bound.
+    GLuint Upload();
+
+    // Size of the loaded file, only valid between Load and Upload
+    int Width() const { return file.Width(); }
+
+    int Height() const { return file.Height(); }
+
+    size_t DataSize() const { return file.DataSize(); }
+
+    // Build or refresh the .ktx2 file without loading it
+    static bool Convert(const std::vector<std::string>& sourcePaths, const std::string& ktxPath);
+
+    static std::string KtxPath(const std::string& sourcePath);
+
+    static std::string CubemapPath(const std::vector<std::string>& facePaths);
+
+    // Call once from the GL thread after the context is created
+    static void DetectSupport();
+
+    static bool IsSupported();
+
+private:
+    bool LoadOrConvert(const std::vector<std::string>& sourcePaths, const std::string& ktxPath);
+
+    static uint64_t HashSources(const std::vector<std::string>& sourcePaths);
+
+    static bool Build(const std::vector<std::string>& sourcePaths, const std::string& ktxPath, uint64_t sourceHash);
+
+    Ktx2File file;
+};
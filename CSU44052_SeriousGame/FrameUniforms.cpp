@@ -0,0 +1,48 @@
+#include "FrameUniforms.h"
+
+FrameUniforms* FrameUniforms::GetInstance()
+{
+    static FrameUniforms* pFrameUniforms = new FrameUniforms();
+    return pFrameUniforms;
+}
+
+FrameUniforms::FrameUniforms()
+{
+    data.view = glm::mat4(1.0f);
+    data.projection = glm::mat4(1.0f);
+    data.cameraPosition = glm::vec4(0.0f);
+    data.sunDirection = glm::vec4(glm::normalize(glm::vec3(0.0f, -1.0f, -1.0f)), 0.0f);
+    data.sunColour = glm::vec4(1.0f);
+    data.fog = glm::vec4(0.7f, 0.7f, 0.7f, 0.1f);
+    buffer = 0;
+}
+
+void FrameUniforms::Update(const glm::mat4& view, const glm::mat4& projection)
+{
+    Data values = data;
+    values.view = view;
+    values.projection = projection;
+    values.cameraPosition = glm::vec4(glm::vec3(glm::inverse(view)[3]), 1.0f);
+    Set(values);
+}
+
+void FrameUniforms::Set(const Data& values)
+{
+    data = values;
+
+    // Created on first use since it needs the GL context, the binding stays put after that
+    if (buffer == 0)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), &data, GL_STREAM_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+    }
+    else
+    {
+        // Orphan it rather than wait for draws still reading the last frame's values
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), &data, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Uniform buffer of everything that stays the same for a whole frame: the camera, the sun and the fog. It is
+// uploaded once per frame and every program reads it through its FrameUniforms block (shaders/frame_uniforms.glsl),
+// so nothing sets view or projection per draw. ShaderProgram points every program's block at BINDING.
+class FrameUniforms
+{
+public:
+    static const GLuint BINDING = 0;
+
+    // std140 layout of the block, everything is a mat4 or a vec4 so the C++ layout matches without padding
+    struct Data
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        // xyz, w unused
+        glm::vec4 cameraPosition;
+        // Direction the sunlight is lit along in xyz, as the lighting used it so far
+        glm::vec4 sunDirection;
+        glm::vec4 sunColour;
+        // Colour in rgb and density in w
+        glm::vec4 fog;
+    };
+
+    static FrameUniforms* GetInstance();
+
+    // Camera of the frame about to be drawn, the camera position comes from the view matrix
+    void Update(const glm::mat4& view, const glm::mat4& projection);
+
+    // What was uploaded last, so code that draws with its own camera can put the frame's back afterwards
+    const Data& Get() const { return data; }
+
+    void Set(const Data& values);
+
+private:
+    FrameUniforms();
+
+    Data data;
+    GLuint buffer;
+};
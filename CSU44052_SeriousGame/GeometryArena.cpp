@@ -0,0 +1,168 @@
+#include "GeometryArena.h"
+#include "MeshCache.h"
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+
+GeometryArena* GeometryArena::GetInstance()
+{
+    static GeometryArena* pGeometryArena = new GeometryArena();
+    return pGeometryArena;
+}
+
+GeometryArena::GeometryArena()
+{
+    vao = 0;
+    compact = false;
+    stride = 0;
+
+    vertexBuffer = 0;
+    vertexCapacity = 0;
+    vertexBytes = 0;
+
+    indexBuffer = 0;
+    indexCapacity = 0;
+    indexBytes = 0;
+
+    vertexMapped = false;
+    indexMapped = false;
+}
+
+void GeometryArena::Create()
+{
+    // Set before anything loads, --full-vertices turns it off for the whole run
+    compact = VertexQuantizer::IsEnabled();
+    stride = compact ? sizeof(CompactVertex) : MeshCache::FLOATS_PER_VERTEX * sizeof(float);
+
+    glGenVertexArrays(1, &vao);
+}
+
+void* GeometryArena::MapVertices(unsigned int count, GLint& baseVertex)
+{
+    if (vao == 0)
+    {
+        Create();
+    }
+
+    GLsizeiptr size = (GLsizeiptr)count * stride;
+    if (vertexBytes + size > vertexCapacity)
+    {
+        Grow(vertexBuffer, vertexCapacity, vertexBytes, vertexBytes + size);
+        SetupVertexArray();
+    }
+
+    baseVertex = (GLint)(vertexBytes / stride);
+    GLintptr offset = vertexBytes;
+    vertexBytes += size;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+    void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    vertexMapped = true;
+    return mapped;
+}
+
+void* GeometryArena::MapIndices(unsigned int count, GLenum type, GLuint& firstIndex)
+{
+    if (vao == 0)
+    {
+        Create();
+    }
+
+    // 32 bit indices start on a 4 byte boundary so firstIndex can count them
+    GLsizeiptr indexSize = type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    GLsizeiptr start = (indexBytes + indexSize - 1) / indexSize * indexSize;
+    GLsizeiptr size = (GLsizeiptr)count * indexSize;
+
+    if (start + size > indexCapacity)
+    {
+        Grow(indexBuffer, indexCapacity, indexBytes, start + size);
+        SetupVertexArray();
+    }
+
+    firstIndex = (GLuint)(start / indexSize);
+    indexBytes = start + size;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+    void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    indexMapped = true;
+    return mapped;
+}
+
+void GeometryArena::Unmap()
+{
+    if (vertexMapped)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        vertexMapped = false;
+    }
+
+    if (indexMapped)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        indexMapped = false;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::Grow(GLuint& buffer, GLsizeiptr& capacity, GLsizeiptr used, GLsizeiptr size)
+{
+    capacity = std::max(size, capacity * 2);
+    capacity = capacity < INITIAL_SIZE ? INITIAL_SIZE : capacity;
+
+    // Written by mapping and copied on the GPU, never with glBufferSubData
+    GLuint grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_MAP_WRITE_BIT);
+
+    // Draws issued from the old buffer keep it alive until they're done
+    if (buffer != 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    buffer = grown;
+}
+
+void GeometryArena::SetupVertexArray()
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+    if (vertexBuffer != 0)
+    {
+        if (compact)
+        {
+            VertexQuantizer::SetupAttributes(0, 2, 1);
+        }
+        else
+        {
+            // Vertex positions
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+
+            // Texture coordinates
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+
+            // Normals
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+            glEnableVertexAttribArray(2);
+        }
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// The geometry of every Model in one vertex buffer and one index buffer behind a single vertex array, so draws of
+// different meshes need no vertex state of their own and can share one glMultiDrawElementsIndirect. All vertices
+// have the same format, CompactVertex or the 8 float one, picked with VertexQuantizer when the first mesh goes in.
+// A mesh's indices stay relative to its first vertex, its draws pass that as baseVertex. Running out of room copies
+// everything into a buffer twice the size.
+class GeometryArena
+{
+public:
+    // Room to begin with in each buffer
+    static const GLsizeiptr INITIAL_SIZE = 1024 * 1024;
+
+    static GeometryArena* GetInstance();
+
+    // Room for count vertices at the end of the vertex buffer, mapped for writing until Unmap. Sets baseVertex to
+    // the first of them.
+    void* MapVertices(unsigned int count, GLint& baseVertex);
+
+    // Room for count indices of type, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, mapped for writing until Unmap. Sets
+    // firstIndex to where they start, counted in indices of that type.
+    void* MapIndices(unsigned int count, GLenum type, GLuint& firstIndex);
+
+    // Unmap both, call before mapping either again
+    void Unmap();
+
+    // Attributes 0 to 2 read the vertex buffer and the index buffer is bound, the draws point attribute 3 at their
+    // instances. 0 until the first mesh is added.
+    GLuint VertexArray() const { return vao; }
+
+    // Vertices are CompactVertex, only known once the first mesh is added
+    bool IsCompact() const { return compact; }
+
+private:
+    GeometryArena();
+
+    // Pick the vertex format and make the vertex array
+    void Create();
+
+    // Move buffer to a new one twice the size or size, whichever is more, and keep the first used bytes
+    static void Grow(GLuint& buffer, GLsizeiptr& capacity, GLsizeiptr used, GLsizeiptr size);
+
+    // Point the vertex array at the current buffers
+    void SetupVertexArray();
+
+    GLuint vao;
+    bool compact;
+    GLsizeiptr stride;
+
+    GLuint vertexBuffer;
+    GLsizeiptr vertexCapacity;
+    GLsizeiptr vertexBytes;
+
+    GLuint indexBuffer;
+    GLsizeiptr indexCapacity;
+    GLsizeiptr indexBytes;
+
+    bool vertexMapped;
+    bool indexMapped;
+};
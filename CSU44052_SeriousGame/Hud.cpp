@@ -0,0 +1,48 @@
+#include "Hud.h"
+
+#include <cstdio>
+
+size_t Hud::AddLabel(const char* format, float x, float y, float scale, const glm::vec3& colour)
+{
+    Label label;
+    label.format = format;
+    label.x = x;
+    label.y = y;
+    label.scale = scale;
+    label.colour = colour;
+    label.value = 0;
+    label.changed = true;
+    label.buffer[0] = '\0';
+
+    labels.push_back(label);
+    return labels.size() - 1;
+}
+
+void Hud::SetValue(size_t label, int value)
+{
+    Label& target = labels[label];
+    if (target.value != value)
+    {
+        target.value = value;
+        target.changed = true;
+    }
+}
+
+void Hud::Submit(Text& text)
+{
+    for (Label& label : labels)
+    {
+        // Laid out again when the value changed, or when the atlas gave one of its glyphs' cells away
+        if (label.changed || !text.IsCurrent(label.layout))
+        {
+            if (label.changed)
+            {
+                snprintf(label.buffer, sizeof(label.buffer), label.format, label.value);
+                label.changed = false;
+            }
+            text.Layout(label.buffer, label.x, label.y, label.scale, label.colour, label.layout);
+        }
+
+        text.Submit(label.layout);
+    }
+}
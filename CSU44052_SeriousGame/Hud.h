@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Text.h"
+
+// Text that stays on screen from frame to frame. Every label keeps the quads it was last laid out with and is
+// only formatted and laid out again when its value changes, so most frames just copy the quads into the text
+// batch without allocating.
+class Hud
+{
+public:
+    // Longest label after formatting, anything past it is cut off
+    static const size_t MAX_LABEL_LENGTH = 64;
+
+    // A label showing one integer through a printf format such as "Score: %d", returns its index. The format
+    // is kept as a pointer so it has to outlive the Hud.
+    size_t AddLabel(const char* format, float x, float y, float scale, const glm::vec3& colour);
+
+    // Cheap to call every frame, only a different value has the label laid out again
+    void SetValue(size_t label, int value);
+
+    // Queue every label on text, the caller flushes it with the rest of the text
+    void Submit(Text& text);
+
+private:
+    struct Label
+    {
+        const char* format;
+        float x, y;
+        float scale;
+        glm::vec3 colour;
+
+        int value;
+        bool changed;
+
+        char buffer[MAX_LABEL_LENGTH];
+        Text::TextLayout layout;
+    };
+
+    std::vector<Label> labels;
+};
@@ -0,0 +1,96 @@
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "stb_image.h"
+
+#include <chrono>
+#include <cstdio>
+
+void DecodedImage::Release()
+{
+    if (pixels)
+    {
+        stbi_image_free(pixels);
+        pixels = nullptr;
+    }
+}
+
+ImageDecoder::ImageDecoder()
+{
+}
+
+std::future<DecodedImage> ImageDecoder::Decode(const std::string& path, int desiredChannels)
+{
+    return pool.Submit([this, path, desiredChannels]()
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        DecodedImage image;
+        image.path = path;
+        image.pixels = nullptr;
+
+        // Decoded from memory so the image can come out of the asset archive
+        MappedFile file;
+        if (file.Open(path))
+        {
+            image.pixels = stbi_load_from_memory(file.Data(), (int)file.Size(), &image.width, &image.height, &image.channels, desiredChannels);
+        }
+
+        auto stop = std::chrono::steady_clock::now();
+        image.decodeMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        if (!image.pixels)
+        {
+            image.width = 0;
+            image.height = 0;
+            image.channels = 0;
+            return image;
+        }
+
+        if (desiredChannels != 0)
+        {
+            image.channels = desiredChannels;
+        }
+
+        Timing timing;
+        timing.path = path;
+        timing.width = image.width;
+        timing.height = image.height;
+        timing.decodeMs = image.decodeMs;
+
+        std::lock_guard<std::mutex> lock(timingsMutex);
+        timings.push_back(timing);
+        return image;
+    });
+}
+
+std::vector<std::future<DecodedImage>> ImageDecoder::DecodeBatch(const std::vector<std::string>& paths, int desiredChannels)
+{
+    std::vector<std::future<DecodedImage>> images;
+    for (const auto& path : paths)
+    {
+        images.push_back(Decode(path, desiredChannels));
+    }
+    return images;
+}
+
+void ImageDecoder::ReportTimings()
+{
+    std::lock_guard<std::mutex> lock(timingsMutex);
+
+    double total = 0.0;
+    printf("Decoded %d images on %u threads\n", (int)timings.size(), pool.ThreadCount());
+
+    for (const auto& timing : timings)
+    {
+        printf("  %-44s %5d x %-5d %8.1f ms\n", timing.path.c_str(), timing.width, timing.height, timing.decodeMs);
+        total += timing.decodeMs;
+    }
+
+    printf("  total decode time %.1f ms\n", total);
+}
+
+ImageDecoder* ImageDecoder::GetInstance()
+{
+    static ImageDecoder* pImageDecoder = new ImageDecoder();
+    return pImageDecoder;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+// Image decoded by stb_image. The pixels stay alive until Release is called, which should be right after upload.
+struct DecodedImage
+{
+    std::string path;
+    int width;
+    int height;
+    int channels;
+    unsigned char* pixels;
+    double decodeMs;
+
+    void Release();
+};
+
+// Decodes images concurrently on its own thread pool so loaders can wait on the results
+// from inside a job of the shared pool without deadlocking it
+class ImageDecoder
+{
+public:
+    ImageDecoder();
+
+    // desiredChannels = 0 keeps the channel count of the file
+    std::future<DecodedImage> Decode(const std::string& path, int desiredChannels = 0);
+
+    std::vector<std::future<DecodedImage>> DecodeBatch(const std::vector<std::string>& paths, int desiredChannels = 0);
+
+    // Print the decode time of every image so far
+    void ReportTimings();
+
+    static ImageDecoder* GetInstance();
+
+private:
+    struct Timing
+    {
+        std::string path;
+        int width;
+        int height;
+        double decodeMs;
+    };
+
+    ThreadPool pool;
+    std::vector<Timing> timings;
+    std::mutex timingsMutex;
+};
@@ -0,0 +1,440 @@
+#include "ImpostorAtlas.h"
+#include "CompressedTexture.h"
+#include "FrameUniforms.h"
+#include "InstanceRing.h"
+#include "Shader.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace
+{
+    const char MAGIC[8] = { 'I', 'M', 'P', 'O', 'S', 'T', 'O', 'R' };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t grid;
+        uint64_t sourceHash;
+        uint32_t frameSize;
+        uint32_t levelCount;
+        float center[3];
+        float radius;
+    };
+
+    // Same basis the impostor shader builds for the quad and for every frame, right stays level with the ground
+    void FrameBasis(const glm::vec3& direction, glm::vec3& right, glm::vec3& up)
+    {
+        right = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), direction);
+        right = glm::dot(right, right) > 1e-8f ? glm::normalize(right) : glm::vec3(1.0f, 0.0f, 0.0f);
+        up = glm::cross(direction, right);
+    }
+}
+
+// The model picks the variant for its vertices and textures
+ShaderVariants ImpostorAtlas::bakeShaders("shaders/shader_instanced.vert", "shaders/impostor_bake.frag");
+ShaderProgram ImpostorAtlas::drawProgram;
+
+ImpostorAtlas::ImpostorAtlas()
+{
+    center = glm::vec3(0.0f);
+    radius = 0.0f;
+    albedoTexture = 0;
+    normalDepthTexture = 0;
+    vao = 0;
+    quadVbo = 0;
+}
+
+std::string ImpostorAtlas::CachePath(const std::string& objPath)
+{
+    size_t dot = objPath.find_last_of('.');
+    size_t slash = objPath.find_last_of("/\\");
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return objPath + ".impostor";
+    }
+    return objPath.substr(0, dot) + ".impostor";
+}
+
+bool ImpostorAtlas::Open(const std::string& cachePath, uint64_t sourceHash)
+{
+    if (!file.Open(cachePath))
+    {
+        return false;
+    }
+
+    if (!Parse(file.Data(), file.Size(), sourceHash))
+    {
+        file.Close();
+        return false;
+    }
+    return true;
+}
+
+bool ImpostorAtlas::Parse(const unsigned char* data, size_t size, uint64_t sourceHash)
+{
+    levels.clear();
+
+    if (size < sizeof(FileHeader))
+    {
+        return false;
+    }
+
+    FileHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    // A cache baked with other settings is as stale as one baked from another source
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.sourceHash != sourceHash ||
+        header.grid != GRID || header.frameSize != FRAME_SIZE || header.levelCount == 0)
+    {
+        return false;
+    }
+
+    size_t offset = sizeof(FileHeader);
+    int levelSize = GRID * FRAME_SIZE;
+
+    for (uint32_t i = 0; i < header.levelCount; i++)
+    {
+        Level level;
+        level.size = levelSize;
+        level.dataSize = TextureCompressor::CompressedSize(TextureCompressor::BC3, levelSize, levelSize);
+
+        if (offset + level.dataSize * 2 > size)
+        {
+            levels.clear();
+            return false;
+        }
+
+        level.albedo = data + offset;
+        level.normalDepth = data + offset + level.dataSize;
+        offset += level.dataSize * 2;
+
+        levels.push_back(level);
+        levelSize = std::max(levelSize / 2, 1);
+    }
+
+    center = glm::vec3(header.center[0], header.center[1], header.center[2]);
+    radius = header.radius;
+    return true;
+}
+
+bool ImpostorAtlas::Bake(const std::string& cachePath, uint64_t sourceHash, const glm::vec3& modelCenter, float modelRadius, const DrawCallback& drawModel)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const int atlasSize = GRID * FRAME_SIZE;
+
+    // Albedo and normal plus depth render targets, cleared to zero so uncovered texels are already premultiplied
+    GLuint targets[2];
+    glGenTextures(2, targets);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, targets[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    GLuint depthBuffer;
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+
+    GLint previousFramebuffer;
+    GLint previousViewport[4];
+    GLfloat previousClearColour[4];
+    GLboolean blendEnabled = glIsEnabled(GL_BLEND);
+    GLboolean depthTestEnabled = glIsEnabled(GL_DEPTH_TEST);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColour);
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets[0], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, targets[1], 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+    GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    std::vector<uint8_t> albedo;
+    std::vector<uint8_t> normalDepth;
+
+    if (complete)
+    {
+        // Blending would mix the leaf cards into the background, the bake shader cuts them out instead
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_SCISSOR_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+        // The camera sits two radii out so the whole sphere is between the clip planes. The bake shader reads the
+        // radius back out of the projection.
+        float distance = 2.0f * modelRadius;
+        glm::mat4 projection = glm::ortho(-modelRadius, modelRadius, -modelRadius, modelRadius, distance - modelRadius, distance + modelRadius);
+
+        // Every frame has its own camera, the game's goes back once they're done
+        FrameUniforms* frameUniforms = FrameUniforms::GetInstance();
+        FrameUniforms::Data gameFrame = frameUniforms->Get();
+
+        for (unsigned int y = 0; y < GRID; y++)
+        {
+            for (unsigned int x = 0; x < GRID; x++)
+            {
+                glViewport(x * FRAME_SIZE, y * FRAME_SIZE, FRAME_SIZE, FRAME_SIZE);
+                glScissor(x * FRAME_SIZE, y * FRAME_SIZE, FRAME_SIZE, FRAME_SIZE);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                glm::vec3 direction = FrameDirection(x, y);
+                glm::vec3 right, up;
+                FrameBasis(direction, right, up);
+
+                glm::mat4 view = glm::lookAt(modelCenter + direction * distance, modelCenter, up);
+                frameUniforms->Update(view, projection);
+                drawModel(bakeShaders);
+            }
+        }
+
+        frameUniforms->Set(gameFrame);
+
+        glDisable(GL_SCISSOR_TEST);
+
+        albedo.resize((size_t)atlasSize * atlasSize * 4);
+        normalDepth.resize((size_t)atlasSize * atlasSize * 4);
+
+        glBindTexture(GL_TEXTURE_2D, targets[0]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, albedo.data());
+        glBindTexture(GL_TEXTURE_2D, targets[1]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, normalDepth.data());
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glClearColor(previousClearColour[0], previousClearColour[1], previousClearColour[2], previousClearColour[3]);
+    if (blendEnabled)
+    {
+        glEnable(GL_BLEND);
+    }
+    if (!depthTestEnabled)
+    {
+        glDisable(GL_DEPTH_TEST);
+    }
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteTextures(2, targets);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (!complete)
+    {
+        printf("Impostor framebuffer is incomplete: %s\n", cachePath.c_str());
+        return false;
+    }
+
+    FileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.grid = GRID;
+    header.sourceHash = sourceHash;
+    header.frameSize = FRAME_SIZE;
+    header.levelCount = 0;
+    header.center[0] = modelCenter.x;
+    header.center[1] = modelCenter.y;
+    header.center[2] = modelCenter.z;
+    header.radius = modelRadius;
+
+    bakedData.assign((const unsigned char*)&header, (const unsigned char*)&header + sizeof(header));
+
+    // Frames are powers of two wide, so the 2x2 box filter never reaches into a neighbouring frame. Coverage
+    // was binary, so the filtered texels stay premultiplied.
+    int levelSize = atlasSize;
+    for (unsigned int frameSize = FRAME_SIZE; frameSize >= MIN_FRAME_SIZE; frameSize /= 2)
+    {
+        std::vector<uint8_t> blocks = TextureCompressor::Compress(TextureCompressor::BC3, albedo.data(), levelSize, levelSize);
+        bakedData.insert(bakedData.end(), blocks.begin(), blocks.end());
+
+        blocks = TextureCompressor::Compress(TextureCompressor::BC3, normalDepth.data(), levelSize, levelSize);
+        bakedData.insert(bakedData.end(), blocks.begin(), blocks.end());
+
+        header.levelCount++;
+
+        if (frameSize / 2 >= MIN_FRAME_SIZE)
+        {
+            int mipSize = levelSize;
+            albedo = TextureCompressor::Downsample(albedo.data(), levelSize, levelSize, mipSize, mipSize);
+            normalDepth = TextureCompressor::Downsample(normalDepth.data(), levelSize, levelSize, mipSize, mipSize);
+            levelSize = mipSize;
+        }
+    }
+
+    memcpy(bakedData.data(), &header, sizeof(header));
+    Parse(bakedData.data(), bakedData.size(), sourceHash);
+
+    // Write to a temporary file so a crash never leaves a half written cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    out.write((const char*)bakedData.data(), bakedData.size());
+    out.close();
+
+    if (!out)
+    {
+        std::remove(tempPath.c_str());
+        printf("Failed to write impostor cache: %s\n", cachePath.c_str());
+    }
+    else
+    {
+        std::remove(cachePath.c_str());
+        std::rename(tempPath.c_str(), cachePath.c_str());
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    printf("Baked impostor %s (%u frames, %u levels) in %.1f ms\n", cachePath.c_str(), GRID * GRID, header.levelCount, std::chrono::duration<double, std::milli>(stop - start).count());
+    return true;
+}
+
+void ImpostorAtlas::Upload()
+{
+    if (levels.empty())
+    {
+        return;
+    }
+
+    if (drawProgram.Id() == 0)
+    {
+        drawProgram = ShaderProgram(Shader::GetInstance()->CreateProgram("shaders/impostor.vert", "shaders/impostor.frag", ShaderVariants::Defines(ShaderVariants::FOG)));
+        // These never change, every impostor uses the same grid and texture units. The rest is set by RenderQueue.
+        drawProgram.Get<int>("impostorGrid").Set(GRID);
+        drawProgram.Get<int>("albedoAtlas").Set(0);
+        drawProgram.Get<int>("normalDepthAtlas").Set(1);
+    }
+
+    GLuint textures[2];
+    glGenTextures(2, textures);
+    albedoTexture = textures[0];
+    normalDepthTexture = textures[1];
+
+    for (int t = 0; t < 2; t++)
+    {
+        glBindTexture(GL_TEXTURE_2D, textures[t]);
+
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            const Level& level = levels[i];
+            const unsigned char* blocks = t == 0 ? level.albedo : level.normalDepth;
+
+            if (CompressedTexture::IsSupported())
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, level.size, level.size, 0, (GLsizei)level.dataSize, blocks);
+            }
+            else
+            {
+                std::vector<uint8_t> pixels = TextureCompressor::Decompress(TextureCompressor::BC3, blocks, level.size, level.size);
+                glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, level.size, level.size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            }
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Unit quad as a strip, every instance stretches it to its bounding sphere
+    const float corners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &quadVbo);
+
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // The instances come from whichever buffer Submit is given, RenderQueue points the attribute at them
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The textures hold everything now
+    levels.clear();
+    bakedData = std::vector<unsigned char>();
+    file.Close();
+}
+
+void ImpostorAtlas::Submit(RenderQueue& queue, const std::vector<glm::vec4>& instances, float depth, const glm::vec2& fade, float shininess, float specularIntensity)
+{
+    if (!IsReady() || instances.empty())
+    {
+        return;
+    }
+
+    GLintptr offset;
+    glm::vec4* ringInstances = InstanceRing::GetInstance()->Allocate<glm::vec4>(instances.size(), offset);
+    std::copy(instances.begin(), instances.end(), ringInstances);
+
+    Submit(queue, InstanceRing::GetInstance()->Buffer(), offset, instances.size(), depth, fade, shininess, specularIntensity);
+}
+
+void ImpostorAtlas::Submit(RenderQueue& queue, GLuint buffer, GLintptr offset, size_t count, float depth, const glm::vec2& fade, float shininess, float specularIntensity)
+{
+    if (!IsReady() || count == 0)
+    {
+        return;
+    }
+
+    RenderItem item;
+    item.program = &drawProgram;
+    item.vao = vao;
+    item.textures[0] = albedoTexture;
+    item.textures[1] = normalDepthTexture;
+    item.instanceFormat = RenderItem::INSTANCE_POSITIONS;
+    item.instanceBuffer = buffer;
+    item.shininess = shininess;
+    item.specularIntensity = specularIntensity;
+    item.impostorFade = fade;
+    item.impostorCenter = center;
+    item.impostorRadius = radius;
+    item.count = 4;
+    item.instanceCount = (GLsizei)count;
+    item.baseInstance = (GLuint)(offset / sizeof(glm::vec4));
+
+    queue.Submit(RenderQueue::PASS_IMPOSTOR, depth, item);
+}
+
+// Frames sit on a regular grid over [-1, 1]^2 that includes the edges, which are the horizon
+glm::vec3 ImpostorAtlas::FrameDirection(unsigned int x, unsigned int y)
+{
+    glm::vec2 encoded = glm::vec2((float)x, (float)y) / (float)(GRID - 1) * 2.0f - 1.0f;
+    return HemiOctDecode(encoded);
+}
+
+glm::vec2 ImpostorAtlas::HemiOctEncode(const glm::vec3& direction)
+{
+    glm::vec3 d = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+    return glm::vec2(d.x + d.z, d.x - d.z);
+}
+
+glm::vec3 ImpostorAtlas::HemiOctDecode(const glm::vec2& encoded)
+{
+    glm::vec2 p = glm::vec2(encoded.x + encoded.y, encoded.x - encoded.y) * 0.5f;
+    return glm::normalize(glm::vec3(p.x, 1.0f - std::abs(p.x) - std::abs(p.y), p.y));
+}
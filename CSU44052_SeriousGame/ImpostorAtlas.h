@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "RenderQueue.h"
+#include "ShaderVariants.h"
+
+// Hemi-octahedral impostor of a model: the model rendered from GRID x GRID directions over the upper hemisphere
+// into an albedo atlas and a normal and depth atlas. A far instance draws as one camera facing quad that blends
+// the three frames closest to its view direction and writes the baked depth, so it still sits in the ground
+// and behind nearer trees. Both atlases are BC3 compressed with their mips and cached in a .impostor file.
+class ImpostorAtlas
+{
+public:
+    // Bump when the baking changes so old files get rebuilt
+    static const uint32_t VERSION = 1;
+
+    // Frames per side of the atlas, and the size of one frame in pixels
+    static const unsigned int GRID = 8;
+    static const unsigned int FRAME_SIZE = 256;
+
+    // Mips stop once a frame is one block across
+    static const unsigned int MIN_FRAME_SIZE = 4;
+
+    // Called with the bake shaders once FrameUniforms holds the camera of a frame, should draw the model
+    // untransformed at full detail
+    typedef std::function<void(ShaderVariants&)> DrawCallback;
+
+    ImpostorAtlas();
+
+    static std::string CachePath(const std::string& objPath);
+
+    // Map a cached impostor baked from this exact source, doesn't touch GL so it can run on a worker thread
+    bool Open(const std::string& cachePath, uint64_t sourceHash);
+
+    // Render every frame around the bounding sphere, compress the atlases and write the cache
+    bool Bake(const std::string& cachePath, uint64_t sourceHash, const glm::vec3& modelCenter, float modelRadius, const DrawCallback& drawModel);
+
+    // True after Open or Bake worked, until Upload
+    bool HasData() const { return !levels.empty(); }
+
+    // Create the atlas textures from the opened or baked data and let go of it
+    void Upload();
+
+    bool IsReady() const { return albedoTexture != 0; }
+
+    // Queue one quad per instance, xyz is the model origin and w its scale. Instance rotation is ignored, the
+    // frames only cover an upright model. depth is the distance to the nearest one. fade is the distance range
+    // the mesh fades out over, the impostor draws the other half of the dither pattern inside it. The camera
+    // comes from FrameUniforms.
+    void Submit(RenderQueue& queue, const std::vector<glm::vec4>& instances, float depth, const glm::vec2& fade, float shininess, float specularIntensity);
+
+    // Same with the instances already in a buffer, count of them from offset, which is a multiple of a vec4
+    void Submit(RenderQueue& queue, GLuint buffer, GLintptr offset, size_t count, float depth, const glm::vec2& fade, float shininess, float specularIntensity);
+
+    // Direction from the model towards the camera frame (x, y) was rendered from
+    static glm::vec3 FrameDirection(unsigned int x, unsigned int y);
+
+    // Unit direction on the upper hemisphere to [-1, 1]^2 and back
+    static glm::vec2 HemiOctEncode(const glm::vec3& direction);
+
+    static glm::vec3 HemiOctDecode(const glm::vec2& encoded);
+
+private:
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    // Check the header against the source and point the levels into data
+    bool Parse(const unsigned char* data, size_t size, uint64_t sourceHash);
+
+    struct Level
+    {
+        int size;
+        size_t dataSize;
+        const unsigned char* albedo;
+        const unsigned char* normalDepth;
+    };
+
+    MappedFile file;
+    std::vector<unsigned char> bakedData;
+    std::vector<Level> levels;
+
+    glm::vec3 center;
+    float radius;
+
+    GLuint albedoTexture;
+    GLuint normalDepthTexture;
+    GLuint vao;
+    GLuint quadVbo;
+
+    static ShaderVariants bakeShaders;
+    static ShaderProgram drawProgram;
+};
@@ -0,0 +1,115 @@
+#include "InstanceGroup.h"
+
+#include <algorithm>
+
+namespace
+{
+    // An all zero instance matrix means the model matrix alone. It's stored as the identity so nothing that reads
+    // the matrices, the shader included, has to check.
+    glm::mat4 Normalize(const glm::mat4& matrix)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (matrix[i] != glm::vec4(0.0f))
+            {
+                return matrix;
+            }
+        }
+        return glm::mat4(1.0f);
+    }
+}
+
+InstanceGroup::InstanceGroup(Usage usage)
+    : usage(usage)
+{
+    dirtyFirst = 0;
+    dirtyEnd = 0;
+    buffer = 0;
+    capacity = 0;
+}
+
+size_t InstanceGroup::Add(const glm::mat4& matrix)
+{
+    matrices.push_back(Normalize(matrix));
+    MarkDirty(matrices.size() - 1);
+    return matrices.size() - 1;
+}
+
+void InstanceGroup::Set(size_t index, const glm::mat4& matrix)
+{
+    matrices[index] = Normalize(matrix);
+    MarkDirty(index);
+}
+
+void InstanceGroup::Remove(size_t index)
+{
+    size_t last = matrices.size() - 1;
+    if (index != last)
+    {
+        matrices[index] = matrices[last];
+        MarkDirty(index);
+    }
+    matrices.pop_back();
+
+    // Whatever sat past the end doesn't need sending any more
+    dirtyEnd = std::min(dirtyEnd, matrices.size());
+    dirtyFirst = std::min(dirtyFirst, dirtyEnd);
+}
+
+void InstanceGroup::MarkDirty(size_t index)
+{
+    if (dirtyFirst == dirtyEnd)
+    {
+        dirtyFirst = index;
+        dirtyEnd = index + 1;
+    }
+    else
+    {
+        dirtyFirst = std::min(dirtyFirst, index);
+        dirtyEnd = std::max(dirtyEnd, index + 1);
+    }
+}
+
+size_t InstanceGroup::Upload()
+{
+    if (usage != STATIC)
+    {
+        return 0;
+    }
+
+    // Grow to twice the size and send everything, the old copy is dropped once the draws using it are done
+    if (matrices.size() > capacity || buffer == 0)
+    {
+        capacity = std::max(matrices.size(), std::max(capacity * 2, (size_t)16));
+
+        // Named before the old one goes so the name differs, RenderQueue tells buffers apart by it
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        if (buffer != 0)
+        {
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = grown;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_STORAGE_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        dirtyFirst = 0;
+        dirtyEnd = matrices.size();
+    }
+
+    if (dirtyFirst == dirtyEnd)
+    {
+        return 0;
+    }
+
+    size_t bytes = (dirtyEnd - dirtyFirst) * sizeof(glm::mat4);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, dirtyFirst * sizeof(glm::mat4), bytes, &matrices[dirtyFirst]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    dirtyFirst = 0;
+    dirtyEnd = 0;
+    return bytes;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// The instance matrices of one Model, kept here instead of rebuilt into a vector every frame. A DYNAMIC group is
+// for instances that move all the time, Model streams all of it through InstanceRing every frame. A STATIC group
+// keeps a copy on the GPU in the same order and Upload only sends the range changed since the last one, so
+// instances that never move cost nothing per frame. Removing swaps the last instance into the gap, which dirties
+// one matrix and never shifts the rest.
+class InstanceGroup
+{
+public:
+    enum Usage
+    {
+        STATIC,
+        DYNAMIC
+    };
+
+    explicit InstanceGroup(Usage usage);
+
+    bool IsStatic() const { return usage == STATIC; }
+
+    // Index of the new instance. An all zero matrix is stored as the identity, the instance is the model matrix
+    // alone.
+    size_t Add(const glm::mat4& matrix);
+
+    // Zero like Add
+    void Set(size_t index, const glm::mat4& matrix);
+
+    // The last instance takes the place of the removed one
+    void Remove(size_t index);
+
+    size_t Size() const { return matrices.size(); }
+
+    const glm::mat4& operator[](size_t index) const { return matrices[index]; }
+
+    const std::vector<glm::mat4>& Matrices() const { return matrices; }
+
+    // Bring the GPU copy of a STATIC group up to date. Returns the bytes sent, none when nothing changed.
+    size_t Upload();
+
+    // The GPU copy, a mat4 per instance, read as the InstanceMatrices storage buffer. Changes when the group grows.
+    GLuint Buffer() const { return buffer; }
+
+private:
+    InstanceGroup(const InstanceGroup&) = delete;
+    InstanceGroup& operator=(const InstanceGroup&) = delete;
+
+    void MarkDirty(size_t index);
+
+    Usage usage;
+    std::vector<glm::mat4> matrices;
+
+    // Matrices from dirtyFirst up to dirtyEnd differ from the GPU copy
+    size_t dirtyFirst;
+    size_t dirtyEnd;
+
+    GLuint buffer;
+    size_t capacity;
+};
@@ -0,0 +1,112 @@
+#include "InstanceRing.h"
+
+#include <algorithm>
+
+InstanceRing* InstanceRing::GetInstance()
+{
+    static InstanceRing* pInstanceRing = new InstanceRing();
+    return pInstanceRing;
+}
+
+InstanceRing::InstanceRing()
+{
+    buffer = 0;
+    mapped = NULL;
+    frameSize = 0;
+    frame = 0;
+    used = 0;
+    frameBytes = 0;
+    fenceWaits = 0;
+
+    for (unsigned int i = 0; i < FRAMES; i++)
+    {
+        fences[i] = 0;
+    }
+}
+
+void InstanceRing::BeginFrame()
+{
+    frameBytes = 0;
+
+    // Last frame's draws are issued, GL keeps the buffers alive until the GPU is done with them
+    if (!retiredBuffers.empty())
+    {
+        glDeleteBuffers((GLsizei)retiredBuffers.size(), retiredBuffers.data());
+        retiredBuffers.clear();
+    }
+
+    // Nothing has been drawn from it yet
+    if (buffer == 0)
+    {
+        return;
+    }
+
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % FRAMES;
+    used = 0;
+
+    if (fences[frame] != 0)
+    {
+        // Only counts as a wait when the GPU hasn't finished with it already
+        GLenum result = glClientWaitSync(fences[frame], 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            fenceWaits++;
+            do
+            {
+                result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+
+        glDeleteSync(fences[frame]);
+        fences[frame] = 0;
+    }
+}
+
+void* InstanceRing::Allocate(GLsizeiptr size, GLintptr& offset)
+{
+    GLsizeiptr start = (used + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (buffer == 0 || start + size > frameSize)
+    {
+        GLsizeiptr grown = std::max(frameSize * 2, size);
+        Grow(grown < INITIAL_FRAME_SIZE ? INITIAL_FRAME_SIZE : grown);
+        start = 0;
+    }
+
+    used = start + size;
+    frameBytes += size;
+
+    offset = frame * frameSize + start;
+    return mapped + offset;
+}
+
+void InstanceRing::Grow(GLsizeiptr frame_size)
+{
+    // Draws queued from the old buffer still need its name, none of its fences matter to the new one
+    if (buffer != 0)
+    {
+        retiredBuffers.push_back(buffer);
+    }
+
+    for (unsigned int i = 0; i < FRAMES; i++)
+    {
+        if (fences[i] != 0)
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+
+    frameSize = (frame_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    // Coherent, so what's written is there for the next draw without a flush
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferStorage(GL_ARRAY_BUFFER, frameSize * FRAMES, NULL, flags);
+    mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, frameSize * FRAMES, flags);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    used = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+// Streams per instance data to the GPU. One buffer made with glBufferStorage stays mapped for good and is split
+// into FRAMES parts, a frame writes into its own part while the GPU may still read the two before it. A fence at
+// the start of every frame marks where the last one's draws end, the part is only written again once it passed.
+// Running out of room mid frame moves everything to a buffer twice the size, so there's no instance limit.
+// Allocations stay at a multiple of ALIGNMENT, so a draw can pick its instances with baseInstance.
+class InstanceRing
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    // Room per frame to begin with, 4096 matrices
+    static const GLsizeiptr INITIAL_FRAME_SIZE = 256 * 1024;
+
+    // Every allocation starts on a matrix boundary
+    static const GLsizeiptr ALIGNMENT = 64;
+
+    static InstanceRing* GetInstance();
+
+    // Fence the frame before and move on to the next part, waiting for the GPU if it's still reading it
+    void BeginFrame();
+
+    // Room for size bytes valid until the same frame comes round again. Returns where to write and sets offset
+    // to where that is in Buffer(). Writes show up without a flush, but the buffer may change with any Allocate,
+    // so bind it after.
+    void* Allocate(GLsizeiptr size, GLintptr& offset);
+
+    template <typename T>
+    T* Allocate(size_t count, GLintptr& offset)
+    {
+        return (T*)Allocate((GLsizeiptr)(count * sizeof(T)), offset);
+    }
+
+    GLuint Buffer() const { return buffer; }
+
+    // Bytes handed out since BeginFrame
+    size_t FrameBytes() const { return frameBytes; }
+
+    // Times BeginFrame had to wait for the GPU since the start
+    size_t FenceWaits() const { return fenceWaits; }
+
+private:
+    InstanceRing();
+
+    // Replace the buffer with one where a frame holds at least frame_size bytes
+    void Grow(GLsizeiptr frame_size);
+
+    GLuint buffer;
+    unsigned char* mapped;
+    GLsizeiptr frameSize;
+
+    // Buffers grown out of, draws queued this frame may still point at them so they go at the next BeginFrame
+    std::vector<GLuint> retiredBuffers;
+
+    unsigned int frame;
+    GLsizeiptr used;
+    GLsync fences[FRAMES];
+
+    size_t frameBytes;
+    size_t fenceWaits;
+};
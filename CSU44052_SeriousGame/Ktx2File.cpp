@@ -0,0 +1,319 @@
+#include "Ktx2File.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    // Identifier, header and index come before the level index
+    const size_t LEVEL_INDEX_OFFSET = 80;
+    const size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+    const char SOURCE_HASH_KEY[] = "SourceHash";
+    const char WRITER_KEY[] = "KTXwriter";
+    const char WRITER[] = "CSU44052_SeriousGame";
+
+    // Khronos data format descriptor values
+    const uint32_t KHR_DF_MODEL_BC1A = 128;
+    const uint32_t KHR_DF_MODEL_BC3 = 130;
+    const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+    const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+    const uint32_t KHR_DF_CHANNEL_COLOR = 0;
+    const uint32_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+
+    void Put32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            out.push_back((uint8_t)(value >> (i * 8)));
+        }
+    }
+
+    void Put64(std::vector<uint8_t>& out, uint64_t value)
+    {
+        Put32(out, (uint32_t)value);
+        Put32(out, (uint32_t)(value >> 32));
+    }
+
+    uint32_t Get32(const unsigned char* bytes)
+    {
+        return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    }
+
+    uint64_t Get64(const unsigned char* bytes)
+    {
+        return (uint64_t)Get32(bytes) | ((uint64_t)Get32(bytes + 4) << 32);
+    }
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool FormatFor(uint32_t vkFormat, TextureCompressor::Format& format)
+    {
+        if (vkFormat == Ktx2File::FORMAT_BC1_RGB_UNORM)
+        {
+            format = TextureCompressor::BC1;
+            return true;
+        }
+        if (vkFormat == Ktx2File::FORMAT_BC3_UNORM)
+        {
+            format = TextureCompressor::BC3;
+            return true;
+        }
+        return false;
+    }
+
+    // Basic data format descriptor for a BC1 or BC3 block
+    std::vector<uint8_t> BuildDfd(TextureCompressor::Format format)
+    {
+        uint32_t sampleCount = format == TextureCompressor::BC3 ? 2 : 1;
+        uint32_t blockSize = 24 + 16 * sampleCount;
+
+        std::vector<uint8_t> dfd;
+        Put32(dfd, 4 + blockSize);
+        Put32(dfd, 0);
+        Put32(dfd, 2 | (blockSize << 16));
+        Put32(dfd, (format == TextureCompressor::BC3 ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A) | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+        Put32(dfd, 3 | (3 << 8));
+        Put32(dfd, TextureCompressor::BlockSize(format));
+        Put32(dfd, 0);
+
+        auto putSample = [&](uint32_t bitOffset, uint32_t channel)
+        {
+            Put32(dfd, bitOffset | (63 << 16) | (channel << 24));
+            Put32(dfd, 0);
+            Put32(dfd, 0);
+            Put32(dfd, 0xFFFFFFFF);
+        };
+
+        if (format == TextureCompressor::BC3)
+        {
+            putSample(0, KHR_DF_CHANNEL_BC3_ALPHA);
+            putSample(64, KHR_DF_CHANNEL_COLOR);
+        }
+        else
+        {
+            putSample(0, KHR_DF_CHANNEL_COLOR);
+        }
+        return dfd;
+    }
+
+    void PutKeyValue(std::vector<uint8_t>& out, const char* key, const std::string& value)
+    {
+        uint32_t length = (uint32_t)(strlen(key) + 1 + value.size() + 1);
+        Put32(out, length);
+        out.insert(out.end(), key, key + strlen(key) + 1);
+        out.insert(out.end(), value.c_str(), value.c_str() + value.size() + 1);
+        out.resize(AlignUp(out.size(), 4), 0);
+    }
+}
+
+Ktx2File::Ktx2File()
+{
+    vkFormat = 0;
+    width = 0;
+    height = 0;
+    faceCount = 0;
+    sourceHash = 0;
+}
+
+bool Ktx2File::Write(const std::string& path, uint32_t vkFormat, int width, int height, int faceCount, const std::vector<std::vector<uint8_t>>& levels, uint64_t sourceHash)
+{
+    TextureCompressor::Format format;
+    if (!FormatFor(vkFormat, format) || levels.empty())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> dfd = BuildDfd(format);
+
+    // Keys are sorted
+    char hashText[17];
+    snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)sourceHash);
+    std::vector<uint8_t> kvd;
+    PutKeyValue(kvd, WRITER_KEY, WRITER);
+    PutKeyValue(kvd, SOURCE_HASH_KEY, hashText);
+
+    size_t dfdOffset = LEVEL_INDEX_OFFSET + levels.size() * LEVEL_INDEX_ENTRY_SIZE;
+    size_t kvdOffset = dfdOffset + dfd.size();
+
+    // Level data goes smallest mip first, each level aligned to the block size
+    size_t alignment = TextureCompressor::BlockSize(format);
+    std::vector<size_t> levelOffsets(levels.size());
+    size_t offset = kvdOffset + kvd.size();
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        offset = AlignUp(offset, alignment);
+        levelOffsets[i] = offset;
+        offset += levels[i].size();
+    }
+
+    std::vector<uint8_t> head(IDENTIFIER, IDENTIFIER + sizeof(IDENTIFIER));
+    Put32(head, vkFormat);
+    Put32(head, 1);
+    Put32(head, (uint32_t)width);
+    Put32(head, (uint32_t)height);
+    Put32(head, 0);
+    Put32(head, 0);
+    Put32(head, (uint32_t)faceCount);
+    Put32(head, (uint32_t)levels.size());
+    Put32(head, 0);
+
+    Put32(head, (uint32_t)dfdOffset);
+    Put32(head, (uint32_t)dfd.size());
+    Put32(head, (uint32_t)kvdOffset);
+    Put32(head, (uint32_t)kvd.size());
+    Put64(head, 0);
+    Put64(head, 0);
+
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        Put64(head, levelOffsets[i]);
+        Put64(head, levels[i].size());
+        Put64(head, levels[i].size());
+    }
+
+    head.insert(head.end(), dfd.begin(), dfd.end());
+    head.insert(head.end(), kvd.begin(), kvd.end());
+
+    // Write to a temporary file so a crash never leaves a half written texture behind
+    std::string tempPath = path + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        printf("Failed to write compressed texture: %s\n", path.c_str());
+        return false;
+    }
+
+    out.write((const char*)head.data(), head.size());
+
+    const char padding[16] = {};
+    size_t written = head.size();
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        out.write(padding, levelOffsets[i] - written);
+        out.write((const char*)levels[i].data(), levels[i].size());
+        written = levelOffsets[i] + levels[i].size();
+    }
+
+    out.close();
+    if (!out)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(path.c_str());
+    return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+bool Ktx2File::Open(const std::string& path)
+{
+    Close();
+
+    if (!file.Open(path) || file.Size() < LEVEL_INDEX_OFFSET || memcmp(file.Data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    const unsigned char* header = file.Data() + sizeof(IDENTIFIER);
+    vkFormat = Get32(header);
+    uint32_t typeSize = Get32(header + 4);
+    width = (int)Get32(header + 8);
+    height = (int)Get32(header + 12);
+    uint32_t pixelDepth = Get32(header + 16);
+    uint32_t layerCount = Get32(header + 20);
+    faceCount = (int)Get32(header + 24);
+    uint32_t levelCount = Get32(header + 28);
+    uint32_t supercompression = Get32(header + 32);
+    uint32_t kvdOffset = Get32(header + 44);
+    uint32_t kvdLength = Get32(header + 48);
+
+    TextureCompressor::Format format;
+    if (!FormatFor(vkFormat, format) || typeSize != 1 || width <= 0 || height <= 0 || pixelDepth != 0 || layerCount != 0
+        || (faceCount != 1 && faceCount != 6) || levelCount == 0 || (int)levelCount > TextureCompressor::MipLevelCount(width, height)
+        || supercompression != 0 || LEVEL_INDEX_OFFSET + levelCount * LEVEL_INDEX_ENTRY_SIZE > file.Size())
+    {
+        Close();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        const unsigned char* entry = file.Data() + LEVEL_INDEX_OFFSET + i * LEVEL_INDEX_ENTRY_SIZE;
+        uint64_t offset = Get64(entry);
+        uint64_t length = Get64(entry + 8);
+
+        int levelWidth = std::max(1, width >> i);
+        int levelHeight = std::max(1, height >> i);
+
+        if (length != TextureCompressor::CompressedSize(format, levelWidth, levelHeight) * faceCount || offset > file.Size() || length > file.Size() - offset)
+        {
+            Close();
+            return false;
+        }
+
+        Level level;
+        level.data = file.Data() + offset;
+        level.size = (size_t)length;
+        levels.push_back(level);
+    }
+
+    // Files without a source hash are treated as stale
+    if (kvdOffset <= file.Size() && kvdLength <= file.Size() - kvdOffset)
+    {
+        const unsigned char* entry = file.Data() + kvdOffset;
+        const unsigned char* end = entry + kvdLength;
+
+        while (end - entry >= 4)
+        {
+            uint32_t length = Get32(entry);
+            const char* key = (const char*)entry + 4;
+            if (length > (size_t)(end - entry) - 4)
+            {
+                break;
+            }
+
+            size_t keyLength = strnlen(key, length);
+            if (keyLength < length && strcmp(key, SOURCE_HASH_KEY) == 0)
+            {
+                std::string value(key + keyLength + 1, strnlen(key + keyLength + 1, length - keyLength - 1));
+                sourceHash = strtoull(value.c_str(), nullptr, 16);
+            }
+
+            entry += AlignUp(4 + length, 4);
+        }
+    }
+
+    return true;
+}
+
+void Ktx2File::Close()
+{
+    file.Close();
+    vkFormat = 0;
+    width = 0;
+    height = 0;
+    faceCount = 0;
+    sourceHash = 0;
+    levels.clear();
+}
+
+size_t Ktx2File::DataSize() const
+{
+    size_t size = 0;
+    for (const auto& level : levels)
+    {
+        size += level.size;
+    }
+    return size;
+}
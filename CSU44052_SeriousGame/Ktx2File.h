@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Reader and writer for the subset of KTX2 the game uses: BC1/BC3 2D textures and cubemaps with a full mip chain,
+// no supercompression. The hash of the source image(s) is kept in the key/value data so stale files can be detected.
+class Ktx2File
+{
+public:
+    // VkFormat values
+    static const uint32_t FORMAT_BC1_RGB_UNORM = 131;
+    static const uint32_t FORMAT_BC3_UNORM = 137;
+
+    // One mip level, the faces of a cubemap are stored back to back in +X -X +Y -Y +Z -Z order
+    struct Level
+    {
+        const unsigned char* data;
+        size_t size;
+    };
+
+    Ktx2File();
+
+    static bool Write(const std::string& path, uint32_t vkFormat, int width, int height, int faceCount, const std::vector<std::vector<uint8_t>>& levels, uint64_t sourceHash);
+
+    bool Open(const std::string& path);
+
+    void Close();
+
+    bool IsOpen() const { return file.IsOpen(); }
+
+    uint32_t VkFormat() const { return vkFormat; }
+
+    int Width() const { return width; }
+
+    int Height() const { return height; }
+
+    int FaceCount() const { return faceCount; }
+
+    int LevelCount() const { return (int)levels.size(); }
+
+    const Level& GetLevel(int index) const { return levels[index]; }
+
+    uint64_t SourceHash() const { return sourceHash; }
+
+    // Size in bytes of all the texture data
+    size_t DataSize() const;
+
+private:
+    MappedFile file;
+    uint32_t vkFormat;
+    int width;
+    int height;
+    int faceCount;
+    uint64_t sourceHash;
+    std::vector<Level> levels;
+};
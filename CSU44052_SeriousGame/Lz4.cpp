@@ -0,0 +1,219 @@
+#include "Lz4.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const size_t MIN_MATCH = 4;
+
+    // The format needs the last five bytes to be literals and the last match to start twelve bytes before the end
+    const size_t LAST_LITERALS = 5;
+    const size_t MATCH_FIND_LIMIT = 12;
+
+    const size_t MAX_OFFSET = 65535;
+    const int HASH_BITS = 16;
+
+    uint32_t Read32(const unsigned char* bytes)
+    {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    uint32_t Hash(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Lengths that don't fit in the token's nibble carry on in bytes of 255
+    unsigned char* WriteLength(unsigned char* out, size_t length)
+    {
+        while (length >= 255)
+        {
+            *out++ = 255;
+            length -= 255;
+        }
+        *out++ = (unsigned char)length;
+        return out;
+    }
+
+    unsigned char* WriteSequence(unsigned char* out, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+        unsigned char* token = out++;
+        *token = (unsigned char)((literalLength < 15 ? literalLength : 15) << 4);
+        if (literalLength >= 15)
+        {
+            out = WriteLength(out, literalLength - 15);
+        }
+
+        memcpy(out, literals, literalLength);
+        out += literalLength;
+
+        // The last sequence is only literals
+        if (matchLength == 0)
+        {
+            return out;
+        }
+
+        *out++ = (unsigned char)(offset & 0xFF);
+        *out++ = (unsigned char)(offset >> 8);
+
+        size_t length = matchLength - MIN_MATCH;
+        *token |= (unsigned char)(length < 15 ? length : 15);
+        if (length >= 15)
+        {
+            out = WriteLength(out, length - 15);
+        }
+        return out;
+    }
+
+    bool ReadLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+    {
+        unsigned char next;
+        do
+        {
+            if (in >= end)
+            {
+                return false;
+            }
+            next = *in++;
+            length += next;
+        } while (next == 255);
+        return true;
+    }
+}
+
+size_t Lz4::Compress(const unsigned char* source, size_t size, unsigned char* destination)
+{
+    unsigned char* out = destination;
+    size_t anchor = 0;
+
+    if (size > MATCH_FIND_LIMIT)
+    {
+        // Position + 1 of the last place each hash was seen, 0 for never
+        std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0);
+
+        size_t matchEnd = size - LAST_LITERALS;
+        size_t position = 0;
+
+        while (position + MATCH_FIND_LIMIT <= size)
+        {
+            uint32_t sequence = Read32(source + position);
+            uint32_t& slot = table[Hash(sequence)];
+            size_t candidate = slot;
+            slot = (uint32_t)(position + 1);
+
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || Read32(source + candidate - 1) != sequence)
+            {
+                position++;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+
+            // Grow the match back into the pending literals, then forward as far as the format allows
+            while (position > anchor && match > 0 && source[position - 1] == source[match - 1])
+            {
+                position--;
+                match--;
+            }
+
+            size_t length = MIN_MATCH;
+            while (position + length < matchEnd && source[position + length] == source[match + length])
+            {
+                length++;
+            }
+
+            out = WriteSequence(out, source + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+        }
+    }
+
+    out = WriteSequence(out, source + anchor, size - anchor, 0, 0);
+    return (size_t)(out - destination);
+}
+
+bool Lz4::Decompress(const unsigned char* source, size_t sourceSize, unsigned char* destination, size_t destinationSize)
+{
+    const unsigned char* in = source;
+    const unsigned char* inEnd = source + sourceSize;
+    unsigned char* out = destination;
+    unsigned char* outEnd = destination + destinationSize;
+
+    while (in < inEnd)
+    {
+        unsigned char token = *in++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(in, inEnd, literalLength))
+        {
+            return false;
+        }
+
+        if (literalLength > (size_t)(inEnd - in) || literalLength > (size_t)(outEnd - out))
+        {
+            return false;
+        }
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        // The block ends after the literals of the last sequence
+        if (in == inEnd)
+        {
+            break;
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+        size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+        in += 2;
+
+        if (offset == 0 || offset > (size_t)(out - destination))
+        {
+            return false;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, inEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+
+        if (matchLength > (size_t)(outEnd - out))
+        {
+            return false;
+        }
+
+        // A match can overlap what it's writing, so it's only copied in pieces no longer than the offset
+        const unsigned char* match = out - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(out, match, matchLength);
+        }
+        else
+        {
+            size_t i = 0;
+            if (offset >= 8)
+            {
+                for (; i + 8 <= matchLength; i += 8)
+                {
+                    memcpy(out + i, match + i, 8);
+                }
+            }
+            for (; i < matchLength; i++)
+            {
+                out[i] = match[i];
+            }
+        }
+        out += matchLength;
+    }
+
+    return out == outEnd;
+}
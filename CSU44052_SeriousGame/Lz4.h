@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// Compressor and decompressor for the LZ4 block format, used for the archive entries that are worth packing
+// smaller. The compressor is the plain greedy one with a single hash table, decompression is what matters
+// since it runs on every load.
+class Lz4
+{
+public:
+    // Largest output Compress can produce for size bytes of input
+    static size_t CompressBound(size_t size) { return size + size / 255 + 16; }
+
+    // Returns the compressed size, destination needs CompressBound(size) bytes
+    static size_t Compress(const unsigned char* source, size_t size, unsigned char* destination);
+
+    // False if the block is malformed or doesn't decompress to exactly destinationSize bytes
+    static bool Decompress(const unsigned char* source, size_t sourceSize, unsigned char* destination, size_t destinationSize);
+};
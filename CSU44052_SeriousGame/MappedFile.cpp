@@ -0,0 +1,146 @@
+#include "MappedFile.h"
+#include "AssetPak.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+    data = nullptr;
+    size = 0;
+    packed = false;
+
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#endif
+}
+
+bool MappedFile::Open(const std::string& filePath)
+{
+    Close();
+
+    // The archive wins over loose files unless they were edited after it was built
+    AssetPak* pak = AssetPak::GetInstance();
+    const AssetPak::Entry* entry = pak->Find(filePath);
+    if (entry)
+    {
+        packed = true;
+        if (!pak->Read(*entry, data, size, unpacked))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+    fileHandle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    data = (const unsigned char*)mapping;
+    size = (size_t)fileStat.st_size;
+#endif
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    // Archive entries belong to the AssetPak mapping
+    if (packed)
+    {
+        packed = false;
+        unpacked = std::vector<unsigned char>();
+        data = nullptr;
+        size = 0;
+        return;
+    }
+
+#ifdef _WIN32
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+    }
+
+    if (fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (data != nullptr)
+    {
+        munmap((void*)data, size);
+    }
+#endif
+
+    data = nullptr;
+    size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
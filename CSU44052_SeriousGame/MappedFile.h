@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Read-only memory mapping of a whole file. Files in the mounted AssetPak come from the archive instead, either
+// pointing into its mapping or decompressed into memory the MappedFile owns, unless the loose file is newer.
+class MappedFile
+{
+public:
+    MappedFile();
+
+    bool Open(const std::string& filePath);
+
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+
+    size_t Size() const { return size; }
+
+    bool IsOpen() const { return data != nullptr; }
+
+    ~MappedFile();
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data;
+    size_t size;
+
+    bool packed;
+    std::vector<unsigned char> unpacked;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
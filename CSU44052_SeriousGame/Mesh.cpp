@@ -1,11 +1,14 @@
 #include "Mesh.h"
 
+#include <vector>
+
 Mesh::Mesh()
 {
 	VAO = 0;
 	VBO = 0;
 	IBO = 0;
 	indexCount = 0;
+	compact = false;
 }
 
 void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices)
@@ -21,16 +24,34 @@ void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int num
 
 	glGenBuffers(1, &VBO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * numOfVertices, vertices, GL_STATIC_DRAW);
-	// vertices 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	// normals
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	// texture cooridinates
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
+
+	compact = VertexQuantizer::IsEnabled();
+	if (compact)
+	{
+		// numOfVertices counts floats, 8 per vertex
+		VertexQuantizer::Layout layout = { 8, 0, 3, 6 };
+		unsigned int vertexCount = numOfVertices / 8;
+		bounds = VertexQuantizer::ComputeBounds(vertices, vertexCount, layout);
+
+		std::vector<CompactVertex> compactVertices(vertexCount);
+		VertexQuantizer::Encode(vertices, vertexCount, layout, bounds, compactVertices.data());
+		glBufferData(GL_ARRAY_BUFFER, sizeof(CompactVertex) * vertexCount, compactVertices.data(), GL_STATIC_DRAW);
+
+		VertexQuantizer::SetupAttributes(0, 1, 2);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * numOfVertices, vertices, GL_STATIC_DRAW);
+		// vertices 
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		// normals
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		// texture cooridinates
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+		glEnableVertexAttribArray(2);
+	}
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -38,8 +59,10 @@ void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int num
 	glBindVertexArray(0);
 }
 
-void Mesh::RenderMesh()
+void Mesh::RenderMesh(const ShaderProgram& program)
 {
+	VertexQuantizer::SetUniforms(program, compact ? &bounds : NULL);
+
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
 	glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/glad.h>
+#include "VertexQuantizer.h"
 
 class Mesh
 {
@@ -9,14 +10,22 @@ public:
 
 	void CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices);
 
-	void RenderMesh();
+	// Draw with program, which the caller has bound
+	void RenderMesh(const ShaderProgram& program);
 
 	void ClearMesh();
 
+	// The program drawing it needs the COMPACT_VERTICES variant
+	bool IsCompact() const { return compact; }
+
 	~Mesh();
 
 private:
 	GLuint VAO, VBO, IBO;
 	GLsizei indexCount;
+
+	// Set when the vertices were quantized to CompactVertex
+	bool compact;
+	CompactBounds bounds;
 };
 
@@ -0,0 +1,363 @@
+#include "MeshCache.h"
+#include "AssetPak.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    const char MAGIC[8] = { 'M', 'E', 'S', 'H', 'B', 'I', 'N', '\0' };
+    const size_t DATA_ALIGNMENT = 16;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t meshCount;
+        uint64_t sourceHash;
+        uint32_t textureCount;
+        uint32_t reserved;
+    };
+
+    struct MeshRecord
+    {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        int32_t material;
+        uint32_t indexSize;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t lodCount;
+        uint32_t reserved;
+        MeshLod lods[MAX_LODS];
+    };
+
+    size_t AlignUp(size_t value)
+    {
+        return (value + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+    }
+}
+
+MeshCache::MeshCache()
+{
+}
+
+std::string MeshCache::CachePath(const std::string& objPath)
+{
+    size_t dot = objPath.find_last_of('.');
+    size_t slash = objPath.find_last_of("/\\");
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return objPath + ".meshbin";
+    }
+    return objPath.substr(0, dot) + ".meshbin";
+}
+
+// 64 bit FNV-1a over the file contents, 0 if the file can't be read
+uint64_t MeshCache::HashFile(const std::string& filePath)
+{
+    // The archive hashed its entries when it was built
+    const AssetPak::Entry* entry = AssetPak::GetInstance()->Find(filePath);
+    if (entry)
+    {
+        return entry->contentHash;
+    }
+
+    MappedFile source;
+    if (!source.Open(filePath))
+    {
+        return 0;
+    }
+    return AssetPak::HashBytes(source.Data(), source.Size());
+}
+
+std::vector<std::string> MeshCache::MaterialPaths(const std::string& objPath)
+{
+    std::vector<std::string> paths;
+
+    MappedFile obj;
+    if (!obj.Open(objPath))
+    {
+        return paths;
+    }
+
+    size_t slash = objPath.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : objPath.substr(0, slash + 1);
+
+    const char* line = (const char*)obj.Data();
+    const char* end = line + obj.Size();
+    while (line < end)
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        lineEnd = lineEnd ? lineEnd : end;
+
+        // One mtllib line can name several files
+        if (lineEnd - line > 7 && strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+        {
+            std::istringstream names(std::string(line + 7, lineEnd));
+            std::string name;
+            while (names >> name)
+            {
+                std::string path = directory + name;
+                if (HashFile(path) != 0 && std::find(paths.begin(), paths.end(), path) == paths.end())
+                {
+                    paths.push_back(path);
+                }
+            }
+        }
+        line = lineEnd + 1;
+    }
+    return paths;
+}
+
+uint64_t MeshCache::HashSource(const std::string& objPath)
+{
+    uint64_t hash = HashFile(objPath);
+    if (hash == 0)
+    {
+        return 0;
+    }
+
+    // Materials end up in the cache too, editing one has to miss it like editing the OBJ
+    for (const std::string& path : MaterialPaths(objPath))
+    {
+        hash = (hash ^ HashFile(path)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+MeshView MeshCache::View(const ModelData& model, size_t mesh)
+{
+    const MeshRange& range = model.meshes[mesh];
+
+    MeshView view;
+    view.vertices = model.vertices.data() + range.firstVertex * FLOATS_PER_VERTEX;
+    view.vertexCount = range.vertexCount;
+    view.indices = model.indices.data() + range.firstIndex;
+    view.indexSize = sizeof(unsigned int);
+    view.indexCount = range.indexCount;
+    view.material = range.material;
+    view.lodCount = range.lodCount;
+    memcpy(view.lods, range.lods, sizeof(view.lods));
+    return view;
+}
+
+// Smallest index type that can address every vertex of a mesh
+unsigned int MeshCache::IndexSize(unsigned int vertexCount)
+{
+    return vertexCount <= 0xFFFF ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+bool MeshCache::Write(const std::string& cachePath, uint64_t sourceHash, const ModelData& model, const std::vector<std::string>& textureNames)
+{
+    FileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.meshCount = (uint32_t)model.meshes.size();
+    header.sourceHash = sourceHash;
+    header.textureCount = (uint32_t)textureNames.size();
+    header.reserved = 0;
+
+    // Work out where every blob goes before writing anything
+    size_t offset = sizeof(FileHeader) + model.meshes.size() * sizeof(MeshRecord);
+    for (const auto& name : textureNames)
+    {
+        offset += sizeof(uint32_t) + name.size();
+    }
+
+    std::vector<MeshRecord> records;
+    for (const auto& mesh : model.meshes)
+    {
+        MeshRecord record;
+        record.vertexCount = mesh.vertexCount;
+        record.indexCount = mesh.indexCount;
+        record.material = mesh.material;
+        record.indexSize = IndexSize(record.vertexCount);
+        record.lodCount = mesh.lodCount;
+        record.reserved = 0;
+        memcpy(record.lods, mesh.lods, sizeof(record.lods));
+
+        offset = AlignUp(offset);
+        record.vertexOffset = offset;
+        offset += (size_t)mesh.vertexCount * FLOATS_PER_VERTEX * sizeof(float);
+
+        offset = AlignUp(offset);
+        record.indexOffset = offset;
+        offset += (size_t)mesh.indexCount * record.indexSize;
+
+        records.push_back(record);
+    }
+
+    // Write to a temporary file so a crash never leaves a half written cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        printf("Failed to write mesh cache: %s\n", cachePath.c_str());
+        return false;
+    }
+
+    const char padding[DATA_ALIGNMENT] = {};
+    size_t written = 0;
+
+    auto writeBytes = [&](const void* bytes, size_t count)
+    {
+        out.write((const char*)bytes, count);
+        written += count;
+    };
+
+    auto pad = [&]()
+    {
+        writeBytes(padding, AlignUp(written) - written);
+    };
+
+    writeBytes(&header, sizeof(header));
+    writeBytes(records.data(), records.size() * sizeof(MeshRecord));
+
+    for (const auto& name : textureNames)
+    {
+        uint32_t length = (uint32_t)name.size();
+        writeBytes(&length, sizeof(length));
+        writeBytes(name.data(), name.size());
+    }
+
+    for (size_t m = 0; m < model.meshes.size(); m++)
+    {
+        MeshView mesh = View(model, m);
+        const unsigned int* indices = (const unsigned int*)mesh.indices;
+
+        pad();
+        writeBytes(mesh.vertices, (size_t)mesh.vertexCount * FLOATS_PER_VERTEX * sizeof(float));
+        pad();
+
+        if (records[m].indexSize == sizeof(uint16_t))
+        {
+            // Narrow through a small buffer rather than copying the whole index array
+            uint16_t shortIndices[4096];
+            for (unsigned int first = 0; first < mesh.indexCount; first += 4096)
+            {
+                unsigned int count = std::min(mesh.indexCount - first, 4096u);
+                std::copy(indices + first, indices + first + count, shortIndices);
+                writeBytes(shortIndices, count * sizeof(uint16_t));
+            }
+        }
+        else
+        {
+            writeBytes(indices, (size_t)mesh.indexCount * sizeof(unsigned int));
+        }
+    }
+
+    out.close();
+    if (!out)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(cachePath.c_str());
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+bool MeshCache::Open(const std::string& cachePath, uint64_t sourceHash)
+{
+    Close();
+
+    if (!file.Open(cachePath) || file.Size() < sizeof(FileHeader))
+    {
+        Close();
+        return false;
+    }
+
+    const unsigned char* base = file.Data();
+    const size_t size = file.Size();
+
+    FileHeader header;
+    memcpy(&header, base, sizeof(header));
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.sourceHash != sourceHash)
+    {
+        Close();
+        return false;
+    }
+
+    size_t offset = sizeof(FileHeader);
+    if (offset + (size_t)header.meshCount * sizeof(MeshRecord) > size)
+    {
+        Close();
+        return false;
+    }
+
+    std::vector<MeshRecord> records(header.meshCount);
+    memcpy(records.data(), base + offset, records.size() * sizeof(MeshRecord));
+    offset += records.size() * sizeof(MeshRecord);
+
+    for (uint32_t i = 0; i < header.textureCount; i++)
+    {
+        uint32_t length;
+        if (offset + sizeof(length) > size)
+        {
+            Close();
+            return false;
+        }
+        memcpy(&length, base + offset, sizeof(length));
+        offset += sizeof(length);
+
+        if (offset + length > size)
+        {
+            Close();
+            return false;
+        }
+        textureNames.push_back(std::string((const char*)base + offset, length));
+        offset += length;
+    }
+
+    for (const auto& record : records)
+    {
+        size_t vertexBytes = (size_t)record.vertexCount * FLOATS_PER_VERTEX * sizeof(float);
+        size_t indexBytes = (size_t)record.indexCount * record.indexSize;
+
+        if ((record.indexSize != sizeof(uint16_t) && record.indexSize != sizeof(uint32_t)) || record.vertexOffset + vertexBytes > size || record.indexOffset + indexBytes > size)
+        {
+            Close();
+            return false;
+        }
+
+        if (record.lodCount == 0 || record.lodCount > MAX_LODS)
+        {
+            Close();
+            return false;
+        }
+        for (uint32_t l = 0; l < record.lodCount; l++)
+        {
+            if ((uint64_t)record.lods[l].firstIndex + record.lods[l].indexCount > record.indexCount)
+            {
+                Close();
+                return false;
+            }
+        }
+
+        MeshView view;
+        view.vertices = (const float*)(base + record.vertexOffset);
+        view.vertexCount = record.vertexCount;
+        view.indices = base + record.indexOffset;
+        view.indexSize = record.indexSize;
+        view.indexCount = record.indexCount;
+        view.material = record.material;
+        view.lodCount = record.lodCount;
+        memcpy(view.lods, record.lods, sizeof(view.lods));
+        meshes.push_back(view);
+    }
+
+    return true;
+}
+
+void MeshCache::Close()
+{
+    meshes.clear();
+    textureNames.clear();
+    file.Close();
+}
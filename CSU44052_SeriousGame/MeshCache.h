@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// Most detail levels a mesh can have, level 0 is the full mesh
+const unsigned int MAX_LODS = 4;
+
+// One detail level, a range of the mesh's indices. error is how far the surface may have moved from the full
+// mesh, in model units.
+struct MeshLod
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+// Range of one mesh inside a ModelData, its indices count from firstVertex. indexCount covers every detail level,
+// the levels share the vertices and their indices follow one another.
+struct MeshRange
+{
+    size_t firstVertex;
+    unsigned int vertexCount;
+    size_t firstIndex;
+    unsigned int indexCount;
+    int material;
+    unsigned int lodCount;
+    MeshLod lods[MAX_LODS];
+};
+
+// Geometry of a whole model ready for upload. Every mesh shares one vertex buffer, interleaved as
+// position(3) texcoord(2) normal(3), and one index buffer.
+struct ModelData
+{
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<MeshRange> meshes;
+};
+
+// Non owning view of a mesh, either from a ModelData or from a mapped .meshbin file.
+// indexSize is 2 for 16 bit indices and 4 for 32 bit indices.
+struct MeshView
+{
+    const float* vertices;
+    unsigned int vertexCount;
+    const void* indices;
+    unsigned int indexSize;
+    unsigned int indexCount;
+    int material;
+    unsigned int lodCount;
+    MeshLod lods[MAX_LODS];
+};
+
+// Versioned binary cache of the processed meshes of an OBJ file (.meshbin).
+// The cache stores the hash of the OBJ and its materials it was built from and is rejected when either changes.
+class MeshCache
+{
+public:
+    static const unsigned int VERSION = 4;
+    static const unsigned int FLOATS_PER_VERTEX = 8;
+
+    MeshCache();
+
+    static std::string CachePath(const std::string& objPath);
+
+    static uint64_t HashFile(const std::string& filePath);
+
+    // The material files the mtllib lines of an OBJ name that exist, next to it like ObjParser looks for them
+    static std::vector<std::string> MaterialPaths(const std::string& objPath);
+
+    // HashFile of the OBJ combined with those of its materials, 0 when the OBJ can't be read
+    static uint64_t HashSource(const std::string& objPath);
+
+    static MeshView View(const ModelData& model, size_t mesh);
+
+    static unsigned int IndexSize(unsigned int vertexCount);
+
+    static bool Write(const std::string& cachePath, uint64_t sourceHash, const ModelData& model, const std::vector<std::string>& textureNames);
+
+    bool Open(const std::string& cachePath, uint64_t sourceHash);
+
+    void Close();
+
+    size_t MeshCount() const { return meshes.size(); }
+
+    const MeshView& GetMesh(size_t index) const { return meshes[index]; }
+
+    const std::vector<std::string>& TextureNames() const { return textureNames; }
+
+private:
+    MappedFile file;
+    std::vector<MeshView> meshes;
+    std::vector<std::string> textureNames;
+};
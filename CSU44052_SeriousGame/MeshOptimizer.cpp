@@ -0,0 +1,367 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const unsigned int UNUSED = 0xFFFFFFFF;
+
+    struct Cluster
+    {
+        unsigned int first;
+        unsigned int count;
+        float sortKey;
+    };
+
+    // FIFO cache simulated with timestamps, a vertex is cached while fewer than cacheSize misses followed its own.
+    // Advancing the clock by more than the cache size flushes it.
+    struct FifoCache
+    {
+        std::vector<unsigned int> timestamps;
+        unsigned int time;
+        unsigned int size;
+
+        FifoCache(unsigned int vertexCount, unsigned int cacheSize) : timestamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+        bool Miss(unsigned int vertex)
+        {
+            if (time - timestamps[vertex] > size)
+            {
+                timestamps[vertex] = time++;
+                return true;
+            }
+            return false;
+        }
+
+        void Flush()
+        {
+            time += size + 1;
+        }
+    };
+}
+
+void MeshOptimizer::Optimize(ModelData& model)
+{
+    for (auto& mesh : model.meshes)
+    {
+        unsigned int* indices = model.indices.data() + mesh.firstIndex;
+        float* vertices = model.vertices.data() + mesh.firstVertex * MeshCache::FLOATS_PER_VERTEX;
+
+        // Some exporters already write cache friendly strips, keep their order if the passes can't beat it
+        std::vector<unsigned int> original(indices, indices + mesh.indexCount);
+        float originalAcmr = AnalyzeVertexCache(indices, mesh.indexCount, mesh.vertexCount).acmr;
+
+        std::vector<unsigned int> clusters = OptimizeVertexCache(indices, mesh.indexCount, mesh.vertexCount);
+        OptimizeOverdraw(indices, mesh.indexCount, vertices, mesh.vertexCount, clusters, OVERDRAW_THRESHOLD);
+
+        if (AnalyzeVertexCache(indices, mesh.indexCount, mesh.vertexCount).acmr > originalAcmr)
+        {
+            memcpy(indices, original.data(), original.size() * sizeof(unsigned int));
+        }
+
+        mesh.vertexCount = OptimizeVertexFetch(vertices, mesh.vertexCount, indices, mesh.indexCount);
+    }
+}
+
+std::vector<unsigned int> MeshOptimizer::OptimizeVertexCache(unsigned int* indices, size_t indexCount, unsigned int vertexCount)
+{
+    std::vector<unsigned int> clusters;
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return clusters;
+    }
+
+    // Triangles around every vertex, stored back to back
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        offsets[indices[i] + 1]++;
+    }
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    // Triangles not yet emitted around every vertex
+    std::vector<unsigned int> live(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+
+    FifoCache cache(vertexCount, CACHE_SIZE);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    deadEnds.reserve(triangleCount * 3);
+    output.reserve(triangleCount * 3);
+
+    unsigned int cursor = 0;
+    int fan = (int)indices[0];
+
+    clusters.push_back(0);
+
+    while (fan >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+        {
+            unsigned int triangle = adjacency[a];
+            if (emitted[triangle])
+            {
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[triangle * 3 + k];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                cache.Miss(v);
+            }
+            emitted[triangle] = 1;
+        }
+
+        // Next fan around the oldest candidate that stays cached while its remaining triangles are emitted,
+        // or any candidate with triangles left
+        int next = -1;
+        int bestPriority = -1;
+        for (unsigned int v : candidates)
+        {
+            if (live[v] == 0)
+            {
+                continue;
+            }
+
+            unsigned int age = cache.time - cache.timestamps[v];
+            int priority = 0;
+            if (age + 2 * live[v] <= CACHE_SIZE)
+            {
+                priority = (int)age;
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = (int)v;
+            }
+        }
+
+        // Dead end, back up to a recently used vertex or scan forward for any vertex with triangles left
+        if (next == -1)
+        {
+            while (!deadEnds.empty())
+            {
+                unsigned int v = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[v] > 0)
+                {
+                    next = (int)v;
+                    break;
+                }
+            }
+
+            while (next == -1 && cursor < vertexCount)
+            {
+                if (live[cursor] > 0)
+                {
+                    next = (int)cursor;
+                }
+                cursor++;
+            }
+
+            if (next != -1)
+            {
+                clusters.push_back((unsigned int)(output.size() / 3));
+            }
+        }
+
+        fan = next;
+    }
+
+    memcpy(indices, output.data(), output.size() * sizeof(unsigned int));
+    return clusters;
+}
+
+void MeshOptimizer::OptimizeOverdraw(unsigned int* indices, size_t indexCount, const float* vertices, unsigned int vertexCount, const std::vector<unsigned int>& clusters, float threshold)
+{
+    unsigned int triangleCount = (unsigned int)(indexCount / 3);
+    if (triangleCount == 0 || clusters.empty())
+    {
+        return;
+    }
+
+    // Cut a cluster as soon as the part so far, counted from a cold cache, is within threshold of the ACMR of
+    // the whole cluster. Flushing the cache there costs little and the smaller clusters sort much better.
+    std::vector<Cluster> sorted;
+    FifoCache cache(vertexCount, CACHE_SIZE);
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        unsigned int begin = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.Flush();
+        unsigned int clusterMisses = 0;
+        for (unsigned int i = begin * 3; i < end * 3; i++)
+        {
+            clusterMisses += cache.Miss(indices[i]) ? 1 : 0;
+        }
+        float clusterAcmr = (float)clusterMisses / (end - begin);
+
+        unsigned int first = begin;
+        unsigned int misses = 0;
+
+        cache.Flush();
+        for (unsigned int t = begin; t < end; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                misses += cache.Miss(indices[t * 3 + k]) ? 1 : 0;
+            }
+
+            if (misses <= (t + 1 - first) * clusterAcmr * threshold)
+            {
+                sorted.push_back({ first, t + 1 - first, 0.0f });
+                first = t + 1;
+                misses = 0;
+                cache.Flush();
+            }
+        }
+
+        // A tail that never got cheap enough stays with the part before it rather than starting cold
+        if (first < end)
+        {
+            if (first > begin)
+            {
+                sorted.back().count += end - first;
+            }
+            else
+            {
+                sorted.push_back({ first, end - first, 0.0f });
+            }
+        }
+    }
+
+    const unsigned int stride = MeshCache::FLOATS_PER_VERTEX;
+
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            meshCentroid[k] += vertices[v * stride + k] / vertexCount;
+        }
+    }
+
+    // Clusters facing away from the middle of the mesh are likely to occlude the rest, draw them first
+    for (auto& cluster : sorted)
+    {
+        float centroid[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        float area = 0.0f;
+
+        for (unsigned int t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            const float* a = vertices + indices[t * 3 + 0] * stride;
+            const float* b = vertices + indices[t * 3 + 1] * stride;
+            const float* c = vertices + indices[t * 3 + 2] * stride;
+
+            float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float cross[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+            float triangleArea = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+            for (int k = 0; k < 3; k++)
+            {
+                centroid[k] += (a[k] + b[k] + c[k]) / 3.0f * triangleArea;
+                normal[k] += cross[k];
+            }
+            area += triangleArea;
+        }
+
+        float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area == 0.0f || normalLength == 0.0f)
+        {
+            continue;
+        }
+
+        cluster.sortKey = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            cluster.sortKey += (centroid[k] / area - meshCentroid[k]) * normal[k] / normalLength;
+        }
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    for (const auto& cluster : sorted)
+    {
+        output.insert(output.end(), indices + cluster.first * 3, indices + (cluster.first + cluster.count) * 3);
+    }
+    memcpy(indices, output.data(), output.size() * sizeof(unsigned int));
+}
+
+unsigned int MeshOptimizer::OptimizeVertexFetch(float* vertices, unsigned int vertexCount, unsigned int* indices, size_t indexCount)
+{
+    std::vector<unsigned int> remap(vertexCount, UNUSED);
+    unsigned int used = 0;
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int& index = indices[i];
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = used++;
+        }
+        index = remap[index];
+    }
+
+    const unsigned int stride = MeshCache::FLOATS_PER_VERTEX;
+    std::vector<float> source(vertices, vertices + (size_t)vertexCount * stride);
+
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] != UNUSED)
+        {
+            memcpy(vertices + (size_t)remap[v] * stride, source.data() + (size_t)v * stride, stride * sizeof(float));
+        }
+    }
+    return used;
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, unsigned int vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (indexCount < 3 || vertexCount == 0)
+    {
+        return stats;
+    }
+
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        misses += cache.Miss(indices[i]) ? 1 : 0;
+    }
+
+    stats.acmr = (float)misses / (indexCount / 3);
+    stats.atvr = (float)misses / vertexCount;
+    return stats;
+}
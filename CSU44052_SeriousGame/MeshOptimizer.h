@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "MeshCache.h"
+
+// Post-transform vertex cache statistics for a FIFO cache.
+// acmr is cache misses per triangle (0.5 is ideal for large grids, 3 is the worst case),
+// atvr is cache misses per vertex (1 is ideal).
+struct VertexCacheStats
+{
+    float acmr;
+    float atvr;
+};
+
+// Reorders the triangles and vertices of indexed triangle lists for the GPU: Tipsify vertex cache ordering
+// (Sander, Nehab and Barczak 2007), overdraw aware cluster ordering on top of it, and first use vertex order
+// for fetch locality. Indices are local to the mesh and vertices are interleaved MeshCache::FLOATS_PER_VERTEX
+// floats with the position first.
+class MeshOptimizer
+{
+public:
+    // Cache size Tipsify optimizes for and the statistics are measured with
+    static const unsigned int CACHE_SIZE = 16;
+
+    // A cluster is split for overdraw sorting once the part so far is within this factor of the whole cluster ACMR
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    // Runs all three passes on every mesh of the model
+    static void Optimize(ModelData& model);
+
+    // Returns the first triangle of every cluster, a cluster ends wherever Tipsify had to jump to a dead end
+    static std::vector<unsigned int> OptimizeVertexCache(unsigned int* indices, size_t indexCount, unsigned int vertexCount);
+
+    // Splits the clusters further where the cache is already warm and sorts them so outward facing ones draw first
+    static void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const float* vertices, unsigned int vertexCount, const std::vector<unsigned int>& clusters, float threshold);
+
+    // Renumbers vertices in the order the indices first use them. Returns the number of vertices still referenced.
+    static unsigned int OptimizeVertexFetch(float* vertices, unsigned int vertexCount, unsigned int* indices, size_t indexCount);
+
+    static VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, unsigned int vertexCount, unsigned int cacheSize = CACHE_SIZE);
+};
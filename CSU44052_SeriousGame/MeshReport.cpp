@@ -0,0 +1,103 @@
+#include "MeshReport.h"
+#include "MeshOptimizer.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+namespace
+{
+    VertexCacheStats Analyze(const ModelData& model, const MeshRange& mesh)
+    {
+        return MeshOptimizer::AnalyzeVertexCache(model.indices.data() + mesh.firstIndex, mesh.indexCount, mesh.vertexCount);
+    }
+}
+
+int RunMeshReport(const std::string& directory)
+{
+    std::vector<std::string> files;
+
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, error); it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+    {
+        if (error)
+        {
+            break;
+        }
+
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        if (it->is_regular_file() && extension == ".obj")
+        {
+            files.push_back(it->path().generic_string());
+        }
+    }
+
+    if (files.empty())
+    {
+        printf("No obj files found under %s\n", directory.c_str());
+        return 1;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    printf("FIFO cache of %u vertices\n", MeshOptimizer::CACHE_SIZE);
+    printf("%-36s %4s %8s %8s %14s %14s %10s\n", "file", "mesh", "tris", "verts", "ACMR", "ATVR", "time (ms)");
+
+    bool all_loaded = true;
+    size_t total_triangles = 0;
+    double total_misses_before = 0.0;
+    double total_misses_after = 0.0;
+
+    for (const auto& file : files)
+    {
+        ModelData model;
+        std::vector<std::string> texture_names;
+
+        if (!Model::LoadObj(file, model, texture_names))
+        {
+            printf("%-36s failed to load\n", file.c_str());
+            all_loaded = false;
+            continue;
+        }
+
+        std::vector<VertexCacheStats> before;
+        for (const auto& mesh : model.meshes)
+        {
+            before.push_back(Analyze(model, mesh));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        MeshOptimizer::Optimize(model);
+        auto stop = std::chrono::steady_clock::now();
+        double optimize_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        for (size_t m = 0; m < model.meshes.size(); m++)
+        {
+            const MeshRange& mesh = model.meshes[m];
+            VertexCacheStats after = Analyze(model, mesh);
+            unsigned int triangles = mesh.indexCount / 3;
+
+            total_triangles += triangles;
+            total_misses_before += before[m].acmr * triangles;
+            total_misses_after += after.acmr * triangles;
+
+            printf("%-36s %4d %8u %8u %6.3f->%6.3f %6.3f->%6.3f", m == 0 ? file.c_str() : "", (int)m, triangles, mesh.vertexCount, before[m].acmr, after.acmr, before[m].atvr, after.atvr);
+            if (m == 0)
+            {
+                printf(" %10.2f", optimize_ms);
+            }
+            printf("\n");
+        }
+    }
+
+    if (total_triangles > 0)
+    {
+        printf("%-36s %4s %8zu %8s %6.3f->%6.3f\n", "total", "", total_triangles, "", total_misses_before / total_triangles, total_misses_after / total_triangles);
+    }
+    return all_loaded ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <string>
+
+// Loads every OBJ file under a directory and prints ACMR and ATVR for each mesh before and after MeshOptimizer
+int RunMeshReport(const std::string& directory);
@@ -0,0 +1,606 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+namespace
+{
+    const unsigned int STRIDE = MeshCache::FLOATS_PER_VERTEX;
+
+    // Planes through open border edges weigh this much more than the faces so borders keep their outline
+    const double BORDER_WEIGHT = 10.0;
+
+    // A collapse may not turn any remaining face further than this from its old normal (cosine)
+    const double MIN_NORMAL_DOT = 0.25;
+
+    // Only pieces smaller than this fraction of the whole mesh are dropped when collapsing runs out
+    const float MAX_DROPPED_EXTENT = 0.1f;
+
+    const unsigned int UNMAPPED = 0xFFFFFFFF;
+
+    enum VertexKind : unsigned char
+    {
+        KIND_MANIFOLD,  // interior vertex, may collapse along any edge
+        KIND_BORDER,    // on one open border, may only collapse along it
+        KIND_LOCKED     // non manifold or a border corner, never moves
+    };
+
+    // Sum of weighted squared distances to a set of planes, Q(p) = p'Ap + 2b.p + c
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    struct Collapse
+    {
+        unsigned int from;
+        unsigned int to;
+        float error;
+    };
+
+    struct Component
+    {
+        glm::vec3 lower;
+        glm::vec3 upper;
+        unsigned int triangles;
+        float extent;
+    };
+
+    glm::dvec3 Position(const float* vertices, unsigned int v)
+    {
+        const float* p = vertices + (size_t)v * STRIDE;
+        return glm::dvec3(p[0], p[1], p[2]);
+    }
+
+    void AddPlane(Quadric& q, const glm::dvec3& n, double d, double weight)
+    {
+        q.a00 += weight * n.x * n.x;
+        q.a01 += weight * n.x * n.y;
+        q.a02 += weight * n.x * n.z;
+        q.a11 += weight * n.y * n.y;
+        q.a12 += weight * n.y * n.z;
+        q.a22 += weight * n.z * n.z;
+        q.b0 += weight * n.x * d;
+        q.b1 += weight * n.y * d;
+        q.b2 += weight * n.z * d;
+        q.c += weight * d * d;
+        q.weight += weight;
+    }
+
+    void AddQuadric(Quadric& q, const Quadric& other)
+    {
+        q.a00 += other.a00;
+        q.a01 += other.a01;
+        q.a02 += other.a02;
+        q.a11 += other.a11;
+        q.a12 += other.a12;
+        q.a22 += other.a22;
+        q.b0 += other.b0;
+        q.b1 += other.b1;
+        q.b2 += other.b2;
+        q.c += other.c;
+        q.weight += other.weight;
+    }
+
+    // Weighted mean of the squared plane distances
+    double Evaluate(const Quadric& q, const glm::dvec3& p)
+    {
+        double r = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z
+            + 2.0 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z)
+            + 2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+
+        return q.weight > 0.0 ? std::max(r, 0.0) / q.weight : 0.0;
+    }
+
+    uint64_t EdgeKey(unsigned int a, unsigned int b)
+    {
+        return ((uint64_t)a << 32) | b;
+    }
+
+    unsigned int FindRoot(std::vector<unsigned int>& parents, unsigned int v)
+    {
+        while (parents[v] != v)
+        {
+            parents[v] = parents[parents[v]];
+            v = parents[v];
+        }
+        return v;
+    }
+}
+
+std::vector<unsigned int> MeshSimplifier::Simplify(const float* vertices, unsigned int vertexCount, const unsigned int* indices, size_t indexCount, size_t targetIndexCount, float* resultError)
+{
+    std::vector<unsigned int> result(indices, indices + indexCount - indexCount % 3);
+    size_t targetTriangles = targetIndexCount / 3;
+    float error = 0.0f;
+
+    // Weld vertices that only differ in texcoord or normal, the topology is worked out on positions.
+    // remap points every vertex at the first vertex with its position, copies lists the vertices of each position.
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<unsigned int> copyOffsets(vertexCount + 1, 0);
+    std::vector<unsigned int> copies(vertexCount);
+    {
+        std::vector<unsigned int> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+        {
+            return memcmp(vertices + (size_t)a * STRIDE, vertices + (size_t)b * STRIDE, 3 * sizeof(float)) < 0;
+        });
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            bool same = i > 0 && memcmp(vertices + (size_t)order[i] * STRIDE, vertices + (size_t)order[i - 1] * STRIDE, 3 * sizeof(float)) == 0;
+            remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+            copyOffsets[remap[order[i]] + 1]++;
+        }
+
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            copyOffsets[v + 1] += copyOffsets[v];
+        }
+
+        std::vector<unsigned int> fill(copyOffsets.begin(), copyOffsets.end() - 1);
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            copies[fill[remap[v]]++] = v;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount, Quadric());
+    std::vector<VertexKind> kinds(vertexCount);
+    std::vector<unsigned int> borderEdges(vertexCount);
+    std::unordered_map<uint64_t, unsigned int> edges;
+    std::vector<unsigned int> offsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<unsigned int> collapseTarget(vertexCount);
+    std::vector<char> touched(vertexCount);
+    std::vector<Collapse> collapses;
+
+    auto isBorderEdge = [&](unsigned int a, unsigned int b)
+    {
+        return (edges.count(EdgeKey(a, b)) != 0) != (edges.count(EdgeKey(b, a)) != 0);
+    };
+
+    auto triangleNormal = [&](const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c)
+    {
+        return glm::cross(b - a, c - a);
+    };
+
+    // Rebuild the welded topology of the current triangles: directed edges, vertex kinds and faces per vertex
+    auto classify = [&]()
+    {
+        edges.clear();
+        std::fill(borderEdges.begin(), borderEdges.end(), 0);
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            unsigned int a = remap[result[i]];
+            unsigned int b = remap[result[i - i % 3 + (i + 1) % 3]];
+            edges[EdgeKey(a, b)]++;
+            offsets[a + 1]++;
+        }
+
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            kinds[v] = KIND_MANIFOLD;
+            offsets[v + 1] += offsets[v];
+        }
+
+        for (const auto& edge : edges)
+        {
+            unsigned int a = (unsigned int)(edge.first >> 32);
+            unsigned int b = (unsigned int)(edge.first & 0xFFFFFFFF);
+            auto opposite = edges.find(EdgeKey(b, a));
+
+            if (edge.second > 1 || (opposite != edges.end() && opposite->second > 1))
+            {
+                kinds[a] = KIND_LOCKED;
+                kinds[b] = KIND_LOCKED;
+            }
+            else if (opposite == edges.end())
+            {
+                borderEdges[a]++;
+                borderEdges[b]++;
+            }
+        }
+
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            if (borderEdges[v] > 0 && kinds[v] == KIND_MANIFOLD)
+            {
+                kinds[v] = borderEdges[v] == 2 ? KIND_BORDER : KIND_LOCKED;
+            }
+        }
+
+        adjacency.resize(result.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            adjacency[fill[remap[result[i]]]++] = (unsigned int)(i / 3);
+        }
+    };
+
+    classify();
+
+    // Face planes weighted by area, plus planes standing on the border edges to hold the outline in place
+    for (size_t t = 0; t < result.size() / 3; t++)
+    {
+        unsigned int corners[3] = { remap[result[t * 3]], remap[result[t * 3 + 1]], remap[result[t * 3 + 2]] };
+        glm::dvec3 positions[3] = { Position(vertices, corners[0]), Position(vertices, corners[1]), Position(vertices, corners[2]) };
+
+        glm::dvec3 normal = triangleNormal(positions[0], positions[1], positions[2]);
+        double length = glm::length(normal);
+        if (length == 0.0)
+        {
+            continue;
+        }
+        normal /= length;
+
+        for (int k = 0; k < 3; k++)
+        {
+            AddPlane(quadrics[corners[k]], normal, -glm::dot(normal, positions[0]), length * 0.5);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = corners[k];
+            unsigned int b = corners[(k + 1) % 3];
+            if (!isBorderEdge(a, b))
+            {
+                continue;
+            }
+
+            glm::dvec3 edge = positions[(k + 1) % 3] - positions[k];
+            glm::dvec3 borderNormal = glm::cross(edge, normal);
+            double borderLength = glm::length(borderNormal);
+            if (borderLength == 0.0)
+            {
+                continue;
+            }
+            borderNormal /= borderLength;
+
+            double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+            AddPlane(quadrics[a], borderNormal, -glm::dot(borderNormal, positions[k]), weight);
+            AddPlane(quadrics[b], borderNormal, -glm::dot(borderNormal, positions[k]), weight);
+        }
+    }
+
+    auto canCollapse = [&](unsigned int from, unsigned int to)
+    {
+        if (kinds[from] == KIND_LOCKED)
+        {
+            return false;
+        }
+        if (kinds[from] == KIND_BORDER)
+        {
+            if (!isBorderEdge(from, to))
+            {
+                return false;
+            }
+
+            // Removing a face with all three corners on the border would start eating a card from its edge
+            for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+            {
+                const unsigned int* triangle = result.data() + adjacency[a] * 3;
+                bool hasTarget = remap[triangle[0]] == to || remap[triangle[1]] == to || remap[triangle[2]] == to;
+                if (hasTarget && borderEdges[remap[triangle[0]]] > 0 && borderEdges[remap[triangle[1]]] > 0 && borderEdges[remap[triangle[2]]] > 0)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // Every copy of from has to share a face with to, that face says which copy of to it turns into. A seam
+    // vertex can only collapse along its seam that way, the copies on either side keep their own attributes.
+    auto mapCopies = [&](unsigned int from, unsigned int to, bool apply)
+    {
+        for (unsigned int c = copyOffsets[from]; c < copyOffsets[from + 1]; c++)
+        {
+            unsigned int copy = copies[c];
+            unsigned int mapped = UNMAPPED;
+            bool used = false;
+
+            for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+            {
+                const unsigned int* triangle = result.data() + adjacency[a] * 3;
+                if (triangle[0] != copy && triangle[1] != copy && triangle[2] != copy)
+                {
+                    continue;
+                }
+                used = true;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    if (remap[triangle[k]] != to)
+                    {
+                        continue;
+                    }
+                    if (mapped != UNMAPPED && mapped != triangle[k])
+                    {
+                        return false;
+                    }
+                    mapped = triangle[k];
+                }
+            }
+
+            if (used && mapped == UNMAPPED)
+            {
+                return false;
+            }
+            if (apply && used)
+            {
+                collapseTarget[copy] = mapped;
+            }
+        }
+        return true;
+    };
+
+    auto collapseError = [&](unsigned int from, unsigned int to)
+    {
+        Quadric q = quadrics[from];
+        AddQuadric(q, quadrics[to]);
+        return (float)std::sqrt(Evaluate(q, Position(vertices, to)));
+    };
+
+    // Moving from onto to must not fold any face that survives the collapse
+    auto flips = [&](unsigned int from, unsigned int to)
+    {
+        glm::dvec3 target = Position(vertices, to);
+
+        for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+        {
+            const unsigned int* triangle = result.data() + adjacency[a] * 3;
+            unsigned int corners[3] = { remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] };
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+            {
+                continue;
+            }
+
+            glm::dvec3 before[3] = { Position(vertices, corners[0]), Position(vertices, corners[1]), Position(vertices, corners[2]) };
+            glm::dvec3 after[3] = { before[0], before[1], before[2] };
+            for (int k = 0; k < 3; k++)
+            {
+                if (corners[k] == from)
+                {
+                    after[k] = target;
+                }
+            }
+
+            glm::dvec3 oldNormal = triangleNormal(before[0], before[1], before[2]);
+            glm::dvec3 newNormal = triangleNormal(after[0], after[1], after[2]);
+            double oldLength = glm::length(oldNormal);
+            if (oldLength == 0.0)
+            {
+                continue;
+            }
+            if (glm::dot(oldNormal, newNormal) <= MIN_NORMAL_DOT * oldLength * glm::length(newNormal))
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Passes of independent collapses, cheapest first, until the target is met or nothing can collapse
+    bool first = true;
+    while (result.size() / 3 > targetTriangles)
+    {
+        if (!first)
+        {
+            classify();
+        }
+        first = false;
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            unsigned int a = remap[result[i]];
+            unsigned int b = remap[result[i - i % 3 + (i + 1) % 3]];
+            if (a == b)
+            {
+                continue;
+            }
+
+            if (canCollapse(a, b) && mapCopies(a, b, false))
+            {
+                collapses.push_back({ a, b, collapseError(a, b) });
+            }
+            if (canCollapse(b, a) && mapCopies(b, a, false))
+            {
+                collapses.push_back({ b, a, collapseError(b, a) });
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        std::iota(collapseTarget.begin(), collapseTarget.end(), 0);
+        std::fill(touched.begin(), touched.end(), 0);
+
+        size_t triangles = result.size() / 3;
+        bool collapsed = false;
+
+        for (const auto& collapse : collapses)
+        {
+            if (triangles <= targetTriangles)
+            {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to))
+            {
+                continue;
+            }
+
+            mapCopies(collapse.from, collapse.to, true);
+
+            for (unsigned int a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+            {
+                const unsigned int* triangle = result.data() + adjacency[a] * 3;
+                bool removed = false;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    removed = removed || remap[triangle[k]] == collapse.to;
+                    touched[remap[triangle[k]]] = 1;
+                }
+                triangles -= removed ? 1 : 0;
+            }
+
+            AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            error = std::max(error, collapse.error);
+            collapsed = true;
+        }
+
+        if (!collapsed)
+        {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < result.size() / 3; t++)
+        {
+            unsigned int corners[3] = { collapseTarget[result[t * 3]], collapseTarget[result[t * 3 + 1]], collapseTarget[result[t * 3 + 2]] };
+            if (remap[corners[0]] == remap[corners[1]] || remap[corners[1]] == remap[corners[2]] || remap[corners[0]] == remap[corners[2]])
+            {
+                continue;
+            }
+            memcpy(result.data() + write, corners, sizeof(corners));
+            write += 3;
+        }
+        result.resize(write);
+    }
+
+    // Whatever is left over the target is in pieces too small to collapse, drop the smallest pieces whole
+    if (result.size() / 3 > targetTriangles)
+    {
+        glm::vec3 meshLower = Position(vertices, result[0]);
+        glm::vec3 meshUpper = meshLower;
+        for (unsigned int index : result)
+        {
+            meshLower = glm::min(meshLower, glm::vec3(Position(vertices, index)));
+            meshUpper = glm::max(meshUpper, glm::vec3(Position(vertices, index)));
+        }
+        float maxExtent = glm::length(meshUpper - meshLower) * 0.5f * MAX_DROPPED_EXTENT;
+
+        std::vector<unsigned int> parents(vertexCount);
+        std::iota(parents.begin(), parents.end(), 0);
+
+        for (size_t t = 0; t < result.size() / 3; t++)
+        {
+            unsigned int root = FindRoot(parents, remap[result[t * 3]]);
+            for (int k = 1; k < 3; k++)
+            {
+                parents[FindRoot(parents, remap[result[t * 3 + k]])] = root;
+            }
+        }
+
+        std::unordered_map<unsigned int, Component> components;
+        for (size_t t = 0; t < result.size() / 3; t++)
+        {
+            unsigned int root = FindRoot(parents, remap[result[t * 3]]);
+            auto found = components.find(root);
+            if (found == components.end())
+            {
+                glm::vec3 position = Position(vertices, result[t * 3]);
+                found = components.insert({ root, { position, position, 0, 0.0f } }).first;
+            }
+
+            Component& component = found->second;
+            component.triangles++;
+            for (int k = 0; k < 3; k++)
+            {
+                glm::vec3 position = Position(vertices, result[t * 3 + k]);
+                component.lower = glm::min(component.lower, position);
+                component.upper = glm::max(component.upper, position);
+            }
+        }
+
+        std::vector<std::pair<float, unsigned int>> bySize;
+        for (auto& entry : components)
+        {
+            entry.second.extent = glm::length(entry.second.upper - entry.second.lower) * 0.5f;
+            bySize.push_back({ entry.second.extent, entry.first });
+        }
+        std::sort(bySize.begin(), bySize.end());
+
+        size_t triangles = result.size() / 3;
+        std::unordered_map<unsigned int, bool> dropped;
+        for (const auto& entry : bySize)
+        {
+            if (triangles <= targetTriangles || entry.first > maxExtent)
+            {
+                break;
+            }
+            dropped[entry.second] = true;
+            triangles -= components[entry.second].triangles;
+            error = std::max(error, entry.first);
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < result.size() / 3; t++)
+        {
+            if (dropped.count(FindRoot(parents, remap[result[t * 3]])) == 0)
+            {
+                memmove(result.data() + write, result.data() + t * 3, 3 * sizeof(unsigned int));
+                write += 3;
+            }
+        }
+        result.resize(write);
+    }
+
+    if (resultError)
+    {
+        *resultError = error;
+    }
+    return result;
+}
+
+void MeshSimplifier::GenerateLods(ModelData& model)
+{
+    std::vector<unsigned int> indices;
+    indices.reserve(model.indices.size() * 2);
+
+    for (auto& mesh : model.meshes)
+    {
+        const unsigned int* full = model.indices.data() + mesh.firstIndex + mesh.lods[0].firstIndex;
+        unsigned int fullCount = mesh.lods[0].indexCount;
+        const float* vertices = model.vertices.data() + mesh.firstVertex * MeshCache::FLOATS_PER_VERTEX;
+        size_t first = indices.size();
+
+        indices.insert(indices.end(), full, full + fullCount);
+        mesh.lods[0] = { 0, fullCount, 0.0f };
+
+        size_t targetTriangles = fullCount / 3;
+        for (unsigned int l = 1; l < MAX_LODS; l++)
+        {
+            targetTriangles = std::max((size_t)(targetTriangles * LOD_REDUCTION), (size_t)1);
+
+            float error = 0.0f;
+            std::vector<unsigned int> lod = Simplify(vertices, mesh.vertexCount, full, fullCount, targetTriangles * 3, &error);
+            MeshOptimizer::OptimizeVertexCache(lod.data(), lod.size(), mesh.vertexCount);
+
+            // A coarser level never claims to be closer to the full mesh than a finer one, selection relies on it
+            error = std::max(error, mesh.lods[l - 1].error);
+
+            mesh.lods[l] = { (unsigned int)(indices.size() - first), (unsigned int)lod.size(), error };
+            indices.insert(indices.end(), lod.begin(), lod.end());
+        }
+
+        mesh.firstIndex = first;
+        mesh.indexCount = (unsigned int)(indices.size() - first);
+        mesh.lodCount = MAX_LODS;
+    }
+
+    model.indices.swap(indices);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "MeshCache.h"
+
+// Quadric error metric simplification (Garland and Heckbert 1997) by collapsing edges onto existing vertices, so a
+// simplified mesh is only a new index list over the same vertices. Vertices on texture or normal seams only move
+// along the seam, open borders only collapse along the border, and once nothing else can collapse the smallest
+// disconnected pieces (leaf cards) are dropped whole.
+class MeshSimplifier
+{
+public:
+    // Triangle count of each level relative to the one before
+    static constexpr float LOD_REDUCTION = 0.5f;
+
+    // Reduce to at most targetIndexCount indices, or as close as the seams allow. Vertices are interleaved
+    // MeshCache::FLOATS_PER_VERTEX floats with the position first. resultError gets the largest distance the
+    // surface moved, in model units.
+    static std::vector<unsigned int> Simplify(const float* vertices, unsigned int vertexCount, const unsigned int* indices, size_t indexCount, size_t targetIndexCount, float* resultError);
+
+    // Give every mesh MAX_LODS detail levels, each simplified from the full mesh and ordered for the vertex cache.
+    // Runs after MeshOptimizer::Optimize, which only looks at the full mesh.
+    static void GenerateLods(ModelData& model);
+};
@@ -1,263 +1,823 @@
 #include "Model.h"
-#include "stb_image.h"
+#include "ObjParser.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "VertexQuantizer.h"
+#include "InstanceRing.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const unsigned int EMPTY_SLOT = 0xFFFFFFFF;
+
+    // Interleaved vertex of one face corner, 8 floats: 3 position, 2 texcoord, 3 normal
+    void GatherVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& idx, float* vertex)
+    {
+        vertex[0] = attrib.vertices[3 * idx.vertex_index + 0];
+        vertex[1] = attrib.vertices[3 * idx.vertex_index + 1];
+        vertex[2] = attrib.vertices[3 * idx.vertex_index + 2];
+        vertex[3] = 0.0f;
+        vertex[4] = 0.0f;
+        vertex[5] = 0.0f;
+        vertex[6] = 0.0f;
+        vertex[7] = 0.0f;
+
+        if (attrib.texcoords.size() > 0 && idx.texcoord_index != -1) 
+        {
+            vertex[3] = attrib.texcoords[2 * idx.texcoord_index + 0];
+            vertex[4] = attrib.texcoords[2 * idx.texcoord_index + 1];
+        }
+        if (attrib.normals.size() > 0 && idx.normal_index != -1) 
+        {
+            vertex[5] = attrib.normals[3 * idx.normal_index + 0];
+            vertex[6] = attrib.normals[3 * idx.normal_index + 1];
+            vertex[7] = attrib.normals[3 * idx.normal_index + 2];
+        }
+    }
+
+    // FNV-1a over the bytes of one interleaved vertex
+    size_t HashVertex(const float* vertex)
+    {
+        const unsigned char* bytes = (const unsigned char*)vertex;
+        size_t hash = 2166136261u;
+
+        for (size_t i = 0; i < MeshCache::FLOATS_PER_VERTEX * sizeof(float); i++)
+        {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    // Columns of the upper 3x3 at right angles and of the same length, so normals only need the matrix itself
+    bool IsUniformScale(const glm::mat4& matrix)
+    {
+        glm::vec3 x(matrix[0]);
+        glm::vec3 y(matrix[1]);
+        glm::vec3 z(matrix[2]);
+
+        float length = glm::dot(x, x);
+        float tolerance = length * 1e-3f;
 
-Model::Model(int max_instance) 
+        return std::abs(glm::dot(y, y) - length) <= tolerance && std::abs(glm::dot(z, z) - length) <= tolerance &&
+            std::abs(glm::dot(x, y)) <= tolerance && std::abs(glm::dot(y, z)) <= tolerance && std::abs(glm::dot(z, x)) <= tolerance;
+    }
+}
+
+float Model::lod_error_pixels = 2.0f;
+float Model::lod_hysteresis = 0.25f;
+int Model::viewport_height = 1;
+size_t Model::frame_triangles = 0;
+size_t Model::frame_upload_bytes = 0;
+
+Model::Model() 
 {
-    MAX_INSTANCES = max_instance;
+    for (unsigned int l = 0; l < MAX_LODS; l++)
+    {
+        lod_instance_counts[l] = 0;
+    }
+
+    bounds_min = glm::vec3(0.0f);
+    bounds_max = glm::vec3(0.0f);
+
+    impostor_enabled = false;
+    impostor_distance = 0.0f;
+    impostor_fade_range = 0.0f;
+    source_hash = 0;
+    camera_position = glm::vec3(0.0f);
+    instances_uniform_scale = true;
+
+    material_shininess = 0.0f;
+    material_specular_intensity = 0.0f;
+}
+
+void Model::EnableImpostor(float distance, float fade_range)
+{
+    impostor_enabled = true;
+    impostor_distance = distance;
+    impostor_fade_range = std::min(fade_range, distance);
+}
+
+void Model::SetMaterial(float shininess, float specular_intensity)
+{
+    material_shininess = shininess;
+    material_specular_intensity = specular_intensity;
+}
+
+void Model::SetLodSettings(float error_pixels, float hysteresis)
+{
+    lod_error_pixels = error_pixels;
+    lod_hysteresis = hysteresis;
+}
+
+void Model::SetViewportHeight(int height)
+{
+    viewport_height = height;
+}
+
+size_t Model::FrameTriangles()
+{
+    return frame_triangles;
+}
+
+size_t Model::FrameUploadBytes()
+{
+    return frame_upload_bytes;
+}
+
+void Model::ResetFrameStatistics()
+{
+    frame_triangles = 0;
+    frame_upload_bytes = 0;
 }
 
 void Model::LoadModelInstanced(const std::string& obj_path, const std::string& material_path)
 {
-    std::string error_msg;
+    if (!LoadModelData(obj_path, material_path))
+    {
+        exit(1);
+    }
+    UploadModelData();
+}
+
+// CPU half of loading, touches no GL state so it can run on a worker thread
+bool Model::LoadModelData(const std::string& obj_path, const std::string& material_path)
+{
+    std::string cache_path = MeshCache::CachePath(obj_path);
+    std::vector<std::string> texture_names;
+    source_hash = MeshCache::HashSource(obj_path);
+
+    // Use the binary cache when it was built from this exact obj file and materials
+    if (source_hash != 0 && mesh_cache.Open(cache_path, source_hash))
+    {
+        texture_names = mesh_cache.TextureNames();
+    }
+    else
+    {
+        if (!BuildMeshCache(obj_path, source_hash, loaded_model, texture_names))
+        {
+            return false;
+        }
+    }
+
+    // Without a cached impostor it's baked once the meshes are on the GPU
+    if (impostor_enabled)
+    {
+        impostor_path = ImpostorAtlas::CachePath(obj_path);
+        impostor.Open(impostor_path, source_hash);
+    }
+
+    return LoadTextures(material_path, texture_names);
+}
+
+// GL half of loading, must run on the thread that owns the context
+void Model::UploadModelData()
+{
+    UploadTextures();
+
+    if (!loaded_model.meshes.empty())
+    {
+        for (size_t s = 0; s < loaded_model.meshes.size(); s++)
+        {
+            UploadMesh(MeshCache::View(loaded_model, s));
+        }
+    }
+    else
+    {
+        for (size_t s = 0; s < mesh_cache.MeshCount(); s++)
+        {
+            UploadMesh(mesh_cache.GetMesh(s));
+        }
+    }
+
+    // The geometry lives in GL buffers now, assign rather than clear so the memory is actually released
+    loaded_model = ModelData();
+    mesh_cache.Close();
+
+    if (impostor_enabled)
+    {
+        // Nothing cached for this source, render it from the meshes that were just uploaded
+        if (!impostor.HasData())
+        {
+            glm::vec3 center = (bounds_min + bounds_max) * 0.5f;
+            float radius = glm::length(bounds_max - bounds_min) * 0.5f;
+
+            impostor.Bake(impostor_path, source_hash, center, radius, [this](ShaderVariants& shaders)
+            {
+                DrawFullDetail(shaders);
+            });
+        }
+        impostor.Upload();
+    }
+}
+
+bool Model::BuildMeshCache(const std::string& obj_path, uint64_t source_hash, ModelData& model, std::vector<std::string>& texture_names)
+{
+    if (!LoadObj(obj_path, model, texture_names))
+    {
+        printf("Error loading obj file: %s\n", obj_path.c_str());
+        return false;
+    }
+
+    // Reorder for the post-transform cache and build the detail levels once, the cache keeps both
+    MeshOptimizer::Optimize(model);
+    MeshSimplifier::GenerateLods(model);
+
+    // Write the cache so the next launch can skip parsing the obj
+    std::string cache_path = MeshCache::CachePath(obj_path);
+    if (source_hash != 0 && !MeshCache::Write(cache_path, source_hash, model, texture_names))
+    {
+        printf("Failed to write mesh cache: %s\n", cache_path.c_str());
+    }
+    return true;
+}
+
+bool Model::LoadObj(const std::string& obj_path, ModelData& model, std::vector<std::string>& texture_names)
+{
     tinyobj::ObjReaderConfig reader_config;
     reader_config.mtl_search_path = ""; 
-    tinyobj::ObjReader reader;
+    ObjParser reader;
 
     if (!reader.ParseFromFile(obj_path, reader_config)) 
     {
         if (!reader.Error().empty()) 
         {
-            printf("Error loading obj file");
+            printf("%s", reader.Error().c_str());
         }
-        exit(1);
+        return false;
     }
 
-    tinyobj::attrib_t attrib = reader.GetAttrib();
-    std::vector<tinyobj::shape_t> shapes = reader.GetShapes();
-    std::vector<tinyobj::material_t> materials = reader.GetMaterials();
+    const tinyobj::attrib_t& attrib = reader.GetAttrib();
+    const std::vector<tinyobj::shape_t>& shapes = reader.GetShapes();
+    const std::vector<tinyobj::material_t>& materials = reader.GetMaterials();
 
-    // looping over shapes ( meshes )
-    for (size_t s = 0; s < shapes.size(); s++) 
+    size_t corner_count = 0;
+    size_t largest_shape = 0;
+    for (const auto& shape : shapes)
     {
-        size_t index_offset = 0;
+        corner_count += shape.mesh.indices.size();
+        largest_shape = std::max(largest_shape, shape.mesh.indices.size());
+    }
+
+    model.indices.resize(corner_count);
+    model.meshes.reserve(shapes.size());
 
-        //making a temporary vector that will fill each mesh separately
-        std::vector<Vertex> tempVector;
+    // Deduplicate by vertex value rather than by obj index triple, some exporters (Tree.obj) write a separate
+    // normal index for every face corner. The open addressing table holds the first corner of each unique
+    // vertex and compares against it through the attribute arrays, so no vertex is stored until the exact
+    // count is known.
+    size_t table_size = 1;
+    while (table_size < largest_shape * 2)
+    {
+        table_size *= 2;
+    }
+    std::vector<unsigned int> slots(table_size);
 
-        // looping over faces for each shape (mesh)
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) 
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+
+    // looping over shapes ( meshes ), the faces are already triangulated so the corners can be walked in order
+    for (const auto& shape : shapes) 
+    {
+        const std::vector<tinyobj::index_t>& corners = shape.mesh.indices;
+        unsigned int* indices = model.indices.data() + index_count;
+        unsigned int unique_count = 0;
+
+        std::fill(slots.begin(), slots.end(), EMPTY_SLOT);
+
+        for (size_t c = 0; c < corners.size(); c++) 
         {
-            int fv = shapes[s].mesh.num_face_vertices[f];
-            
-            // loop over vertices of each face 
-            for (size_t v = 0; v < fv; v++) 
+            float vertex[MeshCache::FLOATS_PER_VERTEX];
+            GatherVertex(attrib, corners[c], vertex);
+
+            size_t slot = HashVertex(vertex) & (table_size - 1);
+            while (slots[slot] != EMPTY_SLOT)
             {
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-        
-                Vertex vertex;
-                vertex.position = glm::vec3(
-                    attrib.vertices[3 * idx.vertex_index + 0],
-                    attrib.vertices[3 * idx.vertex_index + 1],
-                    attrib.vertices[3 * idx.vertex_index + 2]
-                );
-                if (attrib.texcoords.size() > 0 && idx.texcoord_index != -1) 
+                float existing[MeshCache::FLOATS_PER_VERTEX];
+                GatherVertex(attrib, corners[slots[slot]], existing);
+                if (memcmp(existing, vertex, sizeof(vertex)) == 0)
                 {
-                    vertex.texcoord = glm::vec2(
-                        attrib.texcoords[2 * idx.texcoord_index + 0],
-                        attrib.texcoords[2 * idx.texcoord_index + 1]
-                    );
-                }
-                if (attrib.normals.size() > 0 && idx.normal_index != -1) 
-                {
-                    vertex.normal = glm::vec3(
-                        attrib.normals[3 * idx.normal_index + 0],
-                        attrib.normals[3 * idx.normal_index + 1],
-                        attrib.normals[3 * idx.normal_index + 2]
-                    );
+                    break;
                 }
+                slot = (slot + 1) & (table_size - 1);
+            }
 
-                tempVector.push_back(vertex);
+            if (slots[slot] == EMPTY_SLOT)
+            {
+                slots[slot] = (unsigned int)c;
+                indices[c] = unique_count++;
+            }
+            else
+            {
+                indices[c] = indices[slots[slot]];
             }
-        
-            index_offset += fv;
         }
 
-        all_vertices.push_back(tempVector);
+        MeshRange range;
+        range.firstVertex = vertex_count;
+        range.vertexCount = unique_count;
+        range.firstIndex = index_count;
+        range.indexCount = (unsigned int)corners.size();
+        range.material = shape.mesh.material_ids.empty() ? -1 : shape.mesh.material_ids[0];
+        range.lodCount = 1;
+        range.lods[0] = { 0, range.indexCount, 0.0f };
+        model.meshes.push_back(range);
+
+        vertex_count += unique_count;
+        index_count += corners.size();
+    }
+
+    // Now the vertex buffer can be allocated at its exact size and filled from the first corner of each vertex,
+    // vertices are numbered in the order their first corner appears
+    model.vertices.resize(vertex_count * MeshCache::FLOATS_PER_VERTEX);
 
-        // loop over the indices 
-        std::vector<int> indices;
+    for (size_t s = 0; s < shapes.size(); s++)
+    {
+        const std::vector<tinyobj::index_t>& corners = shapes[s].mesh.indices;
+        const MeshRange& range = model.meshes[s];
+        const unsigned int* indices = model.indices.data() + range.firstIndex;
+        float* vertices = model.vertices.data() + range.firstVertex * MeshCache::FLOATS_PER_VERTEX;
+        unsigned int written = 0;
 
-        for (size_t f = 0; f < shapes[s].mesh.indices.size() / 3; f++)
+        for (size_t c = 0; c < corners.size() && written < range.vertexCount; c++)
         {
-            // Push face indices to indices vector
-            indices.push_back(shapes[s].mesh.indices[3 * f].vertex_index);
-            indices.push_back(shapes[s].mesh.indices[3 * f + 1].vertex_index);
-            indices.push_back(shapes[s].mesh.indices[3 * f + 2].vertex_index);
+            if (indices[c] == written)
+            {
+                GatherVertex(attrib, corners[c], vertices + written * MeshCache::FLOATS_PER_VERTEX);
+                written++;
+            }
         }
-        //This should have a size of 2
-        all_indices.push_back(indices);
-    }
-
-    std::vector<std::vector<float>> interleaved_data;
-    interleaved_data.reserve(vertices_.size() * 8); // Each vertex has 8 floats: 3 position, 2 texcoord, 3 normal
-
-    for (const auto& mesh: all_vertices) {
-        std::vector<float> tempInterleavedData;
-        for (const auto& vertex : mesh) {
-            tempInterleavedData.push_back(vertex.position.x);
-            tempInterleavedData.push_back(vertex.position.y);
-            tempInterleavedData.push_back(vertex.position.z);
-            tempInterleavedData.push_back(vertex.texcoord.x);
-            tempInterleavedData.push_back(vertex.texcoord.y);
-            tempInterleavedData.push_back(vertex.normal.x);
-            tempInterleavedData.push_back(vertex.normal.y);
-            tempInterleavedData.push_back(vertex.normal.z);
+    }
+
+    // Extract the texture references from the materials
+    for (const auto& material : materials) 
+    {
+        texture_names.push_back(material.diffuse_texname);
+    }
+    return true;
+}
+
+bool Model::LoadTextures(const std::string& material_path, const std::vector<std::string>& texture_names)
+{
+    std::vector<std::string> texture_paths;
+    for (const auto& texture_name : texture_names) 
+    {
+        texture_paths.push_back(material_path + "/" + texture_name);
+    }
+
+    // Textures already loaded by another model are shared, the rest are decoded concurrently
+    std::vector<TextureHandle> handles = TextureManager::GetInstance()->LoadBatch(texture_paths);
+
+    for (size_t i = 0; i < handles.size(); i++)
+    {
+        if (!handles[i]) 
+        {
+            printf("Error loading texture file: %s\n", texture_paths[i].c_str());
+            textures_.clear();
+            return false;
         }
 
-        interleaved_data.push_back(tempInterleavedData);
+        Texture texture;
+        texture.index = (int)i;
+        texture.handle = handles[i];
+        textures_.push_back(texture);
+    }
+    return true;
+}
+
+void Model::UploadTextures()
+{
+    for (auto& texture : textures_)
+    {
+        TextureManager::GetInstance()->Upload(texture.handle);
     }
+}
+
+// initilise a mesh on the gpu
+void Model::UploadMesh(const MeshView& mesh)
+{
+    GeometryArena* arena = GeometryArena::GetInstance();
 
-    // Extract the material data from the model
-    int index = 0;
- 
-    for (auto& material : materials) 
+    GLint base_vertex;
+    void* vertices = arena->MapVertices(mesh.vertexCount, base_vertex);
+
+    if (arena->IsCompact())
+    {
+        // Quantize straight into the buffer, the bounds go to the shader at draw time
+        VertexQuantizer::Layout layout = { MeshCache::FLOATS_PER_VERTEX, 0, 5, 3 };
+        CompactBounds bounds = VertexQuantizer::ComputeBounds(mesh.vertices, mesh.vertexCount, layout);
+        VertexQuantizer::Encode(mesh.vertices, mesh.vertexCount, layout, bounds, (CompactVertex*)vertices);
+        mesh_bounds.push_back(bounds);
+    }
+    else
     {
-        int width, height, num_channels;
-        std::string texture_path = material_path + "/" + material.diffuse_texname;
-        unsigned char* data = stbi_load(texture_path.c_str(), &width, &height, &num_channels, 0);
+        memcpy(vertices, mesh.vertices, mesh.vertexCount * MeshCache::FLOATS_PER_VERTEX * sizeof(float));
+    }
 
-        if (data) 
-        {    
-            Texture texture;
-            texture.width = width;
-            texture.height = height;
-            texture.channels = num_channels;
-            texture.data = data;
-            texture.index = index;
+    // Use 16 bit indices whenever the mesh is small enough, they count from the mesh's first vertex
+    unsigned int index_size = MeshCache::IndexSize(mesh.vertexCount);
+    if (index_size > mesh.indexSize)
+    {
+        index_size = mesh.indexSize;
+    }
+    GLenum index_type = index_size == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
-            glGenTextures(1, &texture.id);
-            glBindTexture(GL_TEXTURE_2D, texture.id);
+    GLuint first_index;
+    void* indices = arena->MapIndices(mesh.indexCount, index_type, first_index);
 
-            if (num_channels == 3)
-            {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            }    
-            else
+    if (index_size < mesh.indexSize)
+    {
+        // Narrow straight into the buffer instead of through a temporary copy
+        const unsigned int* wide_indices = (const unsigned int*)mesh.indices;
+        std::copy(wide_indices, wide_indices + mesh.indexCount, (unsigned short*)indices);
+    }
+    else
+    {
+        memcpy(indices, mesh.indices, (size_t)mesh.indexCount * index_size);
+    }
+
+    arena->Unmap();
+
+    // Meshes with fewer levels repeat their coarsest one
+    for (unsigned int l = 0; l < MAX_LODS; l++)
+    {
+        MeshLod lod = mesh.lods[std::min(l, mesh.lodCount - 1)];
+        lod.firstIndex += first_index;
+        mesh_lods.push_back(lod);
+    }
+    instance_lods.push_back(std::vector<unsigned char>());
+
+    for (unsigned int v = 0; v < mesh.vertexCount; v++)
+    {
+        glm::vec3 position = glm::make_vec3(mesh.vertices + (size_t)v * MeshCache::FLOATS_PER_VERTEX);
+        bool first = base_vertices.empty() && v == 0;
+        bounds_min = first ? position : glm::min(bounds_min, position);
+        bounds_max = first ? position : glm::max(bounds_max, position);
+    }
+
+    base_vertices.push_back(base_vertex);
+    index_types.push_back(index_type);
+    mesh_materials.push_back(mesh.material);
+}
+
+void Model::SubmitInstanced(RenderQueue& queue, ShaderVariants& shaders, const glm::mat4& model_matrix, const glm::mat4& view_matrix, const glm::mat4& projection_matrix, InstanceGroup& instances)
+{
+    const std::vector<glm::mat4>& model_matrices = instances.Matrices();
+    frame_upload_bytes += instances.Upload();
+
+    MeasureInstances(model_matrix, view_matrix, projection_matrix, model_matrices);
+
+    // The mesh dithers out over the last fade range before the impostor takes over completely
+    glm::vec2 fade(0.0f);
+    uint32_t variant = ShaderVariants::INSTANCED;
+    if (impostor.IsReady())
+    {
+        fade = glm::vec2(impostor_distance - impostor_fade_range, impostor_distance);
+
+        // Without a fade range the mesh just stops where the impostor starts
+        if (fade.y > fade.x)
+        {
+            variant |= ShaderVariants::IMPOSTOR_FADE;
+        }
+    }
+
+    if (instances_uniform_scale)
+    {
+        variant |= ShaderVariants::UNIFORM_SCALE;
+    }
+
+    GeometryArena* arena = GeometryArena::GetInstance();
+    InstanceRing* ring = InstanceRing::GetInstance();
+
+    // A static group's draws wait until the indices of every mesh are in resident_indices, which moves as it grows
+    bool resident = instances.IsStatic();
+    resident_index_data.clear();
+    resident_items.clear();
+
+    for (size_t i = 0; i < mesh_materials.size(); i++) 
+    {
+        SelectLods(i, model_matrices);
+        if (sorted_instances.empty())
+        {
+            continue;
+        }
+
+        RenderItem item;
+        item.program = &shaders.Program(MeshVariant(i, variant));
+        item.vao = arena->VertexArray();
+        item.textures[0] = MeshTexture(i);
+        item.instanceFormat = RenderItem::INSTANCE_INDICES;
+        item.model = model_matrix;
+        item.shininess = material_shininess;
+        item.specularIntensity = material_specular_intensity;
+        item.impostorFade = fade;
+        if (!mesh_bounds.empty())
+        {
+            item.bounds = mesh_bounds[i];
+        }
+
+        // Every instance is the index of its matrix. A static group's matrices are on the GPU already and its
+        // indices stay resident, a dynamic one's are streamed in sorted order and its indices count up.
+        GLuint first_index;
+        if (resident)
+        {
+            item.instanceMatrices = instances.Buffer();
+            first_index = (GLuint)resident_index_data.size();
+            resident_index_data.insert(resident_index_data.end(), sorted_instances.begin(), sorted_instances.end());
+        }
+        else
+        {
+            // Each allocation can grow the ring into a new buffer, so its name is taken right after each one
+            GLintptr matrix_offset = StreamSortedMatrices(model_matrices);
+            GLuint first_matrix = (GLuint)(matrix_offset / sizeof(glm::mat4));
+            item.instanceMatrices = ring->Buffer();
+
+            GLintptr index_offset;
+            GLuint* indices = ring->Allocate<GLuint>(sorted_instances.size(), index_offset);
+            for (size_t k = 0; k < sorted_instances.size(); k++)
             {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+                indices[k] = first_matrix + (GLuint)k;
             }
+            item.instanceBuffer = ring->Buffer();
+            first_index = (GLuint)(index_offset / sizeof(GLuint));
+        }
+
+        // Closest instance drawing this mesh, every level sorts by it
+        float nearest = FLT_MAX;
+        for (unsigned int instance : sorted_instances)
+        {
+            nearest = std::min(nearest, instance_distances[instance]);
+        }
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // One draw per detail level, the instances of each level sit next to each other in sorted_instances
+        size_t index_size = index_types[i] == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        unsigned int first_instance = 0;
+
+        for (unsigned int l = 0; l < MAX_LODS; l++)
+        {
+            const MeshLod& lod = mesh_lods[i * MAX_LODS + l];
+            if (lod_instance_counts[l] > 0 && lod.indexCount > 0)
+            {
+                item.indexType = index_types[i];
+                item.indexOffset = lod.firstIndex * index_size;
+                item.baseVertex = base_vertices[i];
+                item.count = lod.indexCount;
+                item.instanceCount = lod_instance_counts[l];
+                item.baseInstance = first_index + first_instance;
+
+                if (resident)
+                {
+                    resident_items.push_back(std::make_pair(nearest, item));
+                }
+                else
+                {
+                    queue.Submit(RenderQueue::PASS_OPAQUE, nearest, item);
+                }
 
-            textures_.push_back(texture);
+                frame_triangles += (size_t)lod.indexCount / 3 * lod_instance_counts[l];
+            }
+            first_instance += lod_instance_counts[l];
         }
-        else 
+    }
+
+    if (!resident_items.empty())
+    {
+        // Only written again when the camera moves instances to another detail level or out of range
+        frame_upload_bytes += WriteResident(resident_indices, resident_index_data.data(), resident_index_data.size() * sizeof(GLuint));
+        for (std::pair<float, RenderItem>& resident_item : resident_items)
         {
-            printf("Error loading texture file");
-            exit(1);
+            resident_item.second.instanceBuffer = resident_indices.buffer;
+            queue.Submit(RenderQueue::PASS_OPAQUE, resident_item.first, resident_item.second);
         }
-        index++;
     }
-    
-    // initilise meshes 
-    for (size_t s = 0; s < shapes.size(); s++) 
+
+    if (!impostor_instances.empty())
     {
-        unsigned int VAO, VBO, instanceVBO, IBO;
+        float nearest = FLT_MAX;
+        for (const glm::vec4& instance : impostor_instances)
+        {
+            nearest = std::min(nearest, glm::length(glm::vec3(instance) - camera_position));
+        }
 
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &instanceVBO);
+        if (instances.IsStatic())
+        {
+            // Far instances of a static group only change when the camera moves one across the impostor distance
+            frame_upload_bytes += WriteResident(resident_impostors, impostor_instances.data(), impostor_instances.size() * sizeof(glm::vec4));
+            impostor.Submit(queue, resident_impostors.buffer, 0, impostor_instances.size(), nearest, fade, material_shininess, material_specular_intensity);
+        }
+        else
+        {
+            impostor.Submit(queue, impostor_instances, nearest, fade, material_shininess, material_specular_intensity);
+        }
+        frame_triangles += impostor_instances.size() * 2;
+    }
+}
 
-        glBindVertexArray(VAO);
+size_t Model::WriteResident(ResidentBuffer& resident, const void* data, size_t bytes)
+{
+    const unsigned char* begin = (const unsigned char*)data;
+    if (resident.buffer != 0 && resident.contents.size() == bytes && std::equal(begin, begin + bytes, resident.contents.begin()))
+    {
+        return 0;
+    }
+    resident.contents.assign(begin, begin + bytes);
+
+    // Grow to twice the size. Only this frame's draws from it come after, those before were issued already and keep
+    // the old buffer alive.
+    if (bytes > resident.capacity || resident.buffer == 0)
+    {
+        resident.capacity = std::max(bytes, std::max(resident.capacity * 2, (size_t)256));
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, interleaved_data[s].size() * sizeof(float), interleaved_data[s].data(), GL_STATIC_DRAW);
+        // Named before the old one goes so the name differs, RenderQueue tells buffers apart by it
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        if (resident.buffer != 0)
+        {
+            glDeleteBuffers(1, &resident.buffer);
+        }
+        resident.buffer = buffer;
 
-        // Vertex positions
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, resident.buffer);
+        glBufferStorage(GL_ARRAY_BUFFER, resident.capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    }
 
-        // Texture coordinates
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, resident.buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    return bytes;
+}
 
-        // Normals
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
-        glEnableVertexAttribArray(2);
+uint32_t Model::MeshVariant(size_t mesh, uint32_t variant) const
+{
+    if (MeshTexture(mesh) != 0)
+    {
+        variant |= ShaderVariants::HAS_TEXTURE;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER, MAX_INSTANCES * sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
+    if (!mesh_bounds.empty())
+    {
+        variant |= ShaderVariants::COMPACT_VERTICES;
+    }
+    return variant;
+}
 
-        for (int i = 0; i < 4; i++) 
+GLuint Model::MeshTexture(size_t mesh) const
+{
+    // The last texture of the mesh's material, like when each one was bound in turn
+    GLuint texture = 0;
+    for (size_t j = 0; j < textures_.size(); j++) 
+    {
+        if (textures_[j].index == mesh_materials[mesh]) 
         {
-            glEnableVertexAttribArray(3 + i);
-            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
-            glVertexAttribDivisor(3 + i, 1);
+            texture = textures_[j].handle->id;
         }
+    }
+    return texture;
+}
+
+void Model::DrawFullDetail(ShaderVariants& shaders)
+{
+    glBindVertexArray(GeometryArena::GetInstance()->VertexArray());
+
+    for (size_t i = 0; i < mesh_materials.size(); i++)
+    {
+        // Not INSTANCED, so the model uniform alone places it and the instance attribute is left alone
+        const ShaderProgram& program = shaders.Program(MeshVariant(i, ShaderVariants::UNIFORM_SCALE));
+        program.Use();
 
-        glGenBuffers(1, &IBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, all_indices[s].size() * sizeof(int), all_indices[s].data(), GL_STATIC_DRAW);
+        GLuint texture = MeshTexture(i);
+        if (texture != 0)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            program.diffuseTexture.Set(0);
+        }
 
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        // View and projection are in FrameUniforms already
+        program.model.Set(glm::mat4(1.0f));
+        program.shininess.Set(material_shininess);
+        program.specularIntensity.Set(material_specular_intensity);
+        VertexQuantizer::SetUniforms(program, mesh_bounds.empty() ? NULL : &mesh_bounds[i]);
 
-        vbos.push_back(VBO);
-        vaos.push_back(VAO);
-        ibos.push_back(IBO);
-        instance_vbos.push_back(instanceVBO);
+        const MeshLod& lod = mesh_lods[i * MAX_LODS];
+        size_t index_size = index_types[i] == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, index_types[i], (void*)(lod.firstIndex * index_size), base_vertices[i]);
     }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
 }
 
-void Model::DrawInstanced(unsigned int shader_program, const glm::mat4& model_matrix, const glm::mat4& view_matrix, const glm::mat4& projection_matrix, const std::vector<glm::mat4>& model_matrices)
+void Model::MeasureInstances(const glm::mat4& model_matrix, const glm::mat4& view_matrix, const glm::mat4& projection_matrix, const std::vector<glm::mat4>& model_matrices)
 {
-    for (size_t i = 0; i < vaos.size(); i++) 
+    // Pixels covered by one unit of error one unit away from the camera
+    float pixels_per_unit = projection_matrix[1][1] * viewport_height * 0.5f;
+    camera_position = glm::vec3(glm::inverse(view_matrix)[3]);
+
+    instance_pixels_per_error.resize(model_matrices.size());
+    instance_distances.resize(model_matrices.size());
+    impostor_instances.clear();
+    instances_uniform_scale = true;
+
+    float impostor_start = impostor.IsReady() ? impostor_distance - impostor_fade_range : FLT_MAX;
+
+    for (size_t i = 0; i < model_matrices.size(); i++)
     {
-        glUseProgram(shader_program);
-        glBindVertexArray(vaos[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
-        int textureUnit = 0;
+        glm::mat4 world = model_matrix * model_matrices[i];
+        float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        float distance = glm::length(glm::vec3(world[3]) - camera_position);
 
-        for (size_t j = 0; j < textures_.size(); j++) 
+        instance_distances[i] = distance;
+        instance_pixels_per_error[i] = scale * pixels_per_unit / std::max(distance, 0.001f);
+        instances_uniform_scale = instances_uniform_scale && IsUniformScale(world);
+
+        // Inside the fade range both draw
+        if (distance > impostor_start)
         {
-            if (j == i) 
-            {
-                glActiveTexture(GL_TEXTURE0 + j);
-                glBindTexture(GL_TEXTURE_2D, textures_[j].id);
-                std::string u = "diffuseTexture";
-                unsigned int loc = glGetUniformLocation(shader_program, u.c_str());
-                glUniform1i(loc, j);
-                textureUnit++;
-            }
+            impostor_instances.push_back(glm::vec4(glm::vec3(world[3]), scale));
         }
+    }
+}
 
-        // Set the model, view, and projection matrices
-        unsigned int model_location = glGetUniformLocation(shader_program, "model");
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_matrix));
+void Model::SelectLods(size_t mesh, const std::vector<glm::mat4>& model_matrices)
+{
+    const MeshLod* lods = &mesh_lods[mesh * MAX_LODS];
+    std::vector<unsigned char>& previous = instance_lods[mesh];
+    previous.resize(model_matrices.size(), 0);
 
-        unsigned int view_location = glGetUniformLocation(shader_program, "view");
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(view_matrix));
+    // Instances this far only draw their impostor
+    float mesh_end = impostor.IsReady() ? impostor_distance : FLT_MAX;
 
-        unsigned int projection_location = glGetUniformLocation(shader_program, "projection");
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(projection_matrix));
+    for (unsigned int l = 0; l < MAX_LODS; l++)
+    {
+        lod_instance_counts[l] = 0;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, instance_vbos[i]);
-        glBufferData(GL_ARRAY_BUFFER, model_matrices.size() * sizeof(glm::mat4), &model_matrices[0], GL_STATIC_DRAW);
+    for (size_t i = 0; i < model_matrices.size(); i++)
+    {
+        if (instance_distances[i] >= mesh_end)
+        {
+            continue;
+        }
 
-        // Set the model matrix attribute pointer
-        for (size_t i = 0; i < 4; i++) 
+        // Coarsest level within the threshold, and the coarsest well inside it
+        unsigned int loose = 0;
+        unsigned int strict = 0;
+        for (unsigned int l = 1; l < MAX_LODS; l++)
         {
-            glEnableVertexAttribArray(3 + i);
-            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * i));
-            glVertexAttribDivisor(3 + i, 1);
+            float pixels = lods[l].error * instance_pixels_per_error[i];
+            if (pixels <= lod_error_pixels)
+            {
+                loose = l;
+            }
+            if (pixels <= lod_error_pixels * (1.0f - lod_hysteresis))
+            {
+                strict = l;
+            }
+        }
+
+        unsigned int lod = previous[i];
+        if (lod > loose)
+        {
+            lod = loose;
         }
+        else if (lod < strict)
+        {
+            lod = strict;
+        }
+
+        previous[i] = (unsigned char)lod;
+        lod_instance_counts[lod]++;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibos[i]);
-        glDrawArraysInstanced(GL_TRIANGLES, 0, all_indices[i].size(), model_matrices.size());
+    unsigned int next[MAX_LODS];
+    unsigned int first = 0;
+    for (unsigned int l = 0; l < MAX_LODS; l++)
+    {
+        next[l] = first;
+        first += lod_instance_counts[l];
+    }
 
-        // Disable the attribute pointers
-        for (size_t i = 0; i < 4; i++) 
+    sorted_instances.resize(first);
+    for (size_t i = 0; i < model_matrices.size(); i++)
+    {
+        if (instance_distances[i] < mesh_end)
         {
-            glDisableVertexAttribArray(3 + i);
+            sorted_instances[next[previous[i]]++] = (unsigned int)i;
         }
+    }
+}
+
+GLintptr Model::StreamSortedMatrices(const std::vector<glm::mat4>& model_matrices)
+{
+    GLintptr offset;
+    glm::mat4* sorted_matrices = InstanceRing::GetInstance()->Allocate<glm::mat4>(sorted_instances.size(), offset);
 
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glUseProgram(0);
+    for (size_t i = 0; i < sorted_instances.size(); i++)
+    {
+        sorted_matrices[i] = model_matrices[sorted_instances[i]];
     }
+    return offset;
 }
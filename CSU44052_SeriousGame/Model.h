@@ -4,6 +4,14 @@
 #include <string>
 #include <vector>
 #include "tiny_obj_loader.h"
+#include "GeometryArena.h"
+#include "ImpostorAtlas.h"
+#include "InstanceGroup.h"
+#include "MeshCache.h"
+#include "RenderQueue.h"
+#include "ShaderVariants.h"
+#include "TextureManager.h"
+#include "VertexQuantizer.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -14,43 +22,151 @@
 class Model 
 {
 public:
-    Model(int max_instance);
+    Model();
 
     void LoadModelInstanced(const std::string& obj_path, const std::string& material_path);
 
-    void DrawInstanced(unsigned int shader_program, const glm::mat4& model_matrix, const glm::mat4& view_matrix, const glm::mat4& projection_matrix, const std::vector<glm::mat4> & model_matrices);
+    // LoadModelInstanced split in two so the file work can happen off the GL thread
+    bool LoadModelData(const std::string& obj_path, const std::string& material_path);
+
+    void UploadModelData();
+
+    // Queues a draw per detail level of every mesh with the variant of shaders that fits it, so the shaders never
+    // branch on the vertex format. Every mesh is in GeometryArena and every draw indexes its instances' matrices,
+    // so the queue multi draws the ones that share a program and texture, across models too. The shaders take view
+    // and projection from FrameUniforms, the ones passed here pick the detail levels. A static group's changes and
+    // its instance indices are only uploaded when they change, the data stays valid until the queue executes this
+    // frame.
+    void SubmitInstanced(RenderQueue& queue, ShaderVariants& shaders, const glm::mat4& model_matrix, const glm::mat4& view_matrix, const glm::mat4& projection_matrix, InstanceGroup& instances);
+
+    // Shininess and specular intensity the model is lit with, its impostor included
+    void SetMaterial(float shininess, float specular_intensity);
+
+    // Instances further than distance draw as an impostor, the mesh dithers out over the fade_range before it.
+    // Call before loading, the impostor is baked with the model or read from its cache.
+    void EnableImpostor(float distance, float fade_range);
+
+    // Parse an obj into deduplicated meshes in exporter order, before MeshOptimizer runs
+    static bool LoadObj(const std::string& obj_path, ModelData& model, std::vector<std::string>& texture_names);
+
+    // Everything the .meshbin cache of an obj holds: LoadObj, then the cache order and the detail levels. Doesn't
+    // touch GL, so the asset baker runs it ahead of time.
+    static bool BuildMeshCache(const std::string& obj_path, uint64_t source_hash, ModelData& model, std::vector<std::string>& texture_names);
+
+    // Each instance draws the coarsest detail level whose error covers at most error_pixels on screen. A finer
+    // level is picked as soon as the error goes over, a coarser one only once it is below error_pixels * (1 - hysteresis).
+    static void SetLodSettings(float error_pixels, float hysteresis);
+
+    // Height in pixels of what the models are drawn into, the detail levels are picked for it
+    static void SetViewportHeight(int height);
+
+    // Triangles drawn by every model since the last reset
+    static size_t FrameTriangles();
+
+    // Bytes sent to the GPU copies of static groups since the last reset, InstanceRing counts what's streamed
+    static size_t FrameUploadBytes();
+
+    static void ResetFrameStatistics();
 
 private:
 
+    bool LoadTextures(const std::string& material_path, const std::vector<std::string>& texture_names);
+
+    void UploadTextures();
+
+    void UploadMesh(const MeshView& mesh);
+
+    // variant with the bits for a mesh's vertex format and texture added
+    uint32_t MeshVariant(size_t mesh, uint32_t variant) const;
+
+    // Diffuse texture of a mesh's material, 0 without one
+    GLuint MeshTexture(size_t mesh) const;
+
+    // One untransformed copy at full detail with the camera in FrameUniforms, what the impostor is baked from
+    void DrawFullDetail(ShaderVariants& shaders);
+
+    // Work out how far away every instance is and how many pixels one unit of model space error covers for it,
+    // gather the ones far enough for the impostor, and check whether any of them scales unevenly
+    void MeasureInstances(const glm::mat4& model_matrix, const glm::mat4& view_matrix, const glm::mat4& projection_matrix, const std::vector<glm::mat4>& model_matrices);
+
+    // Pick a detail level of one mesh for every instance close enough to draw it, and sort their indices by level
+    // into sorted_instances
+    void SelectLods(size_t mesh, const std::vector<glm::mat4>& model_matrices);
+
+    // Write the matrices of sorted_instances into InstanceRing, returns where they start in its buffer
+    GLintptr StreamSortedMatrices(const std::vector<glm::mat4>& model_matrices);
+
+    // GPU copy of instance data of a static group, with what was last written to it
+    struct ResidentBuffer
+    {
+        GLuint buffer = 0;
+        size_t capacity = 0;
+        std::vector<unsigned char> contents;
+    };
+
+    // Write data into resident unless it holds the same already. Returns the bytes written.
+    static size_t WriteResident(ResidentBuffer& resident, const void* data, size_t bytes);
+
     struct Texture 
     {
         int index;
-        unsigned int id;
-        int width;
-        int height;
-        int channels;
-        unsigned char* data;
+        TextureHandle handle;
     };
     
     std::vector<Texture> textures_;
 
-    int MAX_INSTANCES;
-    
-    struct Vertex 
-    {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec2 texcoord;
-    };
-    
-    std::vector<Vertex> vertices_;
-    std::vector<std::vector<Vertex>> all_vertices;
-    std::vector<std::vector<int>> all_indices;
+    // geometry waiting for UploadModelData, either parsed from the obj or mapped from the cache
+    ModelData loaded_model;
+    MeshCache mesh_cache;
+
+    // per mesh draw data, where it is in GeometryArena
+    std::vector<GLint> base_vertices;
+    std::vector<GLenum> index_types;
+    std::vector<int> mesh_materials;
+    std::vector<CompactBounds> mesh_bounds;
+
+    float material_shininess;
+    float material_specular_intensity;
+
+    // box around every mesh, the impostor is baked around its bounding sphere
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+
+    // MAX_LODS levels per mesh, firstIndex counts from the start of the arena's indices
+    std::vector<MeshLod> mesh_lods;
+
+    // level each instance of each mesh drew last frame, kept for the hysteresis
+    std::vector<std::vector<unsigned char>> instance_lods;
+    std::vector<float> instance_pixels_per_error;
+    std::vector<float> instance_distances;
+    std::vector<unsigned int> sorted_instances;
+    unsigned int lod_instance_counts[MAX_LODS];
+
+    // matrix indices of every mesh and level of a static group, in the order resident_items draw them
+    ResidentBuffer resident_indices;
+    std::vector<GLuint> resident_index_data;
+    std::vector<std::pair<float, RenderItem>> resident_items;
+
+    // impostor instances of a static group
+    ResidentBuffer resident_impostors;
+
+    bool impostor_enabled;
+    float impostor_distance;
+    float impostor_fade_range;
+    std::string impostor_path;
+    uint64_t source_hash;
+    ImpostorAtlas impostor;
+
+    // origin and scale of the instances drawn as impostors this frame
+    std::vector<glm::vec4> impostor_instances;
+    glm::vec3 camera_position;
 
-    int noOfVertices = 0;
+    // every instance measured this frame only rotates, translates and scales evenly
+    bool instances_uniform_scale;
 
-    std::vector<unsigned int> vbos;
-    std::vector<unsigned int> ibos;
-    std::vector<unsigned int> vaos;
-    std::vector<unsigned int> instance_vbos;
+    static float lod_error_pixels;
+    static float lod_hysteresis;
+    static int viewport_height;
+    static size_t frame_triangles;
+    static size_t frame_upload_bytes;
 };
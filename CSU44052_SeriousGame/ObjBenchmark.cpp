@@ -0,0 +1,104 @@
+#include "ObjBenchmark.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+namespace
+{
+    size_t CountIndices(const std::vector<tinyobj::shape_t>& shapes)
+    {
+        size_t count = 0;
+        for (const auto& shape : shapes)
+        {
+            count += shape.mesh.indices.size();
+        }
+        return count;
+    }
+
+    // Best of `iterations` runs in milliseconds
+    template<typename Parse>
+    double TimeBest(int iterations, Parse parse)
+    {
+        double best = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            parse();
+            auto stop = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+        return best;
+    }
+}
+
+int RunObjBenchmark(const std::string& directory, int iterations)
+{
+    std::vector<std::string> files;
+
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, error); it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+    {
+        if (error)
+        {
+            break;
+        }
+
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        if (it->is_regular_file() && extension == ".obj")
+        {
+            files.push_back(it->path().generic_string());
+        }
+    }
+
+    if (files.empty())
+    {
+        printf("No obj files found under %s\n", directory.c_str());
+        return 1;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    // Start the workers up front so thread creation isn't timed
+    ThreadPool::GetInstance();
+
+    printf("Best of %d runs, ObjParser using %u threads\n", iterations, ThreadPool::GetInstance()->ThreadCount());
+    printf("%-36s %10s %12s %12s %8s  %s\n", "file", "size (KB)", "tinyobj (ms)", "parallel (ms)", "speedup", "match");
+
+    bool all_match = true;
+    double total_tinyobj = 0.0;
+    double total_parallel = 0.0;
+
+    for (const auto& file : files)
+    {
+        tinyobj::ObjReader reader;
+        double tinyobj_ms = TimeBest(iterations, [&]() { reader = tinyobj::ObjReader(); reader.ParseFromFile(file); });
+
+        ObjParser parser;
+        double parallel_ms = TimeBest(iterations, [&]() { parser.ParseFromFile(file); });
+
+        // Polygons with more than four corners are split differently, so only compare the totals
+        bool match = reader.Valid() && parser.Valid()
+            && reader.GetAttrib().vertices.size() == parser.GetAttrib().vertices.size()
+            && reader.GetAttrib().normals.size() == parser.GetAttrib().normals.size()
+            && reader.GetAttrib().texcoords.size() == parser.GetAttrib().texcoords.size()
+            && reader.GetShapes().size() == parser.GetShapes().size()
+            && CountIndices(reader.GetShapes()) == CountIndices(parser.GetShapes());
+
+        all_match = all_match && match;
+        total_tinyobj += tinyobj_ms;
+        total_parallel += parallel_ms;
+
+        double size_kb = std::filesystem::file_size(file, error) / 1024.0;
+        printf("%-36s %10.1f %12.2f %12.2f %7.2fx  %s\n", file.c_str(), size_kb, tinyobj_ms, parallel_ms, tinyobj_ms / parallel_ms, match ? "yes" : "NO");
+    }
+
+    printf("%-36s %10s %12.2f %12.2f %7.2fx\n", "total", "", total_tinyobj, total_parallel, total_tinyobj / total_parallel);
+    return all_match ? 0 : 1;
+}
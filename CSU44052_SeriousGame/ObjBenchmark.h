@@ -0,0 +1,6 @@
+#pragma once
+
+#include <string>
+
+// Times tinyobj::ObjReader against ObjParser on every OBJ file under a directory
+int RunObjBenchmark(const std::string& directory, int iterations);
@@ -0,0 +1,817 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+namespace
+{
+    // Opens .mtl files through MappedFile, so they come out of the asset archive when there is one
+    class MappedMaterialReader : public tinyobj::MaterialReader
+    {
+    public:
+        explicit MappedMaterialReader(const std::string& base_dir) : base_dir(base_dir) {}
+
+        bool operator()(const std::string& mat_id, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* mat_map,
+            std::string* warn, std::string* err) override
+        {
+            std::string path = base_dir.empty() ? mat_id : base_dir + "/" + mat_id;
+
+            MappedFile file;
+            if (!file.Open(path))
+            {
+                if (warn)
+                {
+                    *warn += "Material file [ " + path + " ] not found\n";
+                }
+                return false;
+            }
+
+            std::istringstream stream(std::string((const char*)file.Data(), file.Size()));
+            tinyobj::LoadMtl(mat_map, materials, &stream, warn, err);
+            return true;
+        }
+
+    private:
+        std::string base_dir;
+    };
+
+    // Chunks smaller than this aren't worth handing to another thread
+    const size_t MIN_CHUNK_SIZE = 128 * 1024;
+
+    const int MISSING_INDEX = INT_MIN;
+
+    // Flags for indices that were negative (relative) in the file
+    const unsigned char RELATIVE_POSITION = 1;
+    const unsigned char RELATIVE_TEXCOORD = 2;
+    const unsigned char RELATIVE_NORMAL = 4;
+
+    // A face corner as written in the file. Absolute indices are stored 0 based, relative indices are
+    // stored relative to the start of the chunk because the chunk doesn't know how many came before it.
+    struct RawCorner
+    {
+        int position;
+        int texcoord;
+        int normal;
+        unsigned char relative;
+    };
+
+    enum EventType
+    {
+        EVENT_GROUP,
+        EVENT_OBJECT,
+        EVENT_USEMTL,
+        EVENT_MTLLIB,
+        EVENT_SMOOTHING
+    };
+
+    // Anything that isn't geometry, applied before face number `face` of the chunk
+    struct Event
+    {
+        EventType type;
+        size_t face;
+        std::string name;
+        unsigned int smoothing;
+    };
+
+    // Faces of one chunk that belong to the same shape
+    struct Segment
+    {
+        bool startsShape;
+        std::string name;
+        tinyobj::mesh_t mesh;
+    };
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+
+        // Counted in the first pass
+        size_t positionCount;
+        size_t texcoordCount;
+        size_t normalCount;
+
+        // Where this chunk's vertex attributes go in the final arrays
+        size_t positionBase;
+        size_t texcoordBase;
+        size_t normalBase;
+        float* positions;
+        float* texcoords;
+        float* normals;
+
+        std::vector<RawCorner> corners;
+        std::vector<unsigned char> faceSizes;
+        std::vector<Event> events;
+
+        // Filled in once every chunk has been tokenized
+        int startMaterial;
+        unsigned int startSmoothing;
+
+        std::vector<Segment> segments;
+        std::string warning;
+    };
+
+    const double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+        {
+            p++;
+        }
+        return p;
+    }
+
+    // Decimal float parser without locale lookups or allocation, good to float precision
+    const char* ParseFloat(const char* p, const char* end, float& out)
+    {
+        p = SkipSpaces(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        unsigned long long mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+
+        while (p < end && IsDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                {
+                    digits++;
+                }
+            }
+            else
+            {
+                exponent++;
+            }
+            p++;
+        }
+
+        if (p < end && *p == '.')
+        {
+            p++;
+            while (p < end && IsDigit(*p))
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa != 0)
+                    {
+                        digits++;
+                    }
+                    exponent--;
+                }
+                p++;
+            }
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = *p == '-';
+                p++;
+            }
+
+            int value = 0;
+            while (p < end && IsDigit(*p))
+            {
+                if (value < 10000)
+                {
+                    value = value * 10 + (*p - '0');
+                }
+                p++;
+            }
+            exponent += negativeExponent ? -value : value;
+        }
+
+        double result = (double)mantissa;
+        if (exponent < 0)
+        {
+            result = -exponent <= 22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+        }
+        else if (exponent > 0)
+        {
+            result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+        }
+
+        out = (float)(negative ? -result : result);
+        return p;
+    }
+
+    const char* ParseInt(const char* p, const char* end, int& out, bool& found)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        int value = 0;
+        found = false;
+        while (p < end && IsDigit(*p))
+        {
+            value = value * 10 + (*p - '0');
+            found = true;
+            p++;
+        }
+
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // Converts an index from the file into the RawCorner encoding
+    int EncodeIndex(int value, bool found, size_t localCount, unsigned char flag, unsigned char& relative)
+    {
+        if (!found || value == 0)
+        {
+            return MISSING_INDEX;
+        }
+        if (value < 0)
+        {
+            relative |= flag;
+            return (int)localCount + value;
+        }
+        return value - 1;
+    }
+
+    inline int ResolveIndex(int value, bool relative, size_t base)
+    {
+        if (value == MISSING_INDEX)
+        {
+            return -1;
+        }
+        return relative ? (int)base + value : value;
+    }
+
+    std::string RestOfLine(const char* p, const char* end)
+    {
+        p = SkipSpaces(p, end);
+        const char* last = end;
+        while (last > p && (IsSpace(last[-1]) || last[-1] == '\r'))
+        {
+            last--;
+        }
+        return std::string(p, last);
+    }
+
+    // First pass: count the vertex attributes of one chunk so they can be parsed straight into place,
+    // and reserve its face arrays
+    void CountChunk(Chunk& chunk)
+    {
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        size_t faceCount = 0;
+        size_t cornerCount = 0;
+
+        chunk.positionCount = 0;
+        chunk.texcoordCount = 0;
+        chunk.normalCount = 0;
+
+        while (p < end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+            if (lineEnd == nullptr)
+            {
+                lineEnd = end;
+            }
+
+            const char* token = SkipSpaces(p, lineEnd);
+            size_t length = lineEnd - token;
+
+            if (length >= 2 && token[0] == 'v' && IsSpace(token[1]))
+            {
+                chunk.positionCount++;
+            }
+            else if (length >= 3 && token[0] == 'v' && token[1] == 't' && IsSpace(token[2]))
+            {
+                chunk.texcoordCount++;
+            }
+            else if (length >= 3 && token[0] == 'v' && token[1] == 'n' && IsSpace(token[2]))
+            {
+                chunk.normalCount++;
+            }
+            else if (length >= 2 && token[0] == 'f' && IsSpace(token[1]))
+            {
+                const char* q = token + 2;
+                while (true)
+                {
+                    q = SkipSpaces(q, lineEnd);
+                    if (q >= lineEnd || *q == '\r' || *q == '#')
+                    {
+                        break;
+                    }
+                    while (q < lineEnd && !IsSpace(*q))
+                    {
+                        q++;
+                    }
+                    cornerCount++;
+                }
+                faceCount++;
+            }
+
+            p = lineEnd + 1;
+        }
+
+        chunk.corners.reserve(cornerCount);
+        chunk.faceSizes.reserve(faceCount);
+    }
+
+    // Second pass: parse the vertex attributes into place and tokenize everything else
+    void TokenizeChunk(Chunk& chunk)
+    {
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        size_t positionsRead = 0;
+        size_t texcoordsRead = 0;
+        size_t normalsRead = 0;
+
+        while (p < end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+            if (lineEnd == nullptr)
+            {
+                lineEnd = end;
+            }
+
+            const char* token = SkipSpaces(p, lineEnd);
+            size_t length = lineEnd - token;
+
+            if (length >= 2 && token[0] == 'v' && IsSpace(token[1]))
+            {
+                float* position = chunk.positions + 3 * positionsRead++;
+                const char* q = ParseFloat(token + 2, lineEnd, position[0]);
+                q = ParseFloat(q, lineEnd, position[1]);
+                ParseFloat(q, lineEnd, position[2]);
+            }
+            else if (length >= 3 && token[0] == 'v' && token[1] == 't' && IsSpace(token[2]))
+            {
+                float* texcoord = chunk.texcoords + 2 * texcoordsRead++;
+                const char* q = ParseFloat(token + 3, lineEnd, texcoord[0]);
+                ParseFloat(q, lineEnd, texcoord[1]);
+            }
+            else if (length >= 3 && token[0] == 'v' && token[1] == 'n' && IsSpace(token[2]))
+            {
+                float* normal = chunk.normals + 3 * normalsRead++;
+                const char* q = ParseFloat(token + 3, lineEnd, normal[0]);
+                q = ParseFloat(q, lineEnd, normal[1]);
+                ParseFloat(q, lineEnd, normal[2]);
+            }
+            else if (length >= 2 && token[0] == 'f' && IsSpace(token[1]))
+            {
+                const char* q = token + 2;
+                unsigned int cornerCount = 0;
+
+                while (true)
+                {
+                    q = SkipSpaces(q, lineEnd);
+                    if (q >= lineEnd || *q == '\r' || *q == '#')
+                    {
+                        break;
+                    }
+
+                    RawCorner corner;
+                    corner.relative = 0;
+
+                    int value;
+                    bool found;
+                    q = ParseInt(q, lineEnd, value, found);
+                    corner.position = EncodeIndex(value, found, positionsRead, RELATIVE_POSITION, corner.relative);
+                    corner.texcoord = MISSING_INDEX;
+                    corner.normal = MISSING_INDEX;
+
+                    if (q < lineEnd && *q == '/')
+                    {
+                        q = ParseInt(q + 1, lineEnd, value, found);
+                        corner.texcoord = EncodeIndex(value, found, texcoordsRead, RELATIVE_TEXCOORD, corner.relative);
+
+                        if (q < lineEnd && *q == '/')
+                        {
+                            q = ParseInt(q + 1, lineEnd, value, found);
+                            corner.normal = EncodeIndex(value, found, normalsRead, RELATIVE_NORMAL, corner.relative);
+                        }
+                    }
+
+                    if (corner.position == MISSING_INDEX)
+                    {
+                        // not an index, skip the rest of the token
+                        while (q < lineEnd && !IsSpace(*q))
+                        {
+                            q++;
+                        }
+                        continue;
+                    }
+
+                    chunk.corners.push_back(corner);
+                    cornerCount++;
+                }
+
+                if (cornerCount > 255)
+                {
+                    chunk.warning += "Face with more than 255 corners skipped.\n";
+                    chunk.corners.resize(chunk.corners.size() - cornerCount);
+                }
+                else if (cornerCount > 0)
+                {
+                    chunk.faceSizes.push_back((unsigned char)cornerCount);
+                }
+            }
+            else if (length >= 2 && (token[0] == 'g' || token[0] == 'o') && IsSpace(token[1]))
+            {
+                Event event;
+                event.type = token[0] == 'g' ? EVENT_GROUP : EVENT_OBJECT;
+                event.face = chunk.faceSizes.size();
+                event.name = RestOfLine(token + 2, lineEnd);
+                event.smoothing = 0;
+                chunk.events.push_back(event);
+            }
+            else if (length >= 7 && (strncmp(token, "usemtl", 6) == 0 || strncmp(token, "mtllib", 6) == 0) && IsSpace(token[6]))
+            {
+                Event event;
+                event.type = token[0] == 'u' ? EVENT_USEMTL : EVENT_MTLLIB;
+                event.face = chunk.faceSizes.size();
+                event.name = RestOfLine(token + 7, lineEnd);
+                event.smoothing = 0;
+                chunk.events.push_back(event);
+            }
+            else if (length >= 2 && token[0] == 's' && IsSpace(token[1]))
+            {
+                std::string value = RestOfLine(token + 2, lineEnd);
+
+                Event event;
+                event.type = EVENT_SMOOTHING;
+                event.face = chunk.faceSizes.size();
+                event.smoothing = (value.empty() || value == "off") ? 0 : (unsigned int)atoi(value.c_str());
+                chunk.events.push_back(event);
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    tinyobj::index_t ResolveCorner(const RawCorner& corner, const Chunk& chunk)
+    {
+        tinyobj::index_t index;
+        index.vertex_index = ResolveIndex(corner.position, (corner.relative & RELATIVE_POSITION) != 0, chunk.positionBase);
+        index.texcoord_index = ResolveIndex(corner.texcoord, (corner.relative & RELATIVE_TEXCOORD) != 0, chunk.texcoordBase);
+        index.normal_index = ResolveIndex(corner.normal, (corner.relative & RELATIVE_NORMAL) != 0, chunk.normalBase);
+        return index;
+    }
+
+    void AddFace(tinyobj::mesh_t& mesh, int material, unsigned int smoothing, unsigned int count)
+    {
+        mesh.num_face_vertices.push_back((unsigned char)count);
+        mesh.material_ids.push_back(material);
+        mesh.smoothing_group_ids.push_back(smoothing);
+    }
+
+    float DistanceSquared(const std::vector<float>& positions, int a, int b)
+    {
+        float dx = positions[3 * a + 0] - positions[3 * b + 0];
+        float dy = positions[3 * a + 1] - positions[3 * b + 1];
+        float dz = positions[3 * a + 2] - positions[3 * b + 2];
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // Second pass: resolve indices, triangulate and split the chunk into shape segments
+    void BuildSegments(Chunk& chunk, const std::vector<float>& positions, const std::map<std::string, int>& materialMap, bool triangulate)
+    {
+        int material = chunk.startMaterial;
+        unsigned int smoothing = chunk.startSmoothing;
+        size_t vertexCount = positions.size() / 3;
+
+        Segment continuation;
+        continuation.startsShape = false;
+        chunk.segments.push_back(continuation);
+
+        size_t nextEvent = 0;
+        size_t corner = 0;
+
+        for (size_t f = 0; f <= chunk.faceSizes.size(); f++)
+        {
+            while (nextEvent < chunk.events.size() && chunk.events[nextEvent].face == f)
+            {
+                const Event& event = chunk.events[nextEvent++];
+
+                if (event.type == EVENT_GROUP || event.type == EVENT_OBJECT)
+                {
+                    Segment segment;
+                    segment.startsShape = true;
+                    segment.name = event.name;
+                    chunk.segments.push_back(segment);
+                }
+                else if (event.type == EVENT_USEMTL)
+                {
+                    auto found = materialMap.find(event.name);
+                    material = found != materialMap.end() ? found->second : -1;
+                }
+                else if (event.type == EVENT_SMOOTHING)
+                {
+                    smoothing = event.smoothing;
+                }
+            }
+
+            if (f == chunk.faceSizes.size())
+            {
+                break;
+            }
+
+            unsigned int count = chunk.faceSizes[f];
+            const RawCorner* raw = &chunk.corners[corner];
+            corner += count;
+
+            tinyobj::index_t face[255];
+            bool valid = count >= 3;
+
+            for (unsigned int c = 0; c < count && valid; c++)
+            {
+                face[c] = ResolveCorner(raw[c], chunk);
+                valid = face[c].vertex_index >= 0 && (size_t)face[c].vertex_index < vertexCount;
+            }
+
+            if (!valid)
+            {
+                chunk.warning += "Degenerated face or face with invalid vertex index found.\n";
+                continue;
+            }
+
+            tinyobj::mesh_t& mesh = chunk.segments.back().mesh;
+
+            if (!triangulate || count == 3)
+            {
+                mesh.indices.insert(mesh.indices.end(), face, face + count);
+                AddFace(mesh, material, smoothing, count);
+            }
+            else if (count == 4)
+            {
+                // Split along the shorter diagonal, same as tinyobj
+                if (DistanceSquared(positions, face[0].vertex_index, face[2].vertex_index) < DistanceSquared(positions, face[1].vertex_index, face[3].vertex_index))
+                {
+                    tinyobj::index_t triangles[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+                    mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+                }
+                else
+                {
+                    tinyobj::index_t triangles[6] = { face[0], face[1], face[3], face[1], face[2], face[3] };
+                    mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+                }
+                AddFace(mesh, material, smoothing, 3);
+                AddFace(mesh, material, smoothing, 3);
+            }
+            else
+            {
+                for (unsigned int c = 1; c + 1 < count; c++)
+                {
+                    mesh.indices.push_back(face[0]);
+                    mesh.indices.push_back(face[c]);
+                    mesh.indices.push_back(face[c + 1]);
+                    AddFace(mesh, material, smoothing, 3);
+                }
+            }
+        }
+    }
+
+    void AppendMesh(tinyobj::mesh_t& target, const tinyobj::mesh_t& source)
+    {
+        target.indices.insert(target.indices.end(), source.indices.begin(), source.indices.end());
+        target.num_face_vertices.insert(target.num_face_vertices.end(), source.num_face_vertices.begin(), source.num_face_vertices.end());
+        target.material_ids.insert(target.material_ids.end(), source.material_ids.begin(), source.material_ids.end());
+        target.smoothing_group_ids.insert(target.smoothing_group_ids.end(), source.smoothing_group_ids.begin(), source.smoothing_group_ids.end());
+    }
+}
+
+ObjParser::ObjParser()
+{
+    valid = false;
+}
+
+bool ObjParser::ParseFromFile(const std::string& filename, const tinyobj::ObjReaderConfig& config)
+{
+    std::string mtl_search_path = config.mtl_search_path;
+
+    // Same default as tinyobj, look for materials next to the obj file
+    if (mtl_search_path.empty())
+    {
+        size_t pos = filename.find_last_of("/\\");
+        if (pos != std::string::npos)
+        {
+            mtl_search_path = filename.substr(0, pos);
+        }
+    }
+
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        error = "Cannot open file [" + filename + "]\n";
+        valid = false;
+        return false;
+    }
+
+    MappedMaterialReader material_reader(mtl_search_path);
+    return ParseFromMemory((const char*)file.Data(), file.Size(), &material_reader, config.triangulate);
+}
+
+bool ObjParser::ParseFromMemory(const char* data, size_t size, tinyobj::MaterialReader* material_reader, bool triangulate)
+{
+    attrib = tinyobj::attrib_t();
+    shapes.clear();
+    materials.clear();
+    warning.clear();
+    error.clear();
+
+    ThreadPool* pool = ThreadPool::GetInstance();
+
+    // Split the buffer into roughly equal chunks that end on line boundaries
+    size_t chunk_count = std::max((size_t)1, std::min((size_t)pool->ThreadCount() * 2, size / MIN_CHUNK_SIZE));
+    std::vector<Chunk> chunks(chunk_count);
+
+    const char* end = data + size;
+    const char* begin = data;
+
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        const char* split = (i + 1 == chunk_count) ? end : data + size * (i + 1) / chunk_count;
+        if (split < begin)
+        {
+            split = begin;
+        }
+
+        const char* newline = (const char*)memchr(split, '\n', end - split);
+        split = newline ? newline + 1 : end;
+
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        begin = split;
+    }
+
+    pool->ParallelFor(chunk_count, [&chunks](size_t i) { CountChunk(chunks[i]); });
+
+    // Size the attribute arrays once and give every chunk its slice
+    size_t position_count = 0;
+    size_t texcoord_count = 0;
+    size_t normal_count = 0;
+
+    for (auto& chunk : chunks)
+    {
+        chunk.positionBase = position_count;
+        chunk.texcoordBase = texcoord_count;
+        chunk.normalBase = normal_count;
+        position_count += chunk.positionCount;
+        texcoord_count += chunk.texcoordCount;
+        normal_count += chunk.normalCount;
+    }
+
+    attrib.vertices.resize(position_count * 3);
+    attrib.texcoords.resize(texcoord_count * 2);
+    attrib.normals.resize(normal_count * 3);
+
+    for (auto& chunk : chunks)
+    {
+        chunk.positions = attrib.vertices.data() + chunk.positionBase * 3;
+        chunk.texcoords = attrib.texcoords.data() + chunk.texcoordBase * 2;
+        chunk.normals = attrib.normals.data() + chunk.normalBase * 3;
+    }
+
+    pool->ParallelFor(chunk_count, [&chunks](size_t i) { TokenizeChunk(chunks[i]); });
+
+    // Work out the state each chunk starts with
+    int material = -1;
+    unsigned int smoothing = 0;
+    std::map<std::string, int> material_map;
+
+    for (auto& chunk : chunks)
+    {
+        chunk.startSmoothing = smoothing;
+
+        for (const auto& event : chunk.events)
+        {
+            if (event.type == EVENT_MTLLIB && material_reader != nullptr && material_map.empty())
+            {
+                // Try each listed file until one loads, like tinyobj
+                size_t start = 0;
+                while (start < event.name.size())
+                {
+                    size_t stop = event.name.find(' ', start);
+                    if (stop == std::string::npos)
+                    {
+                        stop = event.name.size();
+                    }
+
+                    std::string material_file = event.name.substr(start, stop - start);
+                    std::string mtl_warning, mtl_error;
+
+                    if (!material_file.empty() && (*material_reader)(material_file, &materials, &material_map, &mtl_warning, &mtl_error))
+                    {
+                        warning += mtl_warning;
+                        break;
+                    }
+                    warning += mtl_warning;
+                    start = stop + 1;
+                }
+            }
+            else if (event.type == EVENT_SMOOTHING)
+            {
+                smoothing = event.smoothing;
+            }
+        }
+    }
+
+    // Materials are only known after the mtllib line, so resolve the per chunk start material in a second scan
+    for (auto& chunk : chunks)
+    {
+        chunk.startMaterial = material;
+
+        for (const auto& event : chunk.events)
+        {
+            if (event.type == EVENT_USEMTL)
+            {
+                auto found = material_map.find(event.name);
+                if (found == material_map.end())
+                {
+                    warning += "material [ '" + event.name + "' ] not found in .mtl\n";
+                    material = -1;
+                }
+                else
+                {
+                    material = found->second;
+                }
+            }
+        }
+    }
+
+    pool->ParallelFor(chunk_count, [this, &chunks, &material_map, triangulate](size_t i)
+    {
+        BuildSegments(chunks[i], attrib.vertices, material_map, triangulate);
+
+        std::vector<RawCorner>().swap(chunks[i].corners);
+        std::vector<unsigned char>().swap(chunks[i].faceSizes);
+    });
+
+    // Stitch the segments together into shapes in file order
+    tinyobj::shape_t shape;
+
+    for (auto& chunk : chunks)
+    {
+        warning += chunk.warning;
+
+        for (auto& segment : chunk.segments)
+        {
+            if (segment.startsShape)
+            {
+                if (!shape.mesh.indices.empty())
+                {
+                    shapes.push_back(std::move(shape));
+                }
+                shape = tinyobj::shape_t();
+                shape.name = segment.name;
+            }
+
+            if (shape.mesh.indices.empty())
+            {
+                shape.mesh = std::move(segment.mesh);
+            }
+            else
+            {
+                AppendMesh(shape.mesh, segment.mesh);
+            }
+        }
+    }
+
+    if (!shape.mesh.indices.empty())
+    {
+        shapes.push_back(std::move(shape));
+    }
+
+    valid = true;
+    return true;
+}
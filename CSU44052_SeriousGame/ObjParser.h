@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+// Multithreaded OBJ reader producing the same attrib, shape and material structures as tinyobj::ObjReader.
+// The file is split at line boundaries and every chunk is counted and then tokenized on the thread pool, vertex
+// attributes are parsed straight into the final arrays and the faces are merged in file order. Faces with more
+// than four corners are triangulated as a fan, vertex colours are not read.
+class ObjParser
+{
+public:
+    ObjParser();
+
+    bool ParseFromFile(const std::string& filename, const tinyobj::ObjReaderConfig& config = tinyobj::ObjReaderConfig());
+
+    bool ParseFromMemory(const char* data, size_t size, tinyobj::MaterialReader* material_reader, bool triangulate = true);
+
+    bool Valid() const { return valid; }
+
+    const tinyobj::attrib_t& GetAttrib() const { return attrib; }
+
+    const std::vector<tinyobj::shape_t>& GetShapes() const { return shapes; }
+
+    const std::vector<tinyobj::material_t>& GetMaterials() const { return materials; }
+
+    const std::string& Warning() const { return warning; }
+
+    const std::string& Error() const { return error; }
+
+private:
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warning;
+    std::string error;
+    bool valid;
+};
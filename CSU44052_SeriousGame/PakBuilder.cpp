@@ -0,0 +1,97 @@
+#include "PakBuilder.h"
+#include "AssetPak.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+    // Only sources go in the archive. The caches built from them (.meshbin, .ktx2, .impostor, .sdf) are
+    // written next to them at run time, and are checked against the hash of the packed source.
+    bool IsSourceAsset(std::string extension)
+    {
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        const char* sourceExtensions[] = { ".obj", ".mtl", ".jpg", ".jpeg", ".png", ".ttf", ".vert", ".frag", ".glsl" };
+        for (const char* sourceExtension : sourceExtensions)
+        {
+            if (extension == sourceExtension)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+int RunPakBuilder(const std::vector<std::string>& directories, const std::string& pakPath)
+{
+    std::vector<std::string> files;
+
+    for (const auto& directory : directories)
+    {
+        std::error_code error;
+        for (auto it = std::filesystem::recursive_directory_iterator(directory, error); it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+        {
+            if (error)
+            {
+                break;
+            }
+
+            if (it->is_regular_file() && it->file_size() > 0 && IsSourceAsset(it->path().extension().string()))
+            {
+                files.push_back(it->path().generic_string());
+            }
+        }
+    }
+
+    if (files.empty())
+    {
+        printf("No assets found to pack\n");
+        return 1;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    auto start = std::chrono::steady_clock::now();
+    if (!AssetPak::Build(files, pakPath))
+    {
+        printf("Failed to write %s\n", pakPath.c_str());
+        return 1;
+    }
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    AssetPak* pak = AssetPak::GetInstance();
+    if (!pak->Mount(pakPath))
+    {
+        return 1;
+    }
+
+    // Read every entry back through MappedFile, which now goes to the archive, and compare with the loose file's hash
+    printf("%-44s %10s %10s %6s\n", "file", "size (KB)", "packed", "lz4");
+
+    bool allMatch = true;
+    size_t totalSize = 0;
+    size_t totalStored = 0;
+
+    for (const auto& file : files)
+    {
+        const AssetPak::Entry* entry = pak->Find(file);
+        MappedFile packed;
+        if (!entry || !packed.Open(file) || AssetPak::HashBytes(packed.Data(), packed.Size()) != entry->contentHash)
+        {
+            printf("%-44s does not read back\n", file.c_str());
+            allMatch = false;
+            continue;
+        }
+
+        totalSize += (size_t)entry->size;
+        totalStored += (size_t)entry->storedSize;
+        printf("%-44s %10.1f %10.1f %6s\n", file.c_str(), entry->size / 1024.0, entry->storedSize / 1024.0, entry->compression == AssetPak::LZ4 ? "yes" : "no");
+    }
+
+    printf("%zu files, %.1f KB packed into %.1f KB in %.0f ms\n", files.size(), totalSize / 1024.0, totalStored / 1024.0, buildMs);
+    return allMatch ? 0 : 1;
+}
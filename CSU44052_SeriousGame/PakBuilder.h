@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Packs the source assets under the given directories (models, images, fonts and shaders) into an AssetPak,
+// then mounts it and checks every entry reads back to what was packed
+int RunPakBuilder(const std::vector<std::string>& directories, const std::string& pakPath);
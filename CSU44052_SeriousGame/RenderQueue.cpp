@@ -0,0 +1,371 @@
+#include "RenderQueue.h"
+#include "InstanceRing.h"
+
+#include <algorithm>
+#include <numeric>
+
+const float RenderQueue::MAX_DEPTH = 100.0f;
+
+namespace
+{
+    // More than any draw has instances, so the draw index attribute stays on the element at baseInstance
+    const GLuint DRAW_INDEX_DIVISOR = 1u << 30;
+
+    // Set a uniform the program was last given something else for, or hasn't been given anything yet
+    template <typename T>
+    void UpdateUniform(const Uniform<T>& uniform, T& last, const T& value, bool first, RenderQueue::StateChanges& changes, bool issue)
+    {
+        if (!first && last == value)
+        {
+            return;
+        }
+
+        last = value;
+        if (uniform.IsValid())
+        {
+            changes.uniforms++;
+            if (issue)
+            {
+                uniform.Set(value);
+            }
+        }
+    }
+}
+
+uint64_t RenderQueue::MakeKey(Pass pass, GLuint program, GLuint texture, GLuint vao, GLuint instanceMatrices, float depth)
+{
+    // Names past the bits they get only sort less well, the draws are still right. The vertex array gets 8 bits, every
+    // Model shares GeometryArena's anyway.
+    uint64_t quantizedDepth = (uint64_t)(std::min(std::max(depth / MAX_DEPTH, 0.0f), 1.0f) * 65535.0f);
+
+    return ((uint64_t)(pass & 0xF) << 60) |
+        ((uint64_t)(program & 0xFFF) << 48) |
+        ((uint64_t)(texture & 0xFFFF) << 32) |
+        ((uint64_t)(vao & 0xFF) << 24) |
+        ((uint64_t)(instanceMatrices & 0xFF) << 16) |
+        quantizedDepth;
+}
+
+void RenderQueue::Submit(Pass pass, float depth, const RenderItem& item)
+{
+    keys.push_back(MakeKey(pass, item.program->Id(), item.textures[0], item.vao, item.instanceMatrices, depth));
+    items.push_back(item);
+}
+
+void RenderQueue::Execute()
+{
+    statistics = Statistics();
+    statistics.draws = items.size();
+
+    state.program = nullptr;
+    state.vao = 0;
+    state.textures[0] = 0;
+    state.textures[1] = 0;
+    state.instanceMatrices = 0;
+    state.instanceIndices = 0;
+    state.instanceBindings.clear();
+
+    // Before counting, growing names a new buffer
+    ReserveDrawIndices(items.size());
+
+    // What drawing them as submitted would have changed
+    BoundState unsortedState = state;
+    size_t multiDraws = 0;
+    for (const RenderItem& item : items)
+    {
+        Apply(item, unsortedState, statistics.unsorted, false);
+        multiDraws += item.instanceFormat == RenderItem::INSTANCE_INDICES ? 1 : 0;
+    }
+
+    RadixSort();
+
+    // Room for a command per multi drawn item, each call reads the ones of its run
+    InstanceRing* ring = InstanceRing::GetInstance();
+    DrawElementsIndirectCommand* commands = NULL;
+    GLintptr commandOffset = 0;
+    size_t commandCount = 0;
+
+    if (multiDraws > 0)
+    {
+        WriteDrawRecords();
+        commands = ring->Allocate<DrawElementsIndirectCommand>(multiDraws, commandOffset);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->Buffer());
+    }
+
+    size_t next = 0;
+    while (next < sorted.size())
+    {
+        const RenderItem& item = items[sorted[next].second];
+        Apply(item, state, statistics.sorted, true);
+        statistics.calls++;
+
+        if (item.instanceFormat == RenderItem::INSTANCE_INDICES)
+        {
+            // The draws after it that share its state go in the same call, they already sit next to each other
+            size_t first = commandCount;
+            size_t indexSize = item.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+            do
+            {
+                const RenderItem& draw = items[sorted[next].second];
+                DrawElementsIndirectCommand& command = commands[commandCount++];
+                command.count = (GLuint)draw.count;
+                command.instanceCount = (GLuint)draw.instanceCount;
+                command.firstIndex = (GLuint)(draw.indexOffset / indexSize);
+                command.baseVertex = draw.baseVertex;
+                // Where its DrawRecord is, which then says where its instances are
+                command.baseInstance = sorted[next].second;
+                next++;
+            } while (next < sorted.size() && SharesMultiDraw(item, items[sorted[next].second]));
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, item.indexType, (void*)(commandOffset + first * sizeof(DrawElementsIndirectCommand)),
+                (GLsizei)(commandCount - first), 0);
+            continue;
+        }
+
+        if (item.indexType != 0)
+        {
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, item.count, item.indexType, (void*)item.indexOffset, item.instanceCount, item.baseVertex, item.baseInstance);
+        }
+        else
+        {
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, item.count, item.instanceCount, item.baseInstance);
+        }
+        next++;
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+
+    keys.clear();
+    items.clear();
+}
+
+void RenderQueue::WriteDrawRecords()
+{
+    // The bound range has to start on the storage buffer offset alignment, which can be coarser than the ring's
+    GLint alignment = 0;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = std::max(alignment, 1);
+
+    InstanceRing* ring = InstanceRing::GetInstance();
+    GLsizeiptr size = (GLsizeiptr)(items.size() * sizeof(DrawRecord));
+    GLintptr offset;
+    unsigned char* mapped = (unsigned char*)ring->Allocate(size + alignment, offset);
+
+    GLintptr aligned = (offset + alignment - 1) / alignment * alignment;
+    DrawRecord* records = (DrawRecord*)(mapped + (aligned - offset));
+
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        const RenderItem& item = items[i];
+        DrawRecord& record = records[i];
+        record.model = item.model;
+        record.positionOffset = glm::vec4(item.bounds.positionOffset, 0.0f);
+        record.positionScale = glm::vec4(item.bounds.positionScale, 0.0f);
+        record.texcoordBounds = glm::vec4(item.bounds.texcoordOffset, item.bounds.texcoordScale);
+        record.material = glm::vec4(item.shininess, item.specularIntensity, item.impostorFade);
+        record.instances = glm::uvec4(item.baseInstance, 0, 0, 0);
+    }
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_BINDING, ring->Buffer(), aligned, size);
+}
+
+bool RenderQueue::SharesMultiDraw(const RenderItem& a, const RenderItem& b)
+{
+    return b.instanceFormat == RenderItem::INSTANCE_INDICES && a.program == b.program && a.vao == b.vao &&
+        a.textures[0] == b.textures[0] && a.textures[1] == b.textures[1] && a.instanceBuffer == b.instanceBuffer &&
+        a.instanceMatrices == b.instanceMatrices && a.indexType == b.indexType;
+}
+
+void RenderQueue::Apply(const RenderItem& item, BoundState& state, StateChanges& changes, bool issue) const
+{
+    const ShaderProgram& program = *item.program;
+
+    if (state.program != item.program)
+    {
+        changes.programs++;
+        state.program = item.program;
+        if (issue)
+        {
+            program.Use();
+        }
+    }
+
+    if (state.vao != item.vao)
+    {
+        changes.vertexArrays++;
+        state.vao = item.vao;
+        if (issue)
+        {
+            glBindVertexArray(item.vao);
+        }
+    }
+
+    for (GLuint unit = 0; unit < 2; unit++)
+    {
+        if (item.textures[unit] != 0 && state.textures[unit] != item.textures[unit])
+        {
+            changes.textures++;
+            state.textures[unit] = item.textures[unit];
+            if (issue)
+            {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, item.textures[unit]);
+            }
+        }
+    }
+
+    if (item.instanceMatrices != 0 && state.instanceMatrices != item.instanceMatrices)
+    {
+        changes.storageBuffers++;
+        state.instanceMatrices = item.instanceMatrices;
+        if (issue)
+        {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATRIX_BINDING, item.instanceMatrices);
+        }
+    }
+
+    GLuint attributeBuffer = item.instanceBuffer;
+    if (item.instanceFormat == RenderItem::INSTANCE_INDICES)
+    {
+        attributeBuffer = drawIndices;
+        if (state.instanceIndices != item.instanceBuffer)
+        {
+            changes.storageBuffers++;
+            state.instanceIndices = item.instanceBuffer;
+            if (issue)
+            {
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, item.instanceBuffer);
+            }
+        }
+    }
+
+    // The attributes belong to the vertex array, bound above. Draws pick their instances with baseInstance, so
+    // they only need pointing again when the buffer is another one.
+    auto binding = state.instanceBindings.find(item.vao);
+    if (binding == state.instanceBindings.end() || binding->second.format != item.instanceFormat || binding->second.buffer != attributeBuffer)
+    {
+        changes.instanceAttributes++;
+        state.instanceBindings[item.vao] = { item.instanceFormat, attributeBuffer };
+        if (issue)
+        {
+            PointInstanceAttributes(item.instanceFormat, attributeBuffer);
+        }
+    }
+
+    bool first = state.uniforms.find(item.program) == state.uniforms.end();
+    ProgramUniforms& last = state.uniforms[item.program];
+
+    if (first)
+    {
+        // The sampler always reads the same unit
+        int diffuseUnit = 0;
+        UpdateUniform(program.diffuseTexture, diffuseUnit, 0, true, changes, issue);
+    }
+
+    UpdateUniform(program.model, last.model, item.model, first, changes, issue);
+    UpdateUniform(program.shininess, last.shininess, item.shininess, first, changes, issue);
+    UpdateUniform(program.specularIntensity, last.specularIntensity, item.specularIntensity, first, changes, issue);
+    UpdateUniform(program.impostorFade, last.impostorFade, item.impostorFade, first, changes, issue);
+    UpdateUniform(program.positionOffset, last.bounds.positionOffset, item.bounds.positionOffset, first, changes, issue);
+    UpdateUniform(program.positionScale, last.bounds.positionScale, item.bounds.positionScale, first, changes, issue);
+    UpdateUniform(program.texcoordOffset, last.bounds.texcoordOffset, item.bounds.texcoordOffset, first, changes, issue);
+    UpdateUniform(program.texcoordScale, last.bounds.texcoordScale, item.bounds.texcoordScale, first, changes, issue);
+    UpdateUniform(program.impostorCenter, last.impostorCenter, item.impostorCenter, first, changes, issue);
+    UpdateUniform(program.impostorRadius, last.impostorRadius, item.impostorRadius, first, changes, issue);
+}
+
+void RenderQueue::PointInstanceAttributes(RenderItem::InstanceFormat format, GLuint buffer)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    switch (format)
+    {
+    case RenderItem::INSTANCE_INDICES:
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(3, DRAW_INDEX_DIVISOR);
+        break;
+
+    case RenderItem::INSTANCE_POSITIONS:
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        break;
+    }
+}
+
+void RenderQueue::ReserveDrawIndices(size_t count)
+{
+    if (count <= drawIndexCapacity && drawIndices != 0)
+    {
+        return;
+    }
+
+    drawIndexCapacity = std::max(count, std::max(drawIndexCapacity * 2, (size_t)256));
+    std::vector<GLuint> indices(drawIndexCapacity);
+    std::iota(indices.begin(), indices.end(), 0u);
+
+    // Named before the old one goes so the name differs, the vertex arrays are pointed again by name
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    if (drawIndices != 0)
+    {
+        glDeleteBuffers(1, &drawIndices);
+    }
+    drawIndices = buffer;
+
+    glBindBuffer(GL_ARRAY_BUFFER, drawIndices);
+    glBufferStorage(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void RenderQueue::RadixSort()
+{
+    size_t count = keys.size();
+    sorted.resize(count);
+    sortScratch.resize(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sorted[i] = std::make_pair(keys[i], (uint32_t)i);
+    }
+
+    if (count < 2)
+    {
+        return;
+    }
+
+    for (unsigned int shift = 0; shift < 64; shift += 8)
+    {
+        size_t digits[256] = {};
+        for (const std::pair<uint64_t, uint32_t>& entry : sorted)
+        {
+            digits[(entry.first >> shift) & 0xFF]++;
+        }
+
+        // Every key has the same digit here, the pass wouldn't move anything
+        if (digits[(sorted[0].first >> shift) & 0xFF] == count)
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t d = 0; d < 256; d++)
+        {
+            size_t digitCount = digits[d];
+            digits[d] = offset;
+            offset += digitCount;
+        }
+
+        // Stable, so equal keys stay in the order they were submitted
+        for (const std::pair<uint64_t, uint32_t>& entry : sorted)
+        {
+            sortScratch[digits[(entry.first >> shift) & 0xFF]++] = entry;
+        }
+        sorted.swap(sortScratch);
+    }
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+#include "VertexQuantizer.h"
+
+// Everything one instanced draw needs. Whoever submits it fills it in without touching GL, the queue works out
+// which of it differs from what the draw before left behind.
+struct RenderItem
+{
+    // Where the instances find what's theirs, starting at baseInstance in instanceBuffer
+    enum InstanceFormat
+    {
+        // instanceBuffer is a storage buffer of uint bound to RenderQueue::INDEX_BINDING, the index of each
+        // instance's matrix in instanceMatrices. Drawn with glMultiDrawElementsIndirect, together with the draws
+        // sorted next to it that only differ in their DrawRecord.
+        INSTANCE_INDICES,
+        // A vec4 in attribute 1, an impostor's origin and scale
+        INSTANCE_POSITIONS
+    };
+
+    const ShaderProgram* program = nullptr;
+    GLuint vao = 0;
+
+    // GL_TEXTURE_2D on units 0 and 1, 0 for a unit the program doesn't sample
+    GLuint textures[2] = { 0, 0 };
+
+    // Storage buffer of mat4 bound to RenderQueue::MATRIX_BINDING, for INSTANCE_INDICES
+    GLuint instanceMatrices = 0;
+
+    InstanceFormat instanceFormat = INSTANCE_INDICES;
+    GLuint instanceBuffer = 0;
+
+    // Uniforms, set on the handles of program that exist. INSTANCE_INDICES draws read them from their DrawRecord.
+    glm::mat4 model = glm::mat4(1.0f);
+    float shininess = 0.0f;
+    float specularIntensity = 0.0f;
+    glm::vec2 impostorFade = glm::vec2(0.0f);
+    CompactBounds bounds = {};
+    glm::vec3 impostorCenter = glm::vec3(0.0f);
+    float impostorRadius = 0.0f;
+
+    // Indexed triangles from the vertex array's element buffer, or a triangle strip of count vertices when
+    // indexType is 0. Indices count from baseVertex.
+    GLenum indexType = 0;
+    size_t indexOffset = 0;
+    GLint baseVertex = 0;
+    GLsizei count = 0;
+    GLsizei instanceCount = 0;
+    GLuint baseInstance = 0;
+};
+
+// Collects the draws of a frame, each with a 64 bit key made of its pass, program, texture, vertex array, instance
+// matrices and depth, and draws them sorted by it so draws that share state follow each other. Execute only changes
+// the program, vertex array, textures, instance attributes, storage buffers and uniforms a draw needs different from
+// the draw before. INSTANCE_INDICES draws that end up next to each other with the same state go out as one
+// glMultiDrawElementsIndirect, their uniforms are written to the DrawRecords storage buffer for the frame instead.
+// Each command's baseInstance is its draw's index there, attribute 3 reads it back from a buffer counting up that
+// never advances within a draw, so the shader finds its DrawRecord without gl_DrawID or any per instance data.
+//
+// The uniforms of RenderItem are remembered per program from frame to frame, so a program drawn through the queue
+// must not have them set anywhere else. The diffuseTexture sampler is pointed at unit 0 the first time a program is
+// drawn.
+class RenderQueue
+{
+public:
+    // Highest bits of the key, earlier passes draw first
+    enum Pass : uint32_t
+    {
+        PASS_OPAQUE = 0,
+        // After the meshes, whose depth then saves shading the impostor pixels behind them
+        PASS_IMPOSTOR = 1
+    };
+
+    // Depth is stored in 16 bits of the key over this many units, anything further sorts last
+    static const float MAX_DEPTH;
+
+    // Storage buffer bindings ShaderProgram points the InstanceMatrices, DrawRecords and InstanceIndices blocks at
+    static const GLuint MATRIX_BINDING = 0;
+    static const GLuint DRAW_BINDING = 1;
+    static const GLuint INDEX_BINDING = 2;
+
+    // What an INSTANCE_INDICES draw has instead of uniforms, one per draw submitted in the frame's DrawRecords buffer.
+    // The DrawRecord struct in shaders/shader_instanced.vert has to match this std430 layout.
+    struct DrawRecord
+    {
+        glm::mat4 model;
+        // xyz, w unused
+        glm::vec4 positionOffset;
+        glm::vec4 positionScale;
+        // Offset in xy, scale in zw
+        glm::vec4 texcoordBounds;
+        // Shininess, specular intensity and impostorFade
+        glm::vec4 material;
+        // baseInstance of the item in x, where its instances start in InstanceIndices
+        glm::uvec4 instances;
+    };
+
+    // How much state a frame's draws changed, counted the same way for the order they were submitted in and the
+    // order they were drawn in
+    struct StateChanges
+    {
+        size_t programs = 0;
+        size_t vertexArrays = 0;
+        size_t textures = 0;
+        size_t instanceAttributes = 0;
+        size_t storageBuffers = 0;
+        size_t uniforms = 0;
+
+        size_t Total() const { return programs + vertexArrays + textures + instanceAttributes + storageBuffers + uniforms; }
+    };
+
+    struct Statistics
+    {
+        size_t draws = 0;
+        // GL draw calls the draws went out in, a multi draw counts once
+        size_t calls = 0;
+        StateChanges unsorted;
+        StateChanges sorted;
+    };
+
+    // depth is how far the nearest instance is from the camera, closer draws go first within the same state
+    void Submit(Pass pass, float depth, const RenderItem& item);
+
+    // Sort what was submitted since the last call, draw it and empty the queue. Leaves no program or vertex
+    // array bound. The DrawRecords and indirect commands go through InstanceRing.
+    void Execute();
+
+    // Of the last Execute
+    const Statistics& LastStatistics() const { return statistics; }
+
+    // From the top bit down: pass 4 bits, program 12, texture 16, vertex array 8, instance matrices 8 and depth
+    // 16, quantized over MAX_DEPTH. Names only keep their low bits.
+    static uint64_t MakeKey(Pass pass, GLuint program, GLuint texture, GLuint vao, GLuint instanceMatrices, float depth);
+
+private:
+    // What every program was last given
+    struct ProgramUniforms
+    {
+        glm::mat4 model;
+        float shininess;
+        float specularIntensity;
+        glm::vec2 impostorFade;
+        CompactBounds bounds;
+        glm::vec3 impostorCenter;
+        float impostorRadius;
+    };
+
+    // What a vertex array's instance attributes point at
+    struct InstanceBinding
+    {
+        RenderItem::InstanceFormat format;
+        GLuint buffer;
+    };
+
+    // Bindings of the draw before. They're forgotten at the start of a frame since anything could have run in
+    // between, instance attributes too since the buffers they point at may have been replaced.
+    struct BoundState
+    {
+        const ShaderProgram* program = nullptr;
+        GLuint vao = 0;
+        GLuint textures[2] = { 0, 0 };
+        GLuint instanceMatrices = 0;
+        GLuint instanceIndices = 0;
+        std::unordered_map<const ShaderProgram*, ProgramUniforms> uniforms;
+        std::unordered_map<GLuint, InstanceBinding> instanceBindings;
+    };
+
+    // Bring state up to what item needs and count what changed. GL is only called when issue is set, the
+    // unsorted order is counted on a copy without drawing.
+    void Apply(const RenderItem& item, BoundState& state, StateChanges& changes, bool issue) const;
+
+    // INSTANCE_INDICES draws point attribute 3 at drawIndices, the others at their instanceBuffer
+    static void PointInstanceAttributes(RenderItem::InstanceFormat format, GLuint buffer);
+
+    // Make drawIndices hold at least count, it's only rebuilt when a frame has more draws than ever before
+    void ReserveDrawIndices(size_t count);
+
+    // b can go in the same multi draw as a, they only differ in what their DrawRecords hold
+    static bool SharesMultiDraw(const RenderItem& a, const RenderItem& b);
+
+    // Write the DrawRecord of every item into InstanceRing in submission order and bind them to DRAW_BINDING
+    void WriteDrawRecords();
+
+    // What glMultiDrawElementsIndirect reads per draw
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Sort keyed by keys, an 8 bit digit at a time from the lowest, skipping digits every key shares
+    void RadixSort();
+
+    std::vector<uint64_t> keys;
+    std::vector<RenderItem> items;
+
+    // 0, 1, 2 and on, attribute 3 of a draw reads the element at its baseInstance
+    GLuint drawIndices = 0;
+    size_t drawIndexCapacity = 0;
+
+    // Key and item index, sortScratch is the other half of each radix pass
+    std::vector<std::pair<uint64_t, uint32_t>> sorted;
+    std::vector<std::pair<uint64_t, uint32_t>> sortScratch;
+
+    BoundState state;
+
+    Statistics statistics;
+};
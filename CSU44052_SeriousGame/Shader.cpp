@@ -1,69 +1,392 @@
 #include "Shader.h"
+#include "AssetPak.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const char PROGRAM_MAGIC[8] = { 'P', 'R', 'O', 'G', 'B', 'I', 'N', '\0' };
+
+    struct ProgramHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t binaryFormat;
+        uint64_t sourceHash;
+        uint64_t driverHash;
+        uint64_t binaryLength;
+    };
+
+    // File name without its directory or extension
+    std::string Stem(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        size_t start = slash == std::string::npos ? 0 : slash + 1;
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos || dot < start)
+        {
+            dot = path.size();
+        }
+        return path.substr(start, dot - start);
+    }
+}
 
 Shader* Shader::pShader = nullptr;
 
 Shader::Shader()
+    : driverHashed(false)
+    , driverHash(0)
+    , binaryCacheSupported(false)
 {
 }
 
 bool Shader::ReadFile(const std::string& filePath, std::string& sourceCode)
 {
-    std::ifstream file(filePath);
-    if (!file)
+    // Through MappedFile so shaders can come out of the asset archive
+    MappedFile file;
+    if (!file.Open(filePath))
     {
         printf("Failed to open file");
         return false;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    sourceCode = buffer.str();
+    sourceCode.assign((const char*)file.Data(), file.Size());
     return true;
 }
 
-int Shader::CreateProgram(const std::string& vertexFilePath, const std::string& fragmentFilePath)
+std::string Shader::ProgramCachePath(const std::string& vertexFilePath, const std::string& fragmentFilePath, const std::vector<std::string>& defines)
 {
-    std::string shader;
+    // Both stages go in the name, the same fragment shader can be linked against more than one vertex shader
+    size_t slash = fragmentFilePath.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : fragmentFilePath.substr(0, slash + 1);
+    std::string name = directory + Stem(vertexFilePath) + "." + Stem(fragmentFilePath);
 
-    if (!ReadFile(vertexFilePath, shader))
+    if (!defines.empty())
     {
-        printf("Failed to read vertex shader file");
-        return 1;
+        std::string joined;
+        for (const auto& define : defines)
+        {
+            joined += define + "\n";
+        }
+
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%08x", (uint32_t)AssetPak::HashBytes((const unsigned char*)joined.data(), joined.size()));
+        name += suffix;
     }
 
-    const char* vertexShaderSource = shader.c_str();
-    unsigned int vertexShader;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-    ShowError(vertexShader, "VERTEX SHADER");
+    return name + ".program";
+}
 
-    if (!ReadFile(fragmentFilePath, shader))
+bool Shader::ExpandIncludes(const std::string& filePath, std::vector<std::string>& files, std::string& source)
+{
+    std::string text;
+    if (!ReadFile(filePath, text))
     {
-        printf("Failed to read fragment shader file");
-        return 1;
+        printf("Failed to read shader %s\n", filePath.c_str());
+        return false;
     }
 
-    const char* fragmentShaderSource = shader.c_str();
-    unsigned int fragmentShader;
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    ShowError(fragmentShader, "FRAGMENT SHADER");
+    size_t sourceNumber = files.size();
+    files.push_back(filePath);
+
+    size_t slash = filePath.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : filePath.substr(0, slash + 1);
+
+    size_t lineStart = 0;
+    int lineNumber = 1;
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        lineEnd = lineEnd == std::string::npos ? text.size() : lineEnd + 1;
+
+        size_t first = text.find_first_not_of(" \t", lineStart);
+        if (first < lineEnd && text.compare(first, 8, "#include") == 0)
+        {
+            size_t open = text.find('"', first);
+            size_t close = open < lineEnd ? text.find('"', open + 1) : std::string::npos;
+            if (close >= lineEnd)
+            {
+                printf("Malformed #include in %s line %d\n", filePath.c_str(), lineNumber);
+                return false;
+            }
+
+            // Files included before are skipped, so a shared file can include what it needs without a guard
+            std::string includePath = directory + text.substr(open + 1, close - open - 1);
+            bool included = false;
+            for (const auto& file : files)
+            {
+                included = included || file == includePath;
+            }
+
+            if (!included)
+            {
+                source += "#line 1 " + std::to_string(files.size()) + "\n";
+                if (!ExpandIncludes(includePath, files, source))
+                {
+                    return false;
+                }
+                source += "\n";
+            }
+            source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceNumber) + "\n";
+        }
+        else
+        {
+            source.append(text, lineStart, lineEnd - lineStart);
+        }
+
+        lineStart = lineEnd;
+        lineNumber++;
+    }
+
+    return true;
+}
+
+bool Shader::Preprocess(const std::string& filePath, const std::vector<std::string>& defines, std::string& source, std::vector<std::string>& files)
+{
+    source.clear();
+    files.clear();
+
+    std::string body;
+    if (!ExpandIncludes(filePath, files, body))
+    {
+        return false;
+    }
+
+    // #version has to stay the first line, the defines go after it and the line count picks up again below them
+    size_t versionEnd = 0;
+    if (body.compare(0, 8, "#version") == 0)
+    {
+        versionEnd = body.find('\n');
+        versionEnd = versionEnd == std::string::npos ? body.size() : versionEnd + 1;
+    }
 
+    source.append(body, 0, versionEnd);
+    if (versionEnd > 0 && source.back() != '\n')
+    {
+        source += '\n';
+    }
+    for (const auto& define : defines)
+    {
+        source += "#define " + define + "\n";
+    }
+    if (!defines.empty())
+    {
+        source += versionEnd > 0 ? "#line 2 0\n" : "#line 1 0\n";
+    }
+    source.append(body, versionEnd, std::string::npos);
+    return true;
+}
+
+int Shader::CreateProgram(const std::string& vertexFilePath, const std::string& fragmentFilePath, const std::vector<std::string>& defines)
+{
+    std::vector<std::string> vertexFiles;
+    std::string vertexSource;
+    if (!Preprocess(vertexFilePath, defines, vertexSource, vertexFiles))
+    {
+        printf("Failed to read vertex shader file %s\n", vertexFilePath.c_str());
+        return 0;
+    }
+
+    std::vector<std::string> fragmentFiles;
+    std::string fragmentSource;
+    if (!Preprocess(fragmentFilePath, defines, fragmentSource, fragmentFiles))
+    {
+        printf("Failed to read fragment shader file %s\n", fragmentFilePath.c_str());
+        return 0;
+    }
+
+    // Hashed after preprocessing, so an edit to an included file or another set of defines misses the cache. The
+    // length of the vertex source goes in too so moving text from one stage to the other changes the hash.
+    std::string key = std::to_string(vertexSource.size()) + "\n" + vertexSource + fragmentSource;
+    uint64_t sourceHash = AssetPak::HashBytes((const unsigned char*)key.data(), key.size());
+
+    std::string cachePath = ProgramCachePath(vertexFilePath, fragmentFilePath, defines);
+    DriverHash();
+
+    if (binaryCacheSupported)
+    {
+        unsigned int cached = LoadProgramBinary(cachePath, sourceHash);
+        if (cached != 0)
+        {
+            return cached;
+        }
+    }
+
+    unsigned int vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource, vertexFiles);
+    unsigned int fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentFiles);
+
+    unsigned int shaderProgram = LinkProgram(vertexShader, fragmentShader, binaryCacheSupported);
+    if (shaderProgram != 0 && binaryCacheSupported)
+    {
+        WriteProgramBinary(shaderProgram, cachePath, sourceHash);
+    }
+
+    return shaderProgram;
+}
+
+unsigned int Shader::CompileShader(GLenum type, const std::string& source, const std::vector<std::string>& files)
+{
+    const char* shaderSource = source.c_str();
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &shaderSource, NULL);
+    glCompileShader(shader);
+
+    // The log gives lines as source(line), list which file each source number is
+    std::string name = type == GL_VERTEX_SHADER ? "VERTEX SHADER" : "FRAGMENT SHADER";
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        name += (i == 0 ? " " : ", ") + std::to_string(i) + ": " + files[i];
+    }
+    ShowError(shader, name);
+
+    return shader;
+}
+
+unsigned int Shader::LinkProgram(unsigned int vertexShader, unsigned int fragmentShader, bool retrievable)
+{
     unsigned int shaderProgram;
     shaderProgram = glCreateProgram();
 
+    // Has to be set before linking for the driver to keep the binary around
+    if (retrievable)
+    {
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
     glLinkProgram(shaderProgram);
 
+    glDetachShader(shaderProgram, vertexShader);
+    glDetachShader(shaderProgram, fragmentShader);
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
+    if (!ShowLinkError(shaderProgram))
+    {
+        glDeleteProgram(shaderProgram);
+        return 0;
+    }
+
     return shaderProgram;
 }
 
+unsigned int Shader::LoadProgramBinary(const std::string& cachePath, uint64_t sourceHash)
+{
+    // Read straight off the disk, program binaries are never packed into the asset archive
+    std::ifstream in(cachePath, std::ios::binary);
+    if (!in)
+    {
+        return 0;
+    }
+
+    ProgramHeader header;
+    if (!in.read((char*)&header, sizeof(header)))
+    {
+        return 0;
+    }
+
+    if (memcmp(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC)) != 0 || header.version != PROGRAM_CACHE_VERSION ||
+        header.sourceHash != sourceHash || header.driverHash != driverHash || header.binaryLength == 0 ||
+        header.binaryLength > 64 * 1024 * 1024)
+    {
+        return 0;
+    }
+
+    std::vector<char> binary((size_t)header.binaryLength);
+    if (!in.read(binary.data(), binary.size()))
+    {
+        return 0;
+    }
+
+    // The driver can still refuse a binary it made, after an update that kept the version string for example.
+    // It says so through the link status, the program is then compiled from source as if nothing was cached.
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+void Shader::WriteProgramBinary(unsigned int program, const std::string& cachePath, uint64_t sourceHash)
+{
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &binaryFormat, binary.data());
+    if (written <= 0)
+    {
+        return;
+    }
+
+    ProgramHeader header;
+    memcpy(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.binaryFormat = binaryFormat;
+    header.sourceHash = sourceHash;
+    header.driverHash = driverHash;
+    header.binaryLength = (uint64_t)written;
+
+    // Write to a temporary file so a crash never leaves a half written cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        return;
+    }
+
+    out.write((const char*)&header, sizeof(header));
+    out.write(binary.data(), written);
+    out.close();
+    if (!out)
+    {
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    std::remove(cachePath.c_str());
+    std::rename(tempPath.c_str(), cachePath.c_str());
+}
+
+uint64_t Shader::DriverHash()
+{
+    if (!driverHashed)
+    {
+        driverHashed = true;
+
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        binaryCacheSupported = formats > 0;
+
+        std::string driver;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const char* value = (const char*)glGetString(name);
+            driver += value != nullptr ? value : "";
+            driver += '\n';
+        }
+        driverHash = AssetPak::HashBytes((const unsigned char*)driver.data(), driver.size());
+    }
+    return driverHash;
+}
+
 Shader* Shader::GetInstance()
 {
     if (pShader == nullptr)
@@ -81,9 +404,24 @@ void Shader::ShowError(unsigned int shaderId, const std::string& shader)
     if (!success)
     {
         glGetShaderInfoLog(shaderId, 512, nullptr, infoLog);
-        printf("Error creating shader program \n");
+        printf("Error creating shader program %s\n", shader.c_str());
+        printf(infoLog);
+    }
+}
+
+bool Shader::ShowLinkError(unsigned int programId)
+{
+    int success;
+    char infoLog[512];
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, 512, nullptr, infoLog);
+        printf("Error linking shader program \n");
         printf(infoLog);
+        return false;
     }
+    return true;
 }
 
 void Shader::Cleanup(unsigned int shaderId)
@@ -2,28 +2,65 @@
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 class Shader
 {
 public:
+	// Bump when the program cache layout changes so old caches get rebuilt
+	static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
 	Shader();
 
 	~Shader();
 
-	int CreateProgram(const std::string& vertexFilePath, const std::string& fragmentFilePath);
+	// Linked program of the two shaders, reloaded from the driver's binary when an earlier run cached one for the
+	// same sources on the same driver. Returns 0 when a file can't be read or the program doesn't link.
+	// Both sources go through Preprocess with the same defines first.
+	int CreateProgram(const std::string& vertexFilePath, const std::string& fragmentFilePath, const std::vector<std::string>& defines = {});
 
 	static Shader* GetInstance();
 
+	// Where the binary of a program is cached, next to the fragment shader. Every set of defines gets its own file.
+	static std::string ProgramCachePath(const std::string& vertexFilePath, const std::string& fragmentFilePath, const std::vector<std::string>& defines);
+
+	// Paste in every #include "file", resolved against the directory of the file including it and only once per
+	// program, and #define each of defines straight after the #version line. #line directives keep the compiler's
+	// line numbers right, files holds the path of every source string number they use.
+	bool Preprocess(const std::string& filePath, const std::vector<std::string>& defines, std::string& source, std::vector<std::string>& files);
+
 private:
 	bool ReadFile(const std::string& filePath, std::string& sourceCode);
 
+	bool ExpandIncludes(const std::string& filePath, std::vector<std::string>& files, std::string& source);
+
+	unsigned int CompileShader(GLenum type, const std::string& source, const std::vector<std::string>& files);
+
+	unsigned int LinkProgram(unsigned int vertexShader, unsigned int fragmentShader, bool retrievable);
+
+	unsigned int LoadProgramBinary(const std::string& cachePath, uint64_t sourceHash);
+
+	void WriteProgramBinary(unsigned int program, const std::string& cachePath, uint64_t sourceHash);
+
+	// Hash of the vendor, renderer and version strings, a binary only loads on the driver that made it
+	uint64_t DriverHash();
+
 	void ShowError(unsigned int shaderId, const std::string& shader);
 
+	bool ShowLinkError(unsigned int programId);
+
 	void Cleanup(unsigned int shaderId);
 
 	static Shader* pShader;
+
+	bool driverHashed;
+	uint64_t driverHash;
+
+	// False when the driver has no binary formats, programs are then compiled every time
+	bool binaryCacheSupported;
 };
@@ -0,0 +1,188 @@
+#include "ShaderProgram.h"
+#include "FrameUniforms.h"
+#include "RenderQueue.h"
+
+#include <cstdio>
+#include <vector>
+
+template <> void Uniform<int>::Set(const int& value) const
+{
+    if (location >= 0)
+    {
+        glProgramUniform1i(program, location, value);
+    }
+}
+
+template <> void Uniform<float>::Set(const float& value) const
+{
+    if (location >= 0)
+    {
+        glProgramUniform1f(program, location, value);
+    }
+}
+
+template <> void Uniform<glm::vec2>::Set(const glm::vec2& value) const
+{
+    if (location >= 0)
+    {
+        glProgramUniform2fv(program, location, 1, &value[0]);
+    }
+}
+
+template <> void Uniform<glm::vec3>::Set(const glm::vec3& value) const
+{
+    if (location >= 0)
+    {
+        glProgramUniform3fv(program, location, 1, &value[0]);
+    }
+}
+
+template <> void Uniform<glm::vec4>::Set(const glm::vec4& value) const
+{
+    if (location >= 0)
+    {
+        glProgramUniform4fv(program, location, 1, &value[0]);
+    }
+}
+
+template <> void Uniform<glm::mat4>::Set(const glm::mat4& value) const
+{
+    if (location >= 0)
+    {
+        glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, &value[0][0]);
+    }
+}
+
+ShaderProgram::ShaderProgram()
+    : id(0)
+{
+}
+
+ShaderProgram::ShaderProgram(GLuint id)
+    : id(id)
+{
+    if (id != 0)
+    {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<char> name(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(id, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+            // Members of a block have no location, they're set through its buffer
+            std::string uniformName(name.data(), length);
+            GLint location = glGetUniformLocation(id, uniformName.c_str());
+            if (location < 0)
+            {
+                continue;
+            }
+
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            {
+                uniformName.resize(uniformName.size() - 3);
+            }
+            uniforms[uniformName] = { location, type };
+        }
+
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+        name.resize(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(id, (GLuint)i, (GLsizei)name.size(), &length, name.data());
+            std::string blockName(name.data(), length);
+            blocks[blockName] = (GLuint)i;
+
+            if (blockName == "FrameUniforms")
+            {
+                // A block that doesn't match the C++ side would read garbage, say so instead
+                GLint dataSize = 0;
+                glGetActiveUniformBlockiv(id, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+                if (dataSize != (GLint)sizeof(FrameUniforms::Data))
+                {
+                    printf("FrameUniforms block is %d bytes, expected %d\n", dataSize, (int)sizeof(FrameUniforms::Data));
+                }
+                glUniformBlockBinding(id, (GLuint)i, FrameUniforms::BINDING);
+            }
+        }
+
+        // Storage blocks have no default binding either, the ones RenderQueue fills get theirs
+        glGetProgramInterfaceiv(id, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &count);
+        glGetProgramInterfaceiv(id, GL_SHADER_STORAGE_BLOCK, GL_MAX_NAME_LENGTH, &maxLength);
+
+        name.resize(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            glGetProgramResourceName(id, GL_SHADER_STORAGE_BLOCK, (GLuint)i, (GLsizei)name.size(), &length, name.data());
+            std::string blockName(name.data(), length);
+            blocks[blockName] = (GLuint)i;
+
+            if (blockName == "InstanceMatrices")
+            {
+                glShaderStorageBlockBinding(id, (GLuint)i, RenderQueue::MATRIX_BINDING);
+            }
+            else if (blockName == "DrawRecords")
+            {
+                glShaderStorageBlockBinding(id, (GLuint)i, RenderQueue::DRAW_BINDING);
+            }
+            else if (blockName == "InstanceIndices")
+            {
+                glShaderStorageBlockBinding(id, (GLuint)i, RenderQueue::INDEX_BINDING);
+            }
+        }
+    }
+
+    model = Get<glm::mat4>("model");
+    diffuseTexture = Get<int>("diffuseTexture");
+    shininess = Get<float>("shininess");
+    specularIntensity = Get<float>("specularIntensity");
+    positionOffset = Get<glm::vec3>("positionOffset");
+    positionScale = Get<glm::vec3>("positionScale");
+    texcoordOffset = Get<glm::vec2>("texcoordOffset");
+    texcoordScale = Get<glm::vec2>("texcoordScale");
+    impostorFade = Get<glm::vec2>("impostorFade");
+    impostorCenter = Get<glm::vec3>("impostorCenter");
+    impostorRadius = Get<float>("impostorRadius");
+}
+
+bool ShaderProgram::HasBlock(const std::string& name) const
+{
+    return blocks.find(name) != blocks.end();
+}
+
+GLint ShaderProgram::Find(const std::string& name, GLenum type) const
+{
+    auto found = uniforms.find(name);
+    if (found == uniforms.end())
+    {
+        return -1;
+    }
+
+    GLenum actual = found->second.type;
+    bool matches = actual == type;
+
+    // Samplers and bools are set with glUniform1i
+    if (type == GL_INT)
+    {
+        matches = matches || actual == GL_BOOL || actual == GL_SAMPLER_2D || actual == GL_SAMPLER_CUBE ||
+            actual == GL_SAMPLER_3D || actual == GL_SAMPLER_2D_ARRAY || actual == GL_SAMPLER_BUFFER;
+    }
+
+    if (!matches)
+    {
+        // The setter would be rejected by GL, better to hear about it once than lose the value every draw
+        printf("Uniform %s has type 0x%x, not 0x%x\n", name.c_str(), actual, type);
+        return -1;
+    }
+    return found->second.location;
+}
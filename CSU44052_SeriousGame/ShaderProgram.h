@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// One uniform of a linked program, found by ShaderProgram::Get. Set goes through glProgramUniform so the program
+// doesn't have to be bound first, and does nothing when the program has no such uniform.
+template <typename T>
+struct Uniform
+{
+    GLuint program = 0;
+    GLint location = -1;
+
+    bool IsValid() const { return location >= 0; }
+
+    void Set(const T& value) const;
+};
+
+template <> void Uniform<int>::Set(const int& value) const;
+template <> void Uniform<float>::Set(const float& value) const;
+template <> void Uniform<glm::vec2>::Set(const glm::vec2& value) const;
+template <> void Uniform<glm::vec3>::Set(const glm::vec3& value) const;
+template <> void Uniform<glm::vec4>::Set(const glm::vec4& value) const;
+template <> void Uniform<glm::mat4>::Set(const glm::mat4& value) const;
+
+// A linked program with its active uniforms and blocks reflected once, so drawing never looks a uniform up by its
+// name. Handles of the uniforms the scene shaders share are looked up here, anything else through Get, once, by
+// whoever owns the program. A FrameUniforms block is pointed at FrameUniforms::BINDING.
+class ShaderProgram
+{
+public:
+    ShaderProgram();
+
+    // Takes the program as returned by Shader::CreateProgram, 0 gives an empty program whose handles do nothing
+    explicit ShaderProgram(GLuint id);
+
+    GLuint Id() const { return id; }
+
+    void Use() const { glUseProgram(id); }
+
+    // Handle of an active uniform, invalid when there's none of that name or it isn't a T. Sampler and bool
+    // uniforms are set as int. Arrays are found by their name without [0].
+    template <typename T>
+    Uniform<T> Get(const std::string& name) const
+    {
+        Uniform<T> uniform;
+        uniform.program = id;
+        uniform.location = Find(name, GlType((const T*)nullptr));
+        return uniform;
+    }
+
+    bool HasBlock(const std::string& name) const;
+
+    // Shared by the scene shaders, invalid in the programs that don't have them
+    Uniform<glm::mat4> model;
+    Uniform<int> diffuseTexture;
+    Uniform<float> shininess;
+    Uniform<float> specularIntensity;
+    Uniform<glm::vec3> positionOffset;
+    Uniform<glm::vec3> positionScale;
+    Uniform<glm::vec2> texcoordOffset;
+    Uniform<glm::vec2> texcoordScale;
+    Uniform<glm::vec2> impostorFade;
+    Uniform<glm::vec3> impostorCenter;
+    Uniform<float> impostorRadius;
+
+private:
+    struct ActiveUniform
+    {
+        GLint location;
+        GLenum type;
+    };
+
+    GLint Find(const std::string& name, GLenum type) const;
+
+    static GLenum GlType(const int*) { return GL_INT; }
+    static GLenum GlType(const float*) { return GL_FLOAT; }
+    static GLenum GlType(const glm::vec2*) { return GL_FLOAT_VEC2; }
+    static GLenum GlType(const glm::vec3*) { return GL_FLOAT_VEC3; }
+    static GLenum GlType(const glm::vec4*) { return GL_FLOAT_VEC4; }
+    static GLenum GlType(const glm::mat4*) { return GL_FLOAT_MAT4; }
+
+    GLuint id;
+    std::unordered_map<std::string, ActiveUniform> uniforms;
+    std::unordered_map<std::string, GLuint> blocks;
+};
@@ -0,0 +1,52 @@
+#include "ShaderVariants.h"
+#include "Shader.h"
+
+#include <cstdio>
+
+namespace
+{
+    // In bit order
+    const char* const VARIANT_NAMES[ShaderVariants::VARIANT_BITS] = { "INSTANCED", "HAS_TEXTURE", "FOG", "UNIFORM_SCALE", "COMPACT_VERTICES", "IMPOSTOR_FADE" };
+}
+
+ShaderVariants::ShaderVariants(const std::string& vertexFilePath, const std::string& fragmentFilePath, uint32_t base)
+    : vertexFilePath(vertexFilePath)
+    , fragmentFilePath(fragmentFilePath)
+    , base(base)
+    , programs(1 << VARIANT_BITS)
+    , built(1 << VARIANT_BITS, false)
+{
+}
+
+const ShaderProgram& ShaderVariants::Program(uint32_t variant)
+{
+    variant = (variant | base) & ((1 << VARIANT_BITS) - 1);
+
+    if (!built[variant])
+    {
+        built[variant] = true;
+        GLuint id = Shader::GetInstance()->CreateProgram(vertexFilePath, fragmentFilePath, Defines(variant));
+
+        // Left as the empty program, draws that pick it draw nothing
+        if (id == 0)
+        {
+            printf("Variant %u of %s and %s failed to build\n", variant, vertexFilePath.c_str(), fragmentFilePath.c_str());
+            return programs[variant];
+        }
+        programs[variant] = ShaderProgram(id);
+    }
+    return programs[variant];
+}
+
+std::vector<std::string> ShaderVariants::Defines(uint32_t variant)
+{
+    std::vector<std::string> defines;
+    for (unsigned int bit = 0; bit < VARIANT_BITS; bit++)
+    {
+        if (variant & (1 << bit))
+        {
+            defines.push_back(VARIANT_NAMES[bit]);
+        }
+    }
+    return defines;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ShaderProgram.h"
+
+// Every build of one vertex and fragment shader pair. Each variant bit turns into a #define, so the shaders pick
+// their code path with #ifdef at compile time instead of branching on uniforms for every vertex and fragment.
+// A combination is compiled the first time a draw asks for it and kept, the binary cache in Shader makes that
+// cheap after the first run.
+//
+// Programs of different variants don't share uniform values, whoever picks a program sets everything it needs
+// apart from what FrameUniforms holds.
+class ShaderVariants
+{
+public:
+    enum Variant : uint32_t
+    {
+        // Attribute 3 indexes the instance's matrix in the InstanceMatrices storage buffer and the draw's DrawRecord,
+        // which holds what the uniforms would, so RenderQueue can put draws of different meshes in one multi draw
+        INSTANCED = 1 << 0,
+        // Sample diffuseTexture, without it the surface is white
+        HAS_TEXTURE = 1 << 1,
+        FOG = 1 << 2,
+        // Model matrices only rotate, translate and scale evenly, so normals skip the inverse transpose
+        UNIFORM_SCALE = 1 << 3,
+        // Vertices in the VertexQuantizer format, decoded with the bounds uniforms or the draw's DrawRecord
+        COMPACT_VERTICES = 1 << 4,
+        // Dither out over the impostorFade distance range
+        IMPOSTOR_FADE = 1 << 5
+    };
+
+    static const unsigned int VARIANT_BITS = 6;
+
+    // base is added to every variant asked for
+    ShaderVariants(const std::string& vertexFilePath, const std::string& fragmentFilePath, uint32_t base = 0);
+
+    // Program of a combination of variants, an empty one when it doesn't build
+    const ShaderProgram& Program(uint32_t variant);
+
+    // The #define names of the bits set in variant
+    static std::vector<std::string> Defines(uint32_t variant);
+
+private:
+    std::string vertexFilePath;
+    std::string fragmentFilePath;
+    uint32_t base;
+
+    // Indexed by variant, built is set once the program was tried so a broken one isn't compiled every draw
+    std::vector<ShaderProgram> programs;
+    std::vector<bool> built;
+};
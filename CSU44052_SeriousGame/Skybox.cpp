@@ -1,14 +1,39 @@
 #include "Skybox.h"
 
+const std::vector<std::string> SKYBOX_FACES =
+{
+	"skybox/right.jpg",
+	"skybox/left.jpg",
+	"skybox/top.jpg",
+	"skybox/bottom.jpg",
+	"skybox/front.jpg",
+	"skybox/back.jpg"
+};
 
 Skybox::Skybox()
 {
 }
 
 Skybox::Skybox(std::vector<std::string> faceLocations)
+{
+	if (LoadFaces(faceLocations))
+	{
+		Upload();
+	}
+}
+
+bool Skybox::LoadFaces(std::vector<std::string> faceLocations)
+{
+	// The faces are decoded together, the cubemap is only created in Upload.
+	// Vertical flipping is left at stb_image's default (off), setting it here would race with other decoding threads.
+	cubemap = TextureManager::GetInstance()->LoadCubemap(faceLocations);
+	return cubemap != nullptr;
+}
+
+void Skybox::Upload()
 {
 	// Set up the shaders for skybox 
-	skyboxProgram = Shader::GetInstance()->CreateProgram("shaders/skybox.vert", "shaders/skybox.frag");
+	skyboxProgram = ShaderProgram(Shader::GetInstance()->CreateProgram("shaders/skybox.vert", "shaders/skybox.frag"));
 
 	// Mesh Setup
 	unsigned int skyboxIndices[] = 
@@ -61,47 +86,15 @@ Skybox::Skybox(std::vector<std::string> faceLocations)
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	// Texture setup
-	glGenTextures(1, &cubemapTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	stbi_set_flip_vertically_on_load(false);
-
-	int width, height, bitDepth;
-
-	// Cycles through all the textures and attaches them to the cubemap object
-	for (unsigned int i = 0; i < 6; i++)
-	{
-		unsigned char* texData = stbi_load(faceLocations[i].c_str(), &width, &height, &bitDepth, 0);
-		if (texData)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-			stbi_image_free(texData);
-		}
-		else
-		{
-			printf("Failed to find: %s\n", faceLocations[i].c_str());
-			stbi_image_free(texData);
-			return;
-		}
-	}
+	TextureManager::GetInstance()->Upload(cubemap);
+	cubemapTexture = cubemap->id;
 }
 
 
-void Skybox::DrawSkybox(glm::mat4 view_matrix, glm::mat4 projection_matrix)
+void Skybox::DrawSkybox()
 {
-	glUseProgram(skyboxProgram);
-
-	// Set view and projection matrices
-	unsigned int viewLoc = glGetUniformLocation(skyboxProgram, "view");
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view_matrix));
-	unsigned int projectionLoc = glGetUniformLocation(skyboxProgram, "projection");
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
+	// The view and projection come from FrameUniforms, the shader drops the translation
+	skyboxProgram.Use();
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
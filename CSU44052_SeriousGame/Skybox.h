@@ -8,10 +8,15 @@
 #include <glm\gtc\type_ptr.hpp>
 
 #include "Shader.h"
+#include "ShaderProgram.h"
 #include "Texture.h"
+#include "TextureManager.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 
+// Cubemap faces of the game's sky in +X -X +Y -Y +Z -Z order, shared with the asset baker
+extern const std::vector<std::string> SKYBOX_FACES;
+
 class Skybox
 {
 public:
@@ -19,7 +24,13 @@ public:
 
 	Skybox(std::vector<std::string> faceLocations);
 
-	void DrawSkybox(glm::mat4 cView, glm::mat4 projection_matrix);
+	// The constructor split in two, LoadFaces only decodes the images so it can run on a worker thread
+	bool LoadFaces(std::vector<std::string> faceLocations);
+
+	void Upload();
+
+	// Drawn around the camera in FrameUniforms
+	void DrawSkybox();
 
 	~Skybox();
 
@@ -29,6 +40,8 @@ private:
 	GLuint cubemapTexture;
 	GLuint uniformProjection, uniformView;
 	GLuint skyboxVAO, skyboxVBO, skyboxIBO;
-	unsigned int skyboxProgram;
+	ShaderProgram skyboxProgram;
+
+	TextureHandle cubemap;
 };
 
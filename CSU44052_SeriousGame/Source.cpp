@@ -14,12 +14,29 @@
 #include <glm/gtc/random.hpp>
 
 #include "Text.h"
+#include "Hud.h"
 #include "Texture.h"
+#include "stb_image.h"
 #include "Mesh.h"
 #include "Skybox.h"
 #include "Source.h"
 #include "Camera.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
+#include "FrameUniforms.h"
+#include "InstanceGroup.h"
+#include "InstanceRing.h"
+#include "RenderQueue.h"
+#include "ObjBenchmark.h"
+#include "AssetLoader.h"
+#include "ImageDecoder.h"
+#include "TextureManager.h"
+#include "CompressedTexture.h"
+#include "TextureConverter.h"
+#include "MeshReport.h"
+#include "VertexQuantizer.h"
+#include "AssetPak.h"
+#include "PakBuilder.h"
 
 // Window Dimensions
 #define WIDTH 1000
@@ -32,6 +49,18 @@
 #define NO_OF_POWERUPS 5
 #define NO_OF_BIRDS 5
 
+// Screen space error in pixels before a model switches to a finer detail level, and how far under it the error has
+// to drop before it switches back to a coarser one
+#define LOD_ERROR_PIXELS 2.0f
+#define LOD_HYSTERESIS 0.25f
+
+// Trees further than this draw as impostors, fading over the range before it
+#define IMPOSTOR_DISTANCE 15.0f
+#define IMPOSTOR_FADE_RANGE 2.0f
+
+// Archive of the source assets, loose files are used when it isn't there
+#define ASSET_PAK "assets.pak"
+
 std::vector<Mesh*> MeshList;
 std::vector<StarProps> starPropsList;
 std::vector<GarbageBagProps> garbageBagPropsList;
@@ -42,20 +71,20 @@ Texture groundTexture;
 Mesh* groundPlane = new Mesh();
 Skybox skybox;
 Text gameText;
+Hud hud;
+AssetLoader assetLoader;
+RenderQueue renderQueue;
 
-// Set number of trees
-Model tree (NO_OF_TREES);
+// Models drawn instanced, the matrices are in the InstanceGroups below and any number of instances fit
+Model tree;
 
-// Set number of garbage bags 
-Model garbageBags(NO_OF_GARBAGEBAGS);
+Model garbageBags;
 
-// Set number of Power ups
-Model powerUps(NO_OF_POWERUPS);
+Model powerUps;
 
-// Set number of Birds 
-Model leftWing(NO_OF_BIRDS);
-Model birdBody(NO_OF_BIRDS);
-Model rightWing(NO_OF_BIRDS);
+Model leftWing;
+Model birdBody;
+Model rightWing;
 
 Camera camera(glm::vec3(0.0f, 0.5f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // position and up vectors
 
@@ -71,10 +100,22 @@ float powerUpTimer = 0.0f;
 
 int score = 0;
 
-unsigned int instancedShaderProgram;
-unsigned int shaderProgram;
-
-std::vector<glm::mat4> tree_matrices, birdBody_matrices, leftWing_matrices, rightWing_matrices;
+// HUD labels, laid out again only when the score or the seconds left change
+size_t scoreLabel;
+size_t timeLabel;
+
+// The objects loaded from obj files and the ground. Each draw picks the variant that fits it, compiled the first time.
+ShaderVariants instancedShaders("shaders/shader_instanced.vert", "shaders/shader_instanced.frag", ShaderVariants::FOG);
+ShaderVariants groundShaders("shaders/shader.vert", "shaders/shader.frag", ShaderVariants::FOG | ShaderVariants::HAS_TEXTURE);
+
+// Trees never move and bags only when one is picked up, so their matrices stay on the GPU. Birds and stars move
+// every frame and stream.
+InstanceGroup treeInstances(InstanceGroup::STATIC);
+InstanceGroup garbageBagInstances(InstanceGroup::STATIC);
+InstanceGroup birdBodyInstances(InstanceGroup::DYNAMIC);
+InstanceGroup leftWingInstances(InstanceGroup::DYNAMIC);
+InstanceGroup rightWingInstances(InstanceGroup::DYNAMIC);
+InstanceGroup powerUpInstances(InstanceGroup::DYNAMIC);
 std::vector<float> starRotationAngles(NO_OF_POWERUPS, 0.0f);
 
 int num_indices;
@@ -101,9 +142,9 @@ void checkBagPickup()
 	// bag radius
 	float radius = 0.2f;
 
-	for (auto i = garbageBagPropsList.begin(); i != garbageBagPropsList.end(); i++)
+	for (size_t i = 0; i < garbageBagPropsList.size(); i++)
 	{
-		glm::vec2 pos(i->translation.x - 1.078, i->translation.z+ 0.048);
+		glm::vec2 pos(garbageBagPropsList[i].translation.x - 1.078, garbageBagPropsList[i].translation.z+ 0.048);
 
 		glm::vec2 camPos(camera.Position.x, camera.Position.z);
 
@@ -112,9 +153,12 @@ void checkBagPickup()
 		// Collision detected
 		if (distance < radius)
 		{
-			// remove bag
-			i = garbageBagPropsList.erase(i);
+			// remove bag, the last one takes its place in both lists
+			garbageBagPropsList[i] = garbageBagPropsList.back();
+			garbageBagPropsList.pop_back();
+			garbageBagInstances.Remove(i);
 			score++;
+			hud.SetValue(scoreLabel, score);
 			
 			if (score >= NO_OF_GARBAGEBAGS)
 			{
@@ -132,17 +176,19 @@ void checkPowerUpPickup()
 	// collison radius
 	float radius = 0.1f;
 
-	for (auto i = starPropsList.begin(); i != starPropsList.end(); i++)
+	for (size_t i = 0; i < starPropsList.size(); i++)
 	{
-		glm::vec2 pos(i->translation.x, i->translation.z);
+		glm::vec2 pos(starPropsList[i].translation.x, starPropsList[i].translation.z);
 		glm::vec2 camPos(camera.Position.x, camera.Position.z);
 		float distance = glm::distance(camPos, pos);
 
 		// Collision detected
 		if (distance < radius)
 		{
-			// remove power up
-			i = starPropsList.erase(i);
+			// remove power up, the last one takes its place in both lists
+			starPropsList[i] = starPropsList.back();
+			starPropsList.pop_back();
+			powerUpInstances.Remove(i);
 			powerUpTimer = 10.0f;
 
 			if (camera.MoveSpeed == 2.5f)
@@ -212,15 +258,25 @@ void generatePlane()
 // render skybox into the scene
 void RenderSkyBox()
 {
-	glm::mat4 view_matrix = glm::mat4(glm::mat3(camera.calculateViewMatrix())); // remove translation from the view matrix
-	skybox.DrawSkybox(view_matrix, projection_matrix);
+	skybox.DrawSkybox();
+}
+
+// Queue a model, the obj and its textures are read on a worker thread and uploaded from the main loop
+void LoadModelAsync(Model& model, const std::string& objPath, const std::string& materialPath)
+{
+	Model* pModel = &model;
+	assetLoader.Load(objPath,
+		[pModel, objPath, materialPath]() { return pModel->LoadModelData(objPath, materialPath); },
+		[pModel]() { pModel->UploadModelData(); });
 }
 
 // initilise the models by loading them from the obj files
 void Init() 
 {
 	// ------------------------------------     TREES     ------------------------------------------------------------
-	tree.LoadModelInstanced("models/tree/Tree.obj", "models/tree");
+	tree.EnableImpostor(IMPOSTOR_DISTANCE, IMPOSTOR_FADE_RANGE);
+	tree.SetMaterial(woodShininessValue, woodSpecularIntensity);
+	LoadModelAsync(tree, "models/tree/Tree.obj", "models/tree");
 	
 	for (int i = 0; i < NO_OF_TREES; i++) {
 		glm::vec3 translation = glm::vec3(glm::linearRand(-20.0f, 20.0f), 0.0f, glm::linearRand(-20.0f, 20.0f));
@@ -234,24 +290,27 @@ void Init()
 
 		// Construct the transformation matrix from the translation vector
 		glm::mat4 transformation_matrix = glm::translate(glm::mat4(1.0f), translation);
-		tree_matrices.push_back(transformation_matrix);
+		treeInstances.Add(transformation_matrix);
 	}
 
 	// ------------------------------------     BIRDS     ------------------------------------------------------------
-	birdBody.LoadModelInstanced("models/bird/body.obj", "models/bird");
-	leftWing.LoadModelInstanced("models/bird/wingleft.obj", "models/bird");
-	rightWing.LoadModelInstanced("models/bird/wingright.obj", "models/bird");
+	LoadModelAsync(birdBody, "models/bird/body.obj", "models/bird");
+	LoadModelAsync(leftWing, "models/bird/wingleft.obj", "models/bird");
+	LoadModelAsync(rightWing, "models/bird/wingright.obj", "models/bird");
+	birdBody.SetMaterial(woodShininessValue, woodSpecularIntensity);
+	leftWing.SetMaterial(woodShininessValue, woodSpecularIntensity);
+	rightWing.SetMaterial(woodShininessValue, woodSpecularIntensity);
 
 	for (size_t i = 0; i < NO_OF_BIRDS; i++)
 	{
 		glm::mat4 transformation_matrix = glm::mat4(1.0);
-		birdBody_matrices.push_back(transformation_matrix);
+		birdBodyInstances.Add(transformation_matrix);
 
 		transformation_matrix = glm::mat4(1.0f);
-		leftWing_matrices.push_back(transformation_matrix);
+		leftWingInstances.Add(transformation_matrix);
 
 		transformation_matrix = glm::mat4(1.0f);
-		rightWing_matrices.push_back(transformation_matrix);
+		rightWingInstances.Add(transformation_matrix);
 
 		BirdProps birdProps;
 
@@ -268,7 +327,8 @@ void Init()
 	}
 
 	// ------------------------------------     GARBAGE BAGS     ------------------------------------------------------------
-	garbageBags.LoadModelInstanced("models/bag/Garbage_Bag.obj", "models/bag");
+	LoadModelAsync(garbageBags, "models/bag/Garbage_Bag.obj", "models/bag");
+	garbageBags.SetMaterial(plasticShininessValue, plasticSpecularIntensity);
 	
 	for (int i = 0; i < NO_OF_GARBAGEBAGS; i++) {
 		glm::vec3 translation = glm::vec3(glm::linearRand(-20.0f, 20.0f), 0.0f, glm::linearRand(-20.0f, 20.0f));
@@ -281,13 +341,14 @@ void Init()
 
 		GarbageBagProps garbageBagProps;
 		garbageBagProps.translation = glm::vec3(translation);
-		garbageBagProps.matrix = transformation_matrix;
+		garbageBagInstances.Add(transformation_matrix);
 
 		garbageBagPropsList.push_back(garbageBagProps);
 	}
 
 	// ------------------------------------     POWERUPS     ------------------------------------------------------------
-	powerUps.LoadModelInstanced("models/star/Star_round.obj", "models/star");
+	LoadModelAsync(powerUps, "models/star/Star_round.obj", "models/star");
+	powerUps.SetMaterial(plasticShininessValue, plasticSpecularIntensity);
 
 	for (size_t i = 0; i < NO_OF_POWERUPS; i++)
 	{
@@ -303,23 +364,13 @@ void Init()
 
 		StarProps starProps;
 		starProps.translation = translation;
-		starProps.matrix = transformation_matrix;
+		powerUpInstances.Add(transformation_matrix);
 
 		starPropsList.push_back(starProps);
 	}
 
 }
 
-// creating the shader programs
-void InitShaders()
-{
-	// for the objects loaded from obj files
-	instancedShaderProgram = Shader::GetInstance()->CreateProgram("shaders/shader_instanced.vert", "shaders/shader_instanced.frag");
-
-	// for the ground
-	shaderProgram = Shader::GetInstance()->CreateProgram("shaders/shader.vert", "shaders/shader.frag");
-}
-
 // variables for the bird wings flapping
 float wingAngle = 0.0f;              
 float maxWingRoatation = 90.0f;      
@@ -330,23 +381,11 @@ float angleIncrement = 0.0f;
 // renders the initilised models into the scene
 void RenderModels (glm::mat4& view) 
 {
-	glUseProgram(instancedShaderProgram);
-
-	// Set to use texture
-	unsigned int hasTexture_location = glGetUniformLocation(instancedShaderProgram, "hasTexture");
-	glUniform1i(hasTexture_location, 1);
-
-	int shininessLocation = glGetUniformLocation(instancedShaderProgram, "shininess");
-	int specularIntensityLocation = glGetUniformLocation(instancedShaderProgram, "specularIntensity");
-
 	glm::mat4 model_matrix = glm::mat4(1.0f);
 
 	// ------------------------------------     TREES     ------------------------------------------------------------
 
-	glUniform1f(shininessLocation, woodShininessValue);
-	glUniform1f(specularIntensityLocation, woodSpecularIntensity);
-
-	tree.DrawInstanced(instancedShaderProgram, model_matrix, view, projection_matrix, tree_matrices);
+	tree.SubmitInstanced(renderQueue, instancedShaders, model_matrix, view, projection_matrix, treeInstances);
 
 	// ------------------------------------     Birds     ------------------------------------------------------------
 	// logic for the wings to flap
@@ -394,64 +433,45 @@ void RenderModels (glm::mat4& view)
 		// Left wing transformation
 		transformation_matrix = glm::rotate(transformation_matrix, glm::radians(wingAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 		transformation_matrix = glm::translate(transformation_matrix, glm::vec3(0.5f, 0.0f, 0.0f));
-		leftWing_matrices[i] = model_matrix * transformation_matrix;
+		leftWingInstances.Set(i, model_matrix * transformation_matrix);
 
 		transformation_matrix = glm::mat4(1.0f);
 
 		// Right wing transformation
 		transformation_matrix = glm::rotate(transformation_matrix, glm::radians(-wingAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 		transformation_matrix = glm::translate(transformation_matrix, glm::vec3(-1.0f, 0.0f, 0.0f));
-		rightWing_matrices[i] = model_matrix * transformation_matrix;
+		rightWingInstances.Set(i, model_matrix * transformation_matrix);
 
-		birdBody_matrices[i] = model_matrix;
+		birdBodyInstances.Set(i, model_matrix);
 	}
 
 	model_matrix = glm::mat4(1.0f);
 
-	birdBody.DrawInstanced(instancedShaderProgram, model_matrix, view, projection_matrix, birdBody_matrices);
-	leftWing.DrawInstanced(instancedShaderProgram, model_matrix, view, projection_matrix, leftWing_matrices);
-	rightWing.DrawInstanced(instancedShaderProgram, model_matrix, view, projection_matrix, rightWing_matrices);
-
-	glUseProgram(instancedShaderProgram);
-	glUniform1i(shininessLocation, 0);
-	glUniform1i(specularIntensityLocation, 0);
+	birdBody.SubmitInstanced(renderQueue, instancedShaders, model_matrix, view, projection_matrix, birdBodyInstances);
+	leftWing.SubmitInstanced(renderQueue, instancedShaders, model_matrix, view, projection_matrix, leftWingInstances);
+	rightWing.SubmitInstanced(renderQueue, instancedShaders, model_matrix, view, projection_matrix, rightWingInstances);
 
 	// ------------------------------------     GARBAGE BAGS     ------------------------------------------------------------
 	model_matrix = glm::mat4(1.0f);
 
-	glUseProgram(instancedShaderProgram);
-	glUniform1i(shininessLocation, plasticShininessValue);
-	glUniform1i(specularIntensityLocation, plasticSpecularIntensity);
-
-	std::vector<glm::mat4> matrices;
-
-	// Used while removing bags
-	for (size_t i = 0; i < garbageBagPropsList.size(); i++)
-	{
-		matrices.push_back(garbageBagPropsList.at(i).matrix);
-	}
-
-	garbageBags.DrawInstanced(instancedShaderProgram, model_matrix, view, projection_matrix, matrices);
-
-	matrices.clear();
+	// Picking a bag up removes it from garbageBagInstances, nothing to do here
+	garbageBags.SubmitInstanced(renderQueue, instancedShaders, model_matrix, view, projection_matrix, garbageBagInstances);
 
 	// ------------------------------------     POWERUPS     ------------------------------------------------------------
 	model_matrix = glm::mat4(1.0f);
 
-	for (size_t i = 0; i < starPropsList.size(); i++)
+	for (size_t i = 0; i < powerUpInstances.Size(); i++)
 	{
-		// used while removing power ups 
-		matrices.push_back(starPropsList.at(i).matrix);
-
 		starRotationAngles[i] = 1.0f;
-		glm::mat4 transformation_matrix = starPropsList[i].matrix;
+		glm::mat4 transformation_matrix = powerUpInstances[i];
 		transformation_matrix = glm::rotate(transformation_matrix, glm::radians(starRotationAngles[i]), glm::vec3(1.0f, 0.0f, 0.0f));
-		starPropsList[i].matrix = transformation_matrix;
+		powerUpInstances.Set(i, transformation_matrix);
 	}
 
-	powerUps.DrawInstanced(instancedShaderProgram, model_matrix, view, projection_matrix, matrices);
+	powerUps.SubmitInstanced(renderQueue, instancedShaders, model_matrix, view, projection_matrix, powerUpInstances);
 
-	glUseProgram(0);
+	// Everything above in one go, sorted so draws sharing a program, texture or mesh follow each other
+	renderQueue.Execute();
 }
 
 // Calculates mouse inputs to rotate the camera 
@@ -474,31 +494,75 @@ void MouseCallback(GLFWwindow* window, double xposIn, double yposIn) {
 	camera.mouseControl(xoffset, yoffset);
 }
 
-// Use shader for the ground (shaderProgram)
-void useShaderProgram(glm::mat4 view)
+// Use shader for the ground (groundShaders), the view and projection are in FrameUniforms already
+const ShaderProgram& useShaderProgram()
 {
-	glUseProgram(shaderProgram);
+	uint32_t variant = MeshList[0]->IsCompact() ? (uint32_t)ShaderVariants::COMPACT_VERTICES : 0u;
+	const ShaderProgram& shaderProgram = groundShaders.Program(variant);
+	shaderProgram.Use();
 	glm::mat4 model_matrix = glm::mat4(1.0f);
 	model_matrix = glm::scale(model_matrix, glm::vec3(100.0f));
 
-	// Set the model, view, and projection matrices in the shader
-	GLint modelLoc = glGetUniformLocation(shaderProgram, "modelMatrix");
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_matrix));
+	// Set the model matrix and the material in the shader
+	shaderProgram.model.Set(model_matrix);
+	shaderProgram.shininess.Set(grassShininessValue);
+	shaderProgram.specularIntensity.Set(grassSpecularIntensity);
+	return shaderProgram;
+}
+
+int main(int argc, char** argv)
+{
+	// Compare the obj readers on every model instead of running the game
+	if (argc > 1 && std::string(argv[1]) == "--bench-obj")
+	{
+		return RunObjBenchmark("models", 5);
+	}
+
+	// Build the compressed textures ahead of time and check their quality without a GPU
+	if (argc > 1 && std::string(argv[1]) == "--convert-textures")
+	{
+		return RunTextureConverter({ "models", "textures" }, SKYBOX_FACES);
+	}
 
-	GLint viewLoc1 = glGetUniformLocation(shaderProgram, "viewMatrix");
-	glUniformMatrix4fv(viewLoc1, 1, GL_FALSE, glm::value_ptr(view));
+	// Print how well the mesh optimizer does on the post-transform cache for every model
+	if (argc > 1 && std::string(argv[1]) == "--mesh-stats")
+	{
+		return RunMeshReport("models");
+	}
 
-	GLint projLoc = glGetUniformLocation(shaderProgram, "projectionMatrix");
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
+	// Pack the source assets into one archive the game reads from instead of the loose files
+	if (argc > 1 && std::string(argv[1]) == "--build-pak")
+	{
+		return RunPakBuilder({ "models", "skybox", "textures", "fonts", "shaders" }, ASSET_PAK);
+	}
 
-	int shininessLocation = glGetUniformLocation(shaderProgram, "shininess");
-	int specularIntensityLocation = glGetUniformLocation(shaderProgram, "specularIntensity");
-	glUniform1f(shininessLocation, grassShininessValue);
-	glUniform1f(specularIntensityLocation, grassSpecularIntensity);
-}
+	// Load from the archive when there is one
+	if (AssetPak::GetInstance()->Mount(ASSET_PAK))
+	{
+		printf("Loading assets from %s\n", ASSET_PAK);
+	}
+
+	// Switches for the game itself, any of them in any order
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+
+		// Keep the 32 byte float vertices instead of the quantized format, to compare the two
+		if (option == "--full-vertices")
+		{
+			VertexQuantizer::SetEnabled(false);
+		}
+		// Rasterize the font at a fixed size instead of using distance field glyphs, to compare the two
+		else if (option == "--bitmap-text")
+		{
+			gameText.UseDistanceField(false);
+		}
+		else
+		{
+			printf("Unknown option %s\n", option.c_str());
+		}
+	}
 
-int main()
-{
 	// opengl set up
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -524,24 +588,27 @@ int main()
 		return 1;
 	}
 
-	// Initilising text rendering
+	CompressedTexture::DetectSupport();
+
+	double loadStartTime = glfwGetTime();
+
+	// Initilising text rendering, the font is queued first so the loading screen can show text early
 	glm::mat4 orthoProjection = glm::ortho(0.0f, (float)(WIDTH), 0.0f, (float)(HEIGHT));
 	gameText.intShader(orthoProjection);
-	gameText.InitTextRendering();
 
-	// Initilising a skybox 
-	std::vector<std::string> skyboxFaces;
-	skyboxFaces.push_back("skybox/right.jpg");
-	skyboxFaces.push_back("skybox/left.jpg");
-	skyboxFaces.push_back("skybox/top.jpg");
-	skyboxFaces.push_back("skybox/bottom.jpg");
-	skyboxFaces.push_back("skybox/front.jpg");
-	skyboxFaces.push_back("skybox/back.jpg");
+	scoreLabel = hud.AddLabel("Score: %d/10", 25.0f, HEIGHT - 25.0f, 0.5f, glm::vec3(1.0f));
+	timeLabel = hud.AddLabel("Time: %d", 25.0f, HEIGHT - 50.0f, 0.5f, glm::vec3(1.0f));
 
-	skybox = Skybox(skyboxFaces);
+	bool fontReady = false;
+	assetLoader.Load("fonts/arial.ttf",
+		[]() { return gameText.LoadGlyphs(); },
+		[&fontReady]() { gameText.UploadGlyphs(); fontReady = true; });
+
+	// Initilising a skybox 
+	assetLoader.Load("skybox",
+		[]() { return skybox.LoadFaces(SKYBOX_FACES); },
+		[]() { skybox.Upload(); });
 
-	InitShaders();
-	
 	Init();
 	
 	// Initilise ground 
@@ -549,12 +616,63 @@ int main()
 
 	// load texture
 	groundTexture = Texture((char*)"textures/grass.jpg");
-	groundTexture.LoadTexture();
+	assetLoader.Load("textures/grass.jpg",
+		[]() { return groundTexture.DecodeTexture(); },
+		[]() { groundTexture.UploadTexture(); });
+
+	// Loading screen, runs the GL uploads as the workers finish decoding
+	while (!assetLoader.IsDone())
+	{
+		// Closing the window quits without loading the rest
+		if (glfwWindowShouldClose(window))
+		{
+			assetLoader.Cancel();
+			glfwTerminate();
+			return 0;
+		}
+
+		assetLoader.ProcessCompleted();
+
+		glViewport(0, 0, WIDTH, HEIGHT);
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		if (fontReady)
+		{
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+			std::string progressStr = "Loading... " + std::to_string(assetLoader.CompletedCount()) + "/" + std::to_string(assetLoader.TotalCount());
+			gameText.RenderText(progressStr, 25.0f, HEIGHT / 2.0f, 0.75f, glm::vec3(1.0f));
+			gameText.Flush();
+		}
+
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+	}
+
+	if (!assetLoader.Failures().empty())
+	{
+		printf("Failed to load %d assets", (int)assetLoader.Failures().size());
+		glfwTerminate();
+		return 1;
+	}
+
+	printf("All assets loaded in %.1f ms\n", (glfwGetTime() - loadStartTime) * 1000.0);
+	ImageDecoder::GetInstance()->ReportTimings();
+	TextureManager::GetInstance()->ReportMemory();
 
 	lastFrame = (float)(glfwGetTime());
 
+	Model::SetLodSettings(LOD_ERROR_PIXELS, LOD_HYSTERESIS);
+	Model::SetViewportHeight(HEIGHT);
+	double statisticsTime = glfwGetTime();
+
 	while (!glfwWindowShouldClose(window))
 	{
+		Model::ResetFrameStatistics();
+		InstanceRing::GetInstance()->BeginFrame();
+
 		if (!isGameFrozen)
 		{
 			float currentFrame = (float)(glfwGetTime());
@@ -596,13 +714,16 @@ int main()
 
 			projection_matrix = glm::perspective(glm::radians(45.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
 
+			// Every program reads the camera from here for the rest of the frame
+			FrameUniforms::GetInstance()->Update(view, projection_matrix);
+
 			// Use grass texture
 			groundTexture.UseTexture();
 
-			useShaderProgram(view);
+			const ShaderProgram& groundProgram = useShaderProgram();
 
 			// Render the plane
-			MeshList[0]->RenderMesh();
+			MeshList[0]->RenderMesh(groundProgram);
 
 			// Render Skybox 
 			glDepthFunc(GL_LEQUAL);
@@ -612,10 +733,27 @@ int main()
 			if(!isGameFrozen)
 			RenderModels(view);
 
-			// Render score and time left onto screen
-			std::string scoreStr = "Score: " + std::to_string(score) + "/10";
-			gameText.RenderText(scoreStr, 25.0f, HEIGHT - 25.0f, 0.5f, glm::vec3(1.0f));
-			gameText.RenderText("Time: " + std::to_string((int)GAMEPLAY_TIME - (int)timeElapsed), 25.0f, HEIGHT - 50.0f, 0.5f, glm::vec3(1.0f));
+			// Render score and time left onto screen, the time label only changes once a second
+			hud.SetValue(timeLabel, (int)GAMEPLAY_TIME - (int)timeElapsed);
+			hud.Submit(gameText);
+
+			// Both lines go out in one draw
+			gameText.Flush();
+		}
+
+		// Show the triangles, draws and state changes of the last frame in the title once a second, with the instance
+		// bytes streamed and uploaded and how often the CPU caught up with the GPU
+		if (glfwGetTime() - statisticsTime >= 1.0)
+		{
+			statisticsTime = glfwGetTime();
+			InstanceRing* instanceRing = InstanceRing::GetInstance();
+			const RenderQueue::Statistics& queueStatistics = renderQueue.LastStatistics();
+			std::string title = "CSU44052 Serious Game - " + std::to_string(Model::FrameTriangles()) + " triangles, " +
+				std::to_string(queueStatistics.draws) + " draws in " + std::to_string(queueStatistics.calls) + " calls, " + std::to_string(queueStatistics.unsorted.Total()) + " state changes unsorted, " +
+				std::to_string(queueStatistics.sorted.Total()) + " sorted, " +
+				std::to_string(instanceRing->FrameBytes()) + " bytes streamed, " + std::to_string(Model::FrameUploadBytes()) + " bytes uploaded, " +
+				std::to_string(instanceRing->FenceWaits()) + " fence waits";
+			glfwSetWindowTitle(window, title.c_str());
 		}
 
 		glfwSwapBuffers(window);
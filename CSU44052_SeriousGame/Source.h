@@ -1,15 +1,14 @@
 #pragma once
 
+// The matrices are in the models' InstanceGroups, at the same index as the props
 struct GarbageBagProps 
 {
 	glm::vec3 translation;
-	glm::mat4 matrix;
 };
 
 struct StarProps 
 {
 	glm::vec3 translation;
-	glm::mat4 matrix;
 };
 
 struct BirdProps 
@@ -18,4 +17,4 @@ struct BirdProps
 	glm::vec3 birdVelocity;
 };
 
-int main();
\ No newline at end of file
+int main(int argc, char** argv);
\ No newline at end of file
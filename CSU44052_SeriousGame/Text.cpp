@@ -1,10 +1,117 @@
 #include "Text.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include FT_MODULE_H
 
 // Code has been refrenced from the LearnOpenGL online tutorials 
 
+namespace
+{
+    const char SDF_MAGIC[8] = { 'G', 'L', 'Y', 'P', 'H', 'S', 'D', 'F' };
+
+    struct SdfHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t pixelSize;
+        uint64_t sourceHash;
+        uint32_t spread;
+        uint32_t glyphCount;
+    };
+
+    // Placement of one cached glyph, its pixels follow it
+    struct SdfGlyph
+    {
+        uint32_t codepoint;
+        int32_t width;
+        int32_t height;
+        int32_t bearingX;
+        int32_t bearingY;
+        uint32_t advance;
+    };
+
+    const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+    // Marks a free cell of the atlas
+    const uint32_t NO_GLYPH = 0xFFFFFFFF;
+}
+
+const char* const Text::FONT_PATH = "fonts/arial.ttf";
+const char* const Text::SDF_CACHE_PATH = "fonts/arial.sdf";
+
+Text::Text()
+{
+    distanceField = true;
+    glyphPixelSize = BASE_PIXEL_SIZE;
+    library = nullptr;
+    face = nullptr;
+    fontHash = 0;
+    workerLibrary = nullptr;
+    workerFace = nullptr;
+    storedGlyphsChanged = false;
+    cellSize = 0;
+    cellsPerRow = 0;
+    frame = 1;
+    atlasGeneration = 1;
+    atlasTexture = 0;
+    vboCapacity = 0;
+    textVAO = 0;
+    textVBO = 0;
+    textShader = 0;
+}
+
+Text::~Text()
+{
+    // The thread pool may still be rendering with the worker face or writing the cache
+    for (auto& pending : pendingGlyphs)
+    {
+        pending.second.rendered.wait();
+    }
+    if (cacheWrite.valid())
+    {
+        cacheWrite.wait();
+    }
+
+    // Whatever turned up since the last write is saved on the way out
+    CollectGlyphs();
+    if (storedGlyphsChanged && fontHash != 0)
+    {
+        WriteDistanceFieldCache(SDF_CACHE_PATH, fontHash, storedGlyphs);
+    }
+
+    if (workerFace)
+    {
+        FT_Done_Face(workerFace);
+    }
+    if (workerLibrary)
+    {
+        FT_Done_FreeType(workerLibrary);
+    }
+    if (face)
+    {
+        FT_Done_Face(face);
+    }
+    if (library)
+    {
+        FT_Done_FreeType(library);
+    }
+}
+
+void Text::UseDistanceField(bool enabled)
+{
+    distanceField = enabled;
+}
+
 void Text::intShader(glm::mat4 projection)
 {
-    textShader = Shader::GetInstance()->CreateProgram("shaders/text.vert", "shaders/text.frag");
+    textShader = Shader::GetInstance()->CreateProgram("shaders/text.vert", distanceField ? "shaders/text_sdf.frag" : "shaders/text.frag");
 
     glUseProgram(textShader);
     glUniformMatrix4fv(glGetUniformLocation(textShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
@@ -14,94 +121,560 @@ void Text::intShader(glm::mat4 projection)
 
 void Text::InitTextRendering()
 {
-    FT_Library ft;
-    if (FT_Init_FreeType(&ft))
+    if (LoadGlyphs())
+    {
+        UploadGlyphs();
+    }
+}
+
+bool Text::LoadGlyphs()
+{
+    glyphPixelSize = distanceField ? SDF_PIXEL_SIZE : BASE_PIXEL_SIZE;
+
+    if (!fontFile.Open(FONT_PATH))
+    {
+        printf("Error loading font");
+        return false;
+    }
+
+    // The thread pool renders the distance fields that aren't cached with a face of its own
+    if (!OpenFace(library, face) || (distanceField && !OpenFace(workerLibrary, workerFace)))
+    {
+        return false;
+    }
+
+    // Cells fit the tallest glyph in the font, plus the distance field spread and a texel of padding so
+    // linear filtering doesn't pick up the neighbouring cell
+    int fontHeight = (int)((FT_MulFix(face->bbox.yMax - face->bbox.yMin, face->size->metrics.y_scale) + 63) >> 6);
+    cellSize = fontHeight + (distanceField ? 2 * SDF_SPREAD : 0) + 2;
+    cellsPerRow = ATLAS_SIZE / cellSize;
+
+    // Distance fields take a while to compute, so the ones used before are kept next to the font
+    fontHash = MeshCache::HashFile(FONT_PATH);
+    if (distanceField && fontHash != 0)
+    {
+        ReadDistanceFieldCache(SDF_CACHE_PATH, fontHash);
+    }
+    return true;
+}
+
+bool Text::OpenFace(FT_Library& faceLibrary, FT_Face& openedFace) const
+{
+    if (FT_Init_FreeType(&faceLibrary))
     {
         printf("FREETYPE initialization failed");
-        return;
+        faceLibrary = nullptr;
+        return false;
     }
 
-    std::string fontPath = "fonts/arial.ttf";
-    FT_Face face;
-    if (FT_New_Face(ft, fontPath.c_str(), 0, &face))
+    if (FT_New_Memory_Face(faceLibrary, fontFile.Data(), (FT_Long)fontFile.Size(), 0, &openedFace))
     {
         printf("Error loading font");
-        FT_Done_FreeType(ft);
-        return;
+        openedFace = nullptr;
+        return false;
     }
 
-    // Set font size (48pt)
-    FT_Set_Pixel_Sizes(face, 0, 48);
+    FT_Set_Pixel_Sizes(openedFace, 0, glyphPixelSize);
 
-    LoadCharacters(face);
+    FT_Int spread = SDF_SPREAD;
+    FT_Property_Set(faceLibrary, "sdf", "spread", &spread);
+    return true;
+}
 
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+void Text::UploadGlyphs()
+{
+    // Starts empty, glyphs are copied in by RenderText as they're needed
+    std::vector<unsigned char> empty((size_t)ATLAS_SIZE * ATLAS_SIZE, 0);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, empty.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    cellGlyphs.assign((size_t)cellsPerRow * cellsPerRow, NO_GLYPH);
+    cellLastUsed.assign(cellGlyphs.size(), 0);
+    cellPixels.resize((size_t)cellSize * cellSize);
 
     ConfigureTextRendering();
 }
 
-// Load characters into the map for text rendering
-void Text::LoadCharacters(FT_Face face)
+bool Text::BakeDistanceFields(uint32_t first, uint32_t last)
+{
+    if (!distanceField || !LoadGlyphs())
+    {
+        return false;
+    }
+
+    // Glyphs already in the cache are skipped by RenderGlyph
+    for (uint32_t codepoint = first; codepoint <= last; codepoint++)
+    {
+        GlyphBitmap glyph;
+        if (!RenderGlyph(codepoint, glyph))
+        {
+            return false;
+        }
+    }
+
+    if (storedGlyphsChanged)
+    {
+        storedGlyphsChanged = false;
+        return fontHash != 0 && WriteDistanceFieldCache(SDF_CACHE_PATH, fontHash, storedGlyphs);
+    }
+    return true;
+}
+
+uint32_t Text::DecodeUtf8(const char* text, size_t length, size_t& index)
+{
+    unsigned char lead = (unsigned char)text[index];
+    index++;
+
+    if (lead < 0x80)
+    {
+        return lead;
+    }
+
+    int count;
+    uint32_t codepoint;
+    uint32_t minimum;
+    if ((lead & 0xE0) == 0xC0)
+    {
+        count = 1;
+        codepoint = lead & 0x1F;
+        minimum = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        count = 2;
+        codepoint = lead & 0x0F;
+        minimum = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        count = 3;
+        codepoint = lead & 0x07;
+        minimum = 0x10000;
+    }
+    else
+    {
+        return REPLACEMENT_CHARACTER;
+    }
+
+    if (index + count > length)
+    {
+        return REPLACEMENT_CHARACTER;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        unsigned char next = (unsigned char)text[index + i];
+        if ((next & 0xC0) != 0x80)
+        {
+            return REPLACEMENT_CHARACTER;
+        }
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+
+    // Overlong forms, surrogates and anything past the last plane aren't valid UTF-8
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+    {
+        return REPLACEMENT_CHARACTER;
+    }
+
+    index += count;
+    return codepoint;
+}
+
+const Text::Glyph* Text::AcquireGlyph(uint32_t codepoint)
 {
+    if (!face || atlasTexture == 0)
+    {
+        return nullptr;
+    }
+
+    auto found = glyphs.find(codepoint);
+    if (found != glyphs.end())
+    {
+        Glyph& glyph = found->second;
+        bool empty = glyph.character.Size.x == 0 || glyph.character.Size.y == 0;
+        if (empty || glyph.cell >= 0)
+        {
+            return &glyph;
+        }
+    }
+
+    // Distance fields take FreeType a while, the ones that aren't cached are left to the thread pool
+    if (distanceField && codepoint >= ' ' && storedGlyphs.find(codepoint) == storedGlyphs.end())
+    {
+        Glyph& glyph = glyphs[codepoint];
+        QueueGlyph(codepoint, glyph);
+        return &glyph;
+    }
+
+    // A glyph FreeType can't render is kept as an empty one so it isn't tried again every frame
+    GlyphBitmap bitmap;
+    if (!RenderGlyph(codepoint, bitmap))
+    {
+        bitmap.character = { glm::vec2(0.0f), glm::vec2(0.0f), glm::ivec2(0), glm::ivec2(0), 0 };
+    }
+
+    Glyph& glyph = glyphs[codepoint];
+    glyph.character = bitmap.character;
+    glyph.cell = -1;
+
+    // Spaces take up no room in the atlas
+    Character& character = glyph.character;
+    if (character.Size.x == 0 || character.Size.y == 0)
+    {
+        return &glyph;
+    }
+
+    int cell = AllocateCell();
+    glyph.cell = cell;
+    cellGlyphs[cell] = codepoint;
+
+    // A glyph too big for a cell is cut off rather than spilling into the next one
+    const int padding = 1;
+    int sourceWidth = character.Size.x;
+    character.Size = glm::min(character.Size, glm::ivec2(cellSize - 2 * padding));
+
+    // Copy the whole cell so the last glyph's pixels don't show through the padding
+    std::fill(cellPixels.begin(), cellPixels.end(), 0);
+    for (int row = 0; row < character.Size.y; row++)
+    {
+        std::copy(bitmap.pixels.begin() + row * sourceWidth, bitmap.pixels.begin() + row * sourceWidth + character.Size.x,
+            cellPixels.begin() + (size_t)(row + padding) * cellSize + padding);
+    }
+
+    int cellX = (cell % cellsPerRow) * cellSize;
+    int cellY = (cell / cellsPerRow) * cellSize;
+
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, cellX, cellY, cellSize, cellSize, GL_RED, GL_UNSIGNED_BYTE, cellPixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    // Load first 128 characters of the ASCII set
-    for (unsigned char c = 0; c < 128; c++)
+    character.UvMin = glm::vec2((float)(cellX + padding) / ATLAS_SIZE, (float)(cellY + padding) / ATLAS_SIZE);
+    character.UvMax = glm::vec2((float)(cellX + padding + character.Size.x) / ATLAS_SIZE, (float)(cellY + padding + character.Size.y) / ATLAS_SIZE);
+    return &glyph;
+}
+
+bool Text::RenderGlyph(uint32_t codepoint, GlyphBitmap& glyph)
+{
+    // Control characters never get drawn, leave them empty rather than rendering the missing glyph box
+    if (codepoint < ' ')
     {
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+        glyph.character = { glm::vec2(0.0f), glm::vec2(0.0f), glm::ivec2(0), glm::ivec2(0), 0 };
+        return true;
+    }
+
+    if (distanceField)
+    {
+        auto stored = storedGlyphs.find(codepoint);
+        if (stored != storedGlyphs.end())
+        {
+            glyph = stored->second;
+            return true;
+        }
+    }
+
+    if (!RasterizeGlyph(face, distanceField, codepoint, glyph))
+    {
+        return false;
+    }
+
+    if (distanceField)
+    {
+        storedGlyphs[codepoint] = glyph;
+        storedGlyphsChanged = true;
+    }
+    return true;
+}
+
+bool Text::RasterizeGlyph(FT_Face face, bool distanceField, uint32_t codepoint, GlyphBitmap& glyph)
+{
+    // The SDF renderer works from the outline, so load it without rasterizing
+    if (FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT) || FT_Render_Glyph(face->glyph, distanceField ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL))
+    {
+        printf("Error loading Glyph U+%04X\n", codepoint);
+        return false;
+    }
+
+    const FT_Bitmap& bitmap = face->glyph->bitmap;
+    glyph.character.Size = glm::ivec2(bitmap.width, bitmap.rows);
+    glyph.character.Bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+    glyph.character.Advance = (unsigned int)(face->glyph->advance.x);
+
+    // Copy row by row, the FreeType pitch can be wider than the bitmap
+    glyph.pixels.clear();
+    for (unsigned int row = 0; row < bitmap.rows; row++)
+    {
+        const unsigned char* source = bitmap.buffer + row * bitmap.pitch;
+        glyph.pixels.insert(glyph.pixels.end(), source, source + bitmap.width);
+    }
+    return true;
+}
+
+void Text::QueueGlyph(uint32_t codepoint, Glyph& glyph)
+{
+    // Laid out with its advance meanwhile so the text doesn't move once it turns up. Loading the outline alone is
+    // quick next to the distance field.
+    glyph.character = { glm::vec2(0.0f), glm::vec2(0.0f), glm::ivec2(0), glm::ivec2(0), 0 };
+    glyph.cell = -1;
+    if (!FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT))
+    {
+        glyph.character.Advance = (unsigned int)(face->glyph->advance.x);
+    }
+
+    PendingGlyph& pending = pendingGlyphs[codepoint];
+    std::shared_ptr<GlyphBitmap> bitmap = std::make_shared<GlyphBitmap>();
+    pending.bitmap = bitmap;
+    pending.rendered = ThreadPool::GetInstance()->Submit([this, codepoint, bitmap]()
+    {
+        std::lock_guard<std::mutex> lock(workerMutex);
+        return RasterizeGlyph(workerFace, true, codepoint, *bitmap);
+    });
+}
+
+void Text::CollectGlyphs()
+{
+    for (auto pending = pendingGlyphs.begin(); pending != pendingGlyphs.end();)
+    {
+        if (pending->second.rendered.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++pending;
+            continue;
+        }
+
+        uint32_t codepoint = pending->first;
+        if (pending->second.rendered.get())
+        {
+            storedGlyphs[codepoint] = std::move(*pending->second.bitmap);
+            storedGlyphsChanged = true;
+
+            // Looked up from storedGlyphs the next time it's drawn, and layouts with the gap get made again
+            glyphs.erase(codepoint);
+            atlasGeneration++;
+        }
+        else
+        {
+            // Kept as an empty one so it isn't tried again every frame
+            glyphs[codepoint].character.Advance = 0;
+        }
+        pending = pendingGlyphs.erase(pending);
+    }
+}
+
+void Text::QueueCacheWrite()
+{
+    // One write at a time, glyphs that turn up meanwhile go in the next
+    if (cacheWrite.valid())
+    {
+        if (cacheWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
         {
-            printf("Error loading Glyph");
             return;
         }
+        if (!cacheWrite.get())
+        {
+            printf("Failed to write glyph cache: %s\n", SDF_CACHE_PATH);
+        }
+    }
 
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, face->glyph->bitmap.width, face->glyph->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE, face->glyph->bitmap.buffer);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        Character character = {
-            texture,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            (unsigned int)(face->glyph->advance.x)
-        };
-        Characters.insert(std::pair<char, Character>(c, character));
+    // Written from a copy, storedGlyphs keeps growing while it's going
+    storedGlyphsChanged = false;
+    cacheWrite = ThreadPool::GetInstance()->Submit([cached = storedGlyphs, sourceHash = fontHash]()
+    {
+        return WriteDistanceFieldCache(SDF_CACHE_PATH, sourceHash, cached);
+    });
+}
+
+int Text::AllocateCell()
+{
+    int oldest = 0;
+    for (size_t cell = 0; cell < cellGlyphs.size(); cell++)
+    {
+        if (cellGlyphs[cell] == NO_GLYPH)
+        {
+            return (int)cell;
+        }
+
+        if (cellLastUsed[cell] < cellLastUsed[oldest])
+        {
+            oldest = (int)cell;
+        }
     }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Every cell is drawn by something already queued, so draw that before overwriting one of them
+    if (cellLastUsed[oldest] == frame)
+    {
+        DrawQueued();
+    }
+
+    glyphs[cellGlyphs[oldest]].cell = -1;
+    cellGlyphs[oldest] = NO_GLYPH;
+    atlasGeneration++;
+    return oldest;
+}
+
+bool Text::ReadDistanceFieldCache(const std::string& cachePath, uint64_t sourceHash)
+{
+    MappedFile file;
+    if (!file.Open(cachePath) || file.Size() < sizeof(SdfHeader))
+    {
+        return false;
+    }
+
+    SdfHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+
+    // Rebuilt when the font, the generator or its settings change
+    if (memcmp(header.magic, SDF_MAGIC, sizeof(SDF_MAGIC)) != 0 || header.version != SDF_VERSION || header.sourceHash != sourceHash ||
+        header.pixelSize != SDF_PIXEL_SIZE || header.spread != SDF_SPREAD)
+    {
+        return false;
+    }
+
+    std::unordered_map<uint32_t, GlyphBitmap> loaded;
+    size_t offset = sizeof(SdfHeader);
+
+    for (uint32_t i = 0; i < header.glyphCount; i++)
+    {
+        SdfGlyph entry;
+        if (offset + sizeof(entry) > file.Size())
+        {
+            return false;
+        }
+        memcpy(&entry, file.Data() + offset, sizeof(entry));
+        offset += sizeof(entry);
+
+        size_t pixelCount = (size_t)entry.width * entry.height;
+        if (entry.width < 0 || entry.height < 0 || offset + pixelCount > file.Size())
+        {
+            return false;
+        }
+
+        GlyphBitmap& glyph = loaded[entry.codepoint];
+        glyph.character = { glm::vec2(0.0f), glm::vec2(0.0f), glm::ivec2(entry.width, entry.height), glm::ivec2(entry.bearingX, entry.bearingY), entry.advance };
+        glyph.pixels.assign(file.Data() + offset, file.Data() + offset + pixelCount);
+        offset += pixelCount;
+    }
+
+    if (offset != file.Size())
+    {
+        return false;
+    }
+
+    storedGlyphs = std::move(loaded);
+    return true;
+}
+
+bool Text::WriteDistanceFieldCache(const std::string& cachePath, uint64_t sourceHash, const std::unordered_map<uint32_t, GlyphBitmap>& bitmaps)
+{
+    SdfHeader header;
+    memcpy(header.magic, SDF_MAGIC, sizeof(SDF_MAGIC));
+    header.version = SDF_VERSION;
+    header.pixelSize = SDF_PIXEL_SIZE;
+    header.sourceHash = sourceHash;
+    header.spread = SDF_SPREAD;
+    header.glyphCount = (uint32_t)bitmaps.size();
+
+    // Write to a temporary file so a crash never leaves a half written cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    out.write((const char*)&header, sizeof(header));
+
+    for (const auto& stored : bitmaps)
+    {
+        const Character& character = stored.second.character;
+        SdfGlyph entry = { stored.first, character.Size.x, character.Size.y, character.Bearing.x, character.Bearing.y, character.Advance };
+        out.write((const char*)&entry, sizeof(entry));
+        out.write((const char*)stored.second.pixels.data(), stored.second.pixels.size());
+    }
+    out.close();
+
+    if (!out)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(cachePath.c_str());
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
 }
 
 // Configure VAO/VBO for rendering texture quads
 void Text::ConfigureTextRendering()
 {
+    vboCapacity = 0;
+
     glGenVertexArrays(1, &textVAO);
     glGenBuffers(1, &textVBO);
     glBindVertexArray(textVAO);
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, nullptr, GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)offsetof(TextVertex, colour));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
 
-// Render text on the screen
+// Queue a string to be rendered on the screen
 void Text::RenderText(std::string text, float x, float y, float scale, glm::vec3 color)
 {
-    glUseProgram(textShader);
-    glUniform3f(glGetUniformLocation(textShader, "textColor"), color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(textVAO);
+    LayoutQuads(text.c_str(), text.size(), x, y, scale, color, vertices, nullptr);
+}
+
+void Text::Layout(const char* text, float x, float y, float scale, const glm::vec3& color, TextLayout& layout)
+{
+    layout.vertices.clear();
+    layout.cells.clear();
+    LayoutQuads(text, strlen(text), x, y, scale, color, layout.vertices, &layout.cells);
+
+    // Nothing could be laid out before UploadGlyphs, so leave it to be tried again
+    layout.atlasGeneration = atlasTexture != 0 ? atlasGeneration : 0;
+}
+
+void Text::Submit(const TextLayout& layout)
+{
+    // Counts as drawing the glyphs for the LRU, as RenderText looking them up would
+    for (int cell : layout.cells)
+    {
+        cellLastUsed[cell] = frame;
+    }
+    vertices.insert(vertices.end(), layout.vertices.begin(), layout.vertices.end());
+}
+
+void Text::LayoutQuads(const char* text, size_t length, float x, float y, float scale, const glm::vec3& color, std::vector<TextVertex>& quads, std::vector<int>* cells)
+{
+    unsigned char colour[4] = {
+        (unsigned char)(glm::clamp(color.x, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(color.y, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(color.z, 0.0f, 1.0f) * 255.0f + 0.5f),
+        255
+    };
+
+    // Distance field glyphs are stored smaller than the size callers scale from
+    scale *= (float)BASE_PIXEL_SIZE / glyphPixelSize;
 
     // Iterate through all characters
-    for (auto c = text.begin(); c != text.end(); c++)
+    for (size_t i = 0; i < length;)
     {
-        Character ch = Characters[*c];
+        const Glyph* glyph = AcquireGlyph(DecodeUtf8(text, length, i));
+        if (!glyph)
+        {
+            continue;
+        }
+
+        const Character& ch = glyph->character;
 
         float xpos = x + ch.Bearing.x * scale;
         float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
@@ -109,28 +682,88 @@ void Text::RenderText(std::string text, float x, float y, float scale, glm::vec3
         float w = ch.Size.x * scale;
         float h = ch.Size.y * scale;
 
-        // Update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
+        x += (ch.Advance >> 6) * scale;
+
+        // Spaces have nothing to draw
+        if (ch.Size.x == 0 || ch.Size.y == 0)
+        {
+            continue;
+        }
+
+        cellLastUsed[glyph->cell] = frame;
+        if (cells)
+        {
+            cells->push_back(glyph->cell);
+        }
+
+        // x, y, u and v of the quad's two triangles
+        const float corners[6][4] = {
+            { xpos,     ypos + h,   ch.UvMin.x, ch.UvMin.y },
+            { xpos,     ypos,       ch.UvMin.x, ch.UvMax.y },
+            { xpos + w, ypos,       ch.UvMax.x, ch.UvMax.y },
 
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
+            { xpos,     ypos + h,   ch.UvMin.x, ch.UvMin.y },
+            { xpos + w, ypos,       ch.UvMax.x, ch.UvMax.y },
+            { xpos + w, ypos + h,   ch.UvMax.x, ch.UvMin.y }
         };
 
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
+        for (const auto& corner : corners)
+        {
+            TextVertex vertex;
+            vertex.x = corner[0];
+            vertex.y = corner[1];
+            vertex.u = corner[2];
+            vertex.v = corner[3];
+            memcpy(vertex.colour, colour, sizeof(colour));
+            quads.push_back(vertex);
+        }
+    }
+}
 
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+// Render every queued string on the screen
+void Text::Flush()
+{
+    DrawQueued();
+    frame++;
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    CollectGlyphs();
 
-        x += (ch.Advance >> 6) * scale;
+    // New distance fields are saved as they turn up, which is only ever a handful of times
+    if (storedGlyphsChanged && fontHash != 0)
+    {
+        QueueCacheWrite();
     }
+}
 
+void Text::DrawQueued()
+{
+    if (vertices.empty())
+    {
+        return;
+    }
+
+    glUseProgram(textShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glBindVertexArray(textVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
+
+    // Orphan the buffer every frame so the driver never waits for the last frame's text, and grow it by
+    // doubling so it settles after a few frames
+    size_t size = vertices.size() * sizeof(TextVertex);
+    if (size > vboCapacity)
+    {
+        vboCapacity = std::max(size, vboCapacity * 2);
+    }
+    glBufferData(GL_ARRAY_BUFFER, vboCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    vertices.clear();
 }
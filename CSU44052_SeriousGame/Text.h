@@ -2,40 +2,208 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "MappedFile.h"
 #include "Model.h"
 #include "Shader.h"
 #include "glm/gtc/type_ptr.hpp"
 
-/// Holds all state information relevant to a character as loaded using FreeType
-struct Character 
+/// Where a character sits in the glyph atlas and how to place it, as loaded using FreeType
+struct Character
 {
-	unsigned int TextureID;
-	glm::ivec2   Size; 
-	glm::ivec2   Bearing; 
-	unsigned int Advance; 
+	glm::vec2    UvMin;
+	glm::vec2    UvMax;
+	glm::ivec2   Size;
+	glm::ivec2   Bearing;
+	unsigned int Advance;
 };
 
 class Text
 {
 public:
+	// Font every string is drawn with, and where its distance field glyphs are cached
+	static const char* const FONT_PATH;
+	static const char* const SDF_CACHE_PATH;
+
+	// Size the bitmap glyphs are rasterized at, the scale passed to RenderText is relative to it
+	static const int BASE_PIXEL_SIZE = 48;
+
+	// Distance field glyphs can be smaller since their edge stays sharp at any scale. The spread is how many
+	// pixels out from the outline the distance is stored.
+	static const int SDF_PIXEL_SIZE = 28;
+	static const int SDF_SPREAD = 3;
+
+	// Bump when the distance field generation changes so old caches get rebuilt
+	static const uint32_t SDF_VERSION = 2;
+
+	// Glyphs are rendered the first time they're drawn into cells of a fixed size atlas, the least recently
+	// drawn glyph gives up its cell once the atlas is full
+	static const int ATLAS_SIZE = 512;
+
+	// One vertex of a glyph quad, the colour goes per vertex so strings of any colour share the draw
+	struct TextVertex
+	{
+		float x, y;
+		float u, v;
+		unsigned char colour[4];
+	};
+
+	// Quads of a string laid out once and queued again every frame by Submit. They point into the atlas, so
+	// they have to be laid out again once IsCurrent says a glyph was evicted since.
+	struct TextLayout
+	{
+		std::vector<TextVertex> vertices;
+		std::vector<int> cells;
+		uint64_t atlasGeneration = 0;
+	};
+
+	Text();
+
+	~Text();
+
+	// On by default, --bitmap-text turns it off to compare. Call before intShader.
+	void UseDistanceField(bool enabled);
+
 	void intShader(glm::mat4 projection);
 
 	void InitTextRendering();
 
+	// InitTextRendering split in two, LoadGlyphs opens the font and reads the glyph cache without touching GL
+	// so it can run on a worker thread
+	bool LoadGlyphs();
+
+	void UploadGlyphs();
+
+	// Render the distance fields of every codepoint from first to last into the glyph cache ahead of time, so the
+	// game finds them there instead of running FreeType's SDF pass. Doesn't touch GL.
+	bool BakeDistanceFields(uint32_t first, uint32_t last);
+
+	// Queue the quads of a UTF-8 string, nothing is drawn until Flush. Glyphs not in the atlas yet are uploaded
+	// here. Distance fields that aren't cached are rendered on the thread pool instead, they leave a gap of their
+	// advance until a later Flush picks them up.
 	void RenderText(std::string text, float x, float y, float scale, glm::vec3 color);
 
+	// Lay a UTF-8 string out into layout instead of the queue, reusing its memory
+	void Layout(const char* text, float x, float y, float scale, const glm::vec3& color, TextLayout& layout);
+
+	// Queue a laid out string, keeping its glyphs from being evicted
+	void Submit(const TextLayout& layout);
+
+	bool IsCurrent(const TextLayout& layout) const { return layout.atlasGeneration == atlasGeneration; }
+
+	// Draw every string queued since the last Flush in one call, then take in the glyphs the thread pool finished
+	// and start saving them to the cache there too
+	void Flush();
+
+	// Next codepoint of a UTF-8 string starting at index, which is moved past it. Malformed bytes come back
+	// as U+FFFD one at a time.
+	static uint32_t DecodeUtf8(const char* text, size_t length, size_t& index);
+
 private:
-	void LoadCharacters(FT_Face face);
+	Text(const Text&) = delete;
+	Text& operator=(const Text&) = delete;
+
+	// Rendered glyph waiting to be copied into a cell
+	struct GlyphBitmap
+	{
+		Character character;
+		std::vector<unsigned char> pixels;
+	};
+
+	// A glyph that has been looked up, cell is -1 while it isn't in the atlas
+	struct Glyph
+	{
+		Character character;
+		int cell;
+	};
+
+	// Distance field being rendered on the thread pool into bitmap
+	struct PendingGlyph
+	{
+		std::shared_ptr<GlyphBitmap> bitmap;
+		std::future<bool> rendered;
+	};
+
+	// Find the glyph for a codepoint, rendering it into a cell if it isn't resident
+	const Glyph* AcquireGlyph(uint32_t codepoint);
+
+	// Append the quads of a string to vertices, and the cells they use to cells when it isn't null
+	void LayoutQuads(const char* text, size_t length, float x, float y, float scale, const glm::vec3& color, std::vector<TextVertex>& quads, std::vector<int>* cells);
+
+	bool RenderGlyph(uint32_t codepoint, GlyphBitmap& glyph);
+
+	// Just the FreeType half of RenderGlyph. A face is only used by one thread at a time.
+	static bool RasterizeGlyph(FT_Face face, bool distanceField, uint32_t codepoint, GlyphBitmap& glyph);
+
+	// Start rendering a distance field glyph on the thread pool, it's empty with the right advance until then
+	void QueueGlyph(uint32_t codepoint, Glyph& glyph);
+
+	// Move the glyphs the thread pool finished into storedGlyphs, they get a cell the next time they're drawn
+	void CollectGlyphs();
+
+	// Write storedGlyphs on the thread pool, unless the last write is still going
+	void QueueCacheWrite();
+
+	bool OpenFace(FT_Library& faceLibrary, FT_Face& openedFace) const;
+
+	// A free cell, or the least recently used one. Draws what's queued first if every cell is in use by it.
+	int AllocateCell();
+
+	// Draw the queued quads without starting a new frame of the LRU
+	void DrawQueued();
+
+	bool ReadDistanceFieldCache(const std::string& cachePath, uint64_t sourceHash);
+
+	static bool WriteDistanceFieldCache(const std::string& cachePath, uint64_t sourceHash, const std::unordered_map<uint32_t, GlyphBitmap>& bitmaps);
 
 	void ConfigureTextRendering();
 
-	std::map<GLchar, Character> Characters;
-	unsigned int textVAO, textVBO;
+	bool distanceField;
+	int glyphPixelSize;
 
-	unsigned int textShader;
+	// The face stays open for glyphs that show up later, FreeType reads the font straight out of the mapping
+	MappedFile fontFile;
+	FT_Library library;
+	FT_Face face;
+	uint64_t fontHash;
 
+	// Second face the thread pool renders distance fields with, a face can't be shared between threads
+	FT_Library workerLibrary;
+	FT_Face workerFace;
+	std::mutex workerMutex;
+	std::unordered_map<uint32_t, PendingGlyph> pendingGlyphs;
 
+	// Cache write running on the thread pool
+	std::future<bool> cacheWrite;
 
-	
-};
+	std::unordered_map<uint32_t, Glyph> glyphs;
+
+	// Distance fields rendered so far, written next to the font so the next run doesn't redo them
+	std::unordered_map<uint32_t, GlyphBitmap> storedGlyphs;
+	bool storedGlyphsChanged;
+
+	// Codepoint held by every cell of the atlas, or NO_GLYPH when it's free
+	std::vector<uint32_t> cellGlyphs;
+	std::vector<uint64_t> cellLastUsed;
+	int cellSize;
+	int cellsPerRow;
+	std::vector<unsigned char> cellPixels;
+
+	// Counts Flush calls, a glyph drawn since the last one can't be evicted without drawing first
+	uint64_t frame;
+
+	// Counts evictions, layouts made before the last one may point at a cell that now holds another glyph
+	uint64_t atlasGeneration;
+
+	unsigned int atlasTexture;
 
+	std::vector<TextVertex> vertices;
+	size_t vboCapacity;
+
+	unsigned int textVAO, textVBO;
+
+	unsigned int textShader;
+};
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <glad/glad.h>
-#include "stb_image.h"
+#include "TextureManager.h"
 
 class Texture
 {
@@ -12,6 +12,11 @@ public:
 
 	void LoadTexture();
 
+	// LoadTexture split in two, DecodeTexture doesn't touch GL so it can run on a worker thread
+	bool DecodeTexture();
+
+	void UploadTexture();
+
 	void UseTexture();
 
 	void ClearTexture();
@@ -19,8 +24,8 @@ public:
 	~Texture();
 
 private:
-	GLuint textureID;
-	int width, height, bitDepth;
+	// Shared with every other user of the same image, so copies of a Texture are safe
+	TextureHandle texture;
 
 	char const* fileLocation;
 };
@@ -0,0 +1,490 @@
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Copy a 4x4 block of RGBA pixels, clamping reads past the right and bottom edges
+    void FetchBlock(const uint8_t* rgba, int width, int height, int blockX, int blockY, uint8_t block[64])
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sourceY = std::min(blockY * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sourceX = std::min(blockX * 4 + x, width - 1);
+                const uint8_t* pixel = rgba + ((size_t)sourceY * width + sourceX) * 4;
+                std::copy(pixel, pixel + 4, block + (y * 4 + x) * 4);
+            }
+        }
+    }
+
+    void StoreBlock(const uint8_t block[64], int width, int height, int blockX, int blockY, uint8_t* rgba)
+    {
+        for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+        {
+            for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+            {
+                uint8_t* pixel = rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4;
+                std::copy(block + (y * 4 + x) * 4, block + (y * 4 + x) * 4 + 4, pixel);
+            }
+        }
+    }
+
+    uint16_t Pack565(const float color[3])
+    {
+        int r = std::min(std::max((int)(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+        int g = std::min(std::max((int)(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+        int b = std::min(std::max((int)(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void Unpack565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // RGBA palette of a colour block. Three colour mode has a transparent black fourth entry.
+    void ColorPalette(uint16_t c0, uint16_t c1, bool fourColor, int palette[4][4])
+    {
+        Unpack565(c0, palette[0]);
+        Unpack565(c1, palette[1]);
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (fourColor)
+            {
+                palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+                palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+            }
+            else
+            {
+                palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+                palette[3][i] = 0;
+            }
+        }
+
+        palette[0][3] = 255;
+        palette[1][3] = 255;
+        palette[2][3] = 255;
+        palette[3][3] = fourColor ? 255 : 0;
+    }
+
+    uint32_t ColorIndices(const uint8_t block[64], const int palette[4][4])
+    {
+        uint32_t indices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = block[i * 4] - palette[p][0];
+                int dg = block[i * 4 + 1] - palette[p][1];
+                int db = block[i * 4 + 2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+        return indices;
+    }
+
+    // Endpoints from the extent of the block along its principal axis, then one least squares refinement
+    void CompressColorBlock(const uint8_t block[64], uint8_t* out)
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                mean[c] += block[i * 4 + c] / 16.0f;
+            }
+        }
+
+        float covariance[3][3] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+            for (int a = 0; a < 3; a++)
+            {
+                for (int b = 0; b < 3; b++)
+                {
+                    covariance[a][b] += d[a] * d[b];
+                }
+            }
+        }
+
+        float axis[3] = { 0.9f, 1.0f, 0.7f };
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[3];
+            for (int a = 0; a < 3; a++)
+            {
+                next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+            }
+
+            float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if (length < 1e-6f)
+            {
+                break;
+            }
+            for (int a = 0; a < 3; a++)
+            {
+                axis[a] = next[a] / length;
+            }
+        }
+
+        float minT = 1e30f;
+        float maxT = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        // Pull the endpoints in slightly, the extremes are usually outliers
+        float inset = (maxT - minT) / 16.0f;
+        float end0[3], end1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            end0[c] = mean[c] + axis[c] * (maxT - inset);
+            end1[c] = mean[c] + axis[c] * (minT + inset);
+        }
+
+        uint16_t c0 = Pack565(end0);
+        uint16_t c1 = Pack565(end1);
+
+        if (c0 != c1)
+        {
+            int palette[4][4];
+            ColorPalette(std::max(c0, c1), std::min(c0, c1), true, palette);
+            uint32_t indices = ColorIndices(block, palette);
+
+            // Weight of the first endpoint for each palette entry
+            const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            float ax[3] = { 0.0f, 0.0f, 0.0f };
+            float bx[3] = { 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 16; i++)
+            {
+                float a = weights[(indices >> (i * 2)) & 3];
+                float b = 1.0f - a;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int c = 0; c < 3; c++)
+                {
+                    ax[c] += a * block[i * 4 + c];
+                    bx[c] += b * block[i * 4 + c];
+                }
+            }
+
+            float determinant = aa * bb - ab * ab;
+            if (std::fabs(determinant) > 1e-6f)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                    end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+                }
+                c0 = Pack565(end0);
+                c1 = Pack565(end1);
+            }
+        }
+
+        // c0 > c1 selects four colour mode, equal endpoints only ever use index 0
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            int palette[4][4];
+            ColorPalette(c0, c1, true, palette);
+            indices = ColorIndices(block, palette);
+        }
+
+        out[0] = (uint8_t)(c0 & 0xFF);
+        out[1] = (uint8_t)(c0 >> 8);
+        out[2] = (uint8_t)(c1 & 0xFF);
+        out[3] = (uint8_t)(c1 >> 8);
+        for (int i = 0; i < 4; i++)
+        {
+            out[4 + i] = (uint8_t)(indices >> (i * 8));
+        }
+    }
+
+    void DecompressColorBlock(const uint8_t* in, bool alwaysFourColor, uint8_t block[64])
+    {
+        uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+        uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+        uint32_t indices = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24);
+
+        int palette[4][4];
+        ColorPalette(c0, c1, alwaysFourColor || c0 > c1, palette);
+
+        for (int i = 0; i < 16; i++)
+        {
+            const int* color = palette[(indices >> (i * 2)) & 3];
+            for (int c = 0; c < 4; c++)
+            {
+                block[i * 4 + c] = (uint8_t)color[c];
+            }
+        }
+    }
+
+    // Eight entry palette when a0 > a1, otherwise six entries plus 0 and 255
+    void AlphaPalette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+
+        if (a0 > a1)
+        {
+            for (int i = 1; i < 7; i++)
+            {
+                palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+            }
+        }
+        else
+        {
+            for (int i = 1; i < 5; i++)
+            {
+                palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    void CompressAlphaBlock(const uint8_t block[64], uint8_t* out)
+    {
+        int minAlpha = 255;
+        int maxAlpha = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            minAlpha = std::min(minAlpha, (int)block[i * 4 + 3]);
+            maxAlpha = std::max(maxAlpha, (int)block[i * 4 + 3]);
+        }
+
+        out[0] = (uint8_t)maxAlpha;
+        out[1] = (uint8_t)minAlpha;
+
+        uint64_t indices = 0;
+        if (maxAlpha != minAlpha)
+        {
+            int palette[8];
+            AlphaPalette(maxAlpha, minAlpha, palette);
+
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0;
+                int bestDistance = 1 << 30;
+                for (int p = 0; p < 8; p++)
+                {
+                    int distance = std::abs(block[i * 4 + 3] - palette[p]);
+                    if (distance < bestDistance)
+                    {
+                        best = p;
+                        bestDistance = distance;
+                    }
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+
+        for (int i = 0; i < 6; i++)
+        {
+            out[2 + i] = (uint8_t)(indices >> (i * 8));
+        }
+    }
+
+    void DecompressAlphaBlock(const uint8_t* in, uint8_t block[64])
+    {
+        int palette[8];
+        AlphaPalette(in[0], in[1], palette);
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            indices |= (uint64_t)in[2 + i] << (i * 8);
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            block[i * 4 + 3] = (uint8_t)palette[(indices >> (i * 3)) & 7];
+        }
+    }
+}
+
+unsigned int TextureCompressor::BlockSize(Format format)
+{
+    return format == BC1 ? 8 : 16;
+}
+
+size_t TextureCompressor::CompressedSize(Format format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockSize(format);
+}
+
+TextureCompressor::Format TextureCompressor::ChooseFormat(const uint8_t* rgba, int width, int height)
+{
+    size_t pixelCount = (size_t)width * height;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        if (rgba[i * 4 + 3] != 255)
+        {
+            return BC3;
+        }
+    }
+    return BC1;
+}
+
+std::vector<uint8_t> TextureCompressor::Compress(Format format, const uint8_t* rgba, int width, int height)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    unsigned int blockSize = BlockSize(format);
+
+    std::vector<uint8_t> blocks(CompressedSize(format, width, height));
+
+    ThreadPool::GetInstance()->ParallelFor(blocksY, [&](size_t blockY)
+    {
+        uint8_t block[64];
+        for (int blockX = 0; blockX < blocksX; blockX++)
+        {
+            FetchBlock(rgba, width, height, blockX, (int)blockY, block);
+            uint8_t* out = blocks.data() + (blockY * blocksX + blockX) * blockSize;
+
+            if (format == BC3)
+            {
+                CompressAlphaBlock(block, out);
+                CompressColorBlock(block, out + 8);
+            }
+            else
+            {
+                CompressColorBlock(block, out);
+            }
+        }
+    });
+
+    return blocks;
+}
+
+std::vector<uint8_t> TextureCompressor::Decompress(Format format, const uint8_t* blocks, int width, int height)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    unsigned int blockSize = BlockSize(format);
+
+    std::vector<uint8_t> rgba((size_t)width * height * 4);
+
+    for (int blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (int blockX = 0; blockX < blocksX; blockX++)
+        {
+            const uint8_t* in = blocks + ((size_t)blockY * blocksX + blockX) * blockSize;
+            uint8_t block[64];
+
+            if (format == BC3)
+            {
+                // BC3 colour blocks are always decoded in four colour mode
+                DecompressColorBlock(in + 8, true, block);
+                DecompressAlphaBlock(in, block);
+            }
+            else
+            {
+                DecompressColorBlock(in, false, block);
+            }
+
+            StoreBlock(block, width, height, blockX, blockY, rgba.data());
+        }
+    }
+
+    return rgba;
+}
+
+std::vector<uint8_t> TextureCompressor::Downsample(const uint8_t* rgba, int width, int height, int& mipWidth, int& mipHeight)
+{
+    mipWidth = std::max(1, width / 2);
+    mipHeight = std::max(1, height / 2);
+
+    std::vector<uint8_t> mip((size_t)mipWidth * mipHeight * 4);
+
+    for (int y = 0; y < mipHeight; y++)
+    {
+        int y0 = std::min(y * 2, height - 1);
+        int y1 = std::min(y * 2 + 1, height - 1);
+
+        for (int x = 0; x < mipWidth; x++)
+        {
+            int x0 = std::min(x * 2, width - 1);
+            int x1 = std::min(x * 2 + 1, width - 1);
+
+            const uint8_t* p00 = rgba + ((size_t)y0 * width + x0) * 4;
+            const uint8_t* p01 = rgba + ((size_t)y0 * width + x1) * 4;
+            const uint8_t* p10 = rgba + ((size_t)y1 * width + x0) * 4;
+            const uint8_t* p11 = rgba + ((size_t)y1 * width + x1) * 4;
+            uint8_t* out = mip.data() + ((size_t)y * mipWidth + x) * 4;
+
+            for (int c = 0; c < 4; c++)
+            {
+                out[c] = (uint8_t)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+            }
+        }
+    }
+
+    return mip;
+}
+
+int TextureCompressor::MipLevelCount(int width, int height)
+{
+    int count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        count++;
+    }
+    return count;
+}
+
+double TextureCompressor::Psnr(const uint8_t* a, const uint8_t* b, int width, int height, bool includeAlpha)
+{
+    int channels = includeAlpha ? 4 : 3;
+    size_t pixelCount = (size_t)width * height;
+
+    double squaredError = 0.0;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            double difference = (double)a[i * 4 + c] - b[i * 4 + c];
+            squaredError += difference * difference;
+        }
+    }
+
+    if (squaredError == 0.0)
+    {
+        return 99.0;
+    }
+
+    double mse = squaredError / (pixelCount * channels);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
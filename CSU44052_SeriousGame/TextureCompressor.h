@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// BC1 (DXT1) and BC3 (DXT5) block compression of RGBA8 images, plus a CPU reference decoder
+// so compression quality can be checked without a GPU
+class TextureCompressor
+{
+public:
+    enum Format
+    {
+        BC1,    // opaque RGB, 8 bytes per 4x4 block
+        BC3     // RGB plus interpolated alpha, 16 bytes per 4x4 block
+    };
+
+    static unsigned int BlockSize(Format format);
+
+    static size_t CompressedSize(Format format, int width, int height);
+
+    // BC3 if any pixel isn't fully opaque, BC1 otherwise
+    static Format ChooseFormat(const uint8_t* rgba, int width, int height);
+
+    // Edge blocks of sizes that aren't a multiple of 4 are padded by repeating the last row and column
+    static std::vector<uint8_t> Compress(Format format, const uint8_t* rgba, int width, int height);
+
+    static std::vector<uint8_t> Decompress(Format format, const uint8_t* blocks, int width, int height);
+
+    // 2x2 box filtered half size copy, odd edges are clamped. Sizes never go below 1.
+    static std::vector<uint8_t> Downsample(const uint8_t* rgba, int width, int height, int& mipWidth, int& mipHeight);
+
+    static int MipLevelCount(int width, int height);
+
+    // PSNR in dB over RGB (and alpha if includeAlpha), 99 for identical images
+    static double Psnr(const uint8_t* a, const uint8_t* b, int width, int height, bool includeAlpha);
+};
@@ -0,0 +1,96 @@
+#include "TextureConverter.h"
+#include "CompressedTexture.h"
+#include "ImageDecoder.h"
+#include "Ktx2File.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+
+namespace
+{
+    // Decode the base level of every face on the CPU and print the lowest PSNR against the source images
+    bool Verify(const std::vector<std::string>& sourcePaths, const std::string& ktxPath)
+    {
+        Ktx2File file;
+        if (!file.Open(ktxPath))
+        {
+            printf("%-44s failed to open %s\n", sourcePaths[0].c_str(), ktxPath.c_str());
+            return false;
+        }
+
+        bool bc3 = file.VkFormat() == Ktx2File::FORMAT_BC3_UNORM;
+        TextureCompressor::Format format = bc3 ? TextureCompressor::BC3 : TextureCompressor::BC1;
+        size_t faceSize = file.GetLevel(0).size / file.FaceCount();
+
+        std::vector<std::future<DecodedImage>> decoding = ImageDecoder::GetInstance()->DecodeBatch(sourcePaths, 4);
+
+        double psnr = 99.0;
+        size_t rawSize = 0;
+        for (int face = 0; face < file.FaceCount(); face++)
+        {
+            DecodedImage source = decoding[face].get();
+            if (!source.pixels)
+            {
+                return false;
+            }
+
+            std::vector<uint8_t> decoded = TextureCompressor::Decompress(format, file.GetLevel(0).data + face * faceSize, file.Width(), file.Height());
+            psnr = std::min(psnr, TextureCompressor::Psnr(source.pixels, decoded.data(), file.Width(), file.Height(), bc3));
+            rawSize += (size_t)source.width * source.height * 4;
+            source.Release();
+        }
+
+        std::string name = file.FaceCount() == 6 ? ktxPath : sourcePaths[0];
+        printf("%-44s %5d x %-5d %4s %6d %10.1f %10.1f %8.2f\n", name.c_str(), file.Width(), file.Height(), bc3 ? "BC3" : "BC1", file.LevelCount(), rawSize / 1024.0, file.DataSize() / 1024.0, psnr);
+        return true;
+    }
+}
+
+int RunTextureConverter(const std::vector<std::string>& directories, const std::vector<std::string>& cubemapFaces)
+{
+    std::vector<std::string> files;
+
+    for (const auto& directory : directories)
+    {
+        std::error_code error;
+        for (auto it = std::filesystem::recursive_directory_iterator(directory, error); it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+        {
+            if (error)
+            {
+                break;
+            }
+
+            std::string extension = it->path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+            if (it->is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg"))
+            {
+                files.push_back(it->path().generic_string());
+            }
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+
+    // Raw size is the RGBA8 base level the uncompressed path uploads, compressed size includes every mip
+    printf("%-44s %13s %4s %6s %10s %10s %8s\n", "file", "size", "fmt", "levels", "raw (KB)", "ktx2 (KB)", "PSNR");
+
+    bool succeeded = true;
+    for (const auto& file : files)
+    {
+        std::vector<std::string> sources = { file };
+        std::string ktxPath = CompressedTexture::KtxPath(file);
+        succeeded = CompressedTexture::Convert(sources, ktxPath) && Verify(sources, ktxPath) && succeeded;
+    }
+
+    if (!cubemapFaces.empty())
+    {
+        std::string ktxPath = CompressedTexture::CubemapPath(cubemapFaces);
+        succeeded = CompressedTexture::Convert(cubemapFaces, ktxPath) && Verify(cubemapFaces, ktxPath) && succeeded;
+    }
+
+    return succeeded ? 0 : 1;
+}
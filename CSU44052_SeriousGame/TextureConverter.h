@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Builds the .ktx2 file of every image under the given directories and of the skybox cubemap, then decodes
+// them again on the CPU and prints the PSNR against the source images
+int RunTextureConverter(const std::vector<std::string>& directories, const std::vector<std::string>& cubemapFaces);
@@ -0,0 +1,369 @@
+#include "TextureManager.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <unordered_set>
+
+namespace
+{
+    std::string CanonicalPath(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        if (error)
+        {
+            return path;
+        }
+        return canonical.generic_string();
+    }
+
+    // Hash of every file and the texture type, 0 if any file can't be read
+    uint64_t HashContents(const std::vector<std::string>& paths, GLenum target)
+    {
+        uint64_t hash = 14695981039346656037ULL ^ target;
+
+        for (const auto& path : paths)
+        {
+            uint64_t fileHash = MeshCache::HashFile(path);
+            if (fileHash == 0)
+            {
+                printf("Failed to find: %s\n", path.c_str());
+                return 0;
+            }
+            hash = (hash ^ fileHash) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    GLenum FormatFor(int channels)
+    {
+        if (channels == 1)
+        {
+            return GL_RED;
+        }
+        if (channels == 3)
+        {
+            return GL_RGB;
+        }
+        return GL_RGBA;
+    }
+}
+
+TextureResource::~TextureResource()
+{
+    if (id != 0)
+    {
+        glDeleteTextures(1, &id);
+    }
+
+    for (auto& image : images)
+    {
+        image.Release();
+    }
+
+    TextureManager* manager = TextureManager::GetInstance();
+    manager->cpuBytes -= cpuBytes;
+    manager->gpuBytes -= gpuBytes;
+    manager->Forget(*this);
+}
+
+TextureManager::TextureManager()
+{
+    cpuBytes = 0;
+    gpuBytes = 0;
+}
+
+TextureHandle TextureManager::Load(const std::string& path)
+{
+    return Acquire(CanonicalPath(path), { path }, GL_TEXTURE_2D);
+}
+
+TextureHandle TextureManager::LoadCubemap(const std::vector<std::string>& facePaths)
+{
+    std::string key;
+    for (const auto& facePath : facePaths)
+    {
+        key += CanonicalPath(facePath) + "|";
+    }
+    return Acquire(key, facePaths, GL_TEXTURE_CUBE_MAP);
+}
+
+std::vector<TextureHandle> TextureManager::LoadBatch(const std::vector<std::string>& paths)
+{
+    std::vector<TextureHandle> textures(paths.size());
+
+    ThreadPool::GetInstance()->ParallelFor(paths.size(), [&](size_t i)
+    {
+        textures[i] = Load(paths[i]);
+    });
+
+    return textures;
+}
+
+void TextureManager::Upload(const TextureHandle& texture)
+{
+    if (!texture)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(texture->loadMutex);
+    if (!texture->succeeded || texture->id != 0)
+    {
+        return;
+    }
+
+    size_t uploadedBytes = 0;
+
+    if (texture->isCompressed)
+    {
+        uploadedBytes = texture->compressed.DataSize();
+        texture->id = texture->compressed.Upload();
+    }
+    else if (texture->target == GL_TEXTURE_CUBE_MAP)
+    {
+        glGenTextures(1, &texture->id);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture->id);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+        for (size_t i = 0; i < texture->images.size(); i++)
+        {
+            const DecodedImage& face = texture->images[i];
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i, 0, GL_RGB, face.width, face.height, 0, FormatFor(face.channels), GL_UNSIGNED_BYTE, face.pixels);
+            uploadedBytes += (size_t)face.width * face.height * 3;
+        }
+    }
+    else
+    {
+        const DecodedImage& image = texture->images[0];
+        GLenum format = FormatFor(image.channels);
+
+        glGenTextures(1, &texture->id);
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // A full mip chain adds a third
+        uploadedBytes = (size_t)image.width * image.height * image.channels * 4 / 3;
+    }
+
+    if (texture->target == GL_TEXTURE_CUBE_MAP)
+    {
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    else
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+    glBindTexture(texture->target, 0);
+
+    // The pixels live on the GPU now
+    for (auto& image : texture->images)
+    {
+        image.Release();
+    }
+    texture->images.clear();
+
+    cpuBytes -= texture->cpuBytes;
+    texture->cpuBytes = 0;
+    texture->gpuBytes = uploadedBytes;
+    gpuBytes += uploadedBytes;
+}
+
+void TextureManager::ReportMemory()
+{
+    // The handles are let go once the lock is released, the last one going calls Forget which takes it again
+    std::vector<TextureHandle> handles;
+    size_t loaded;
+    double cpuMegabytes;
+    double gpuMegabytes;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_set<TextureResource*> live;
+        for (const auto& entry : byPath)
+        {
+            if (TextureHandle texture = entry.second.lock())
+            {
+                live.insert(texture.get());
+                handles.push_back(std::move(texture));
+            }
+        }
+
+        loaded = live.size();
+        cpuMegabytes = cpuBytes / (1024.0 * 1024.0);
+        gpuMegabytes = gpuBytes / (1024.0 * 1024.0);
+    }
+
+    printf("Textures: %d loaded, %.1f MB CPU, %.1f MB GPU\n", (int)loaded, cpuMegabytes, gpuMegabytes);
+}
+
+TextureManager* TextureManager::GetInstance()
+{
+    static TextureManager* pTextureManager = new TextureManager();
+    return pTextureManager;
+}
+
+TextureHandle TextureManager::Acquire(const std::string& key, const std::vector<std::string>& paths, GLenum target)
+{
+    TextureHandle texture;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = byPath.find(key);
+        if (found != byPath.end())
+        {
+            texture = found->second.lock();
+        }
+    }
+
+    if (!texture)
+    {
+        uint64_t contentHash = HashContents(paths, target);
+        if (contentHash == 0)
+        {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Another thread may have started on the same file while this one was hashing
+        auto found = byPath.find(key);
+        if (found != byPath.end())
+        {
+            texture = found->second.lock();
+        }
+
+        if (!texture)
+        {
+            auto sameContent = byContent.find(contentHash);
+            if (sameContent != byContent.end())
+            {
+                texture = sameContent->second.lock();
+                if (texture)
+                {
+                    printf("Sharing %s with identical %s\n", key.c_str(), texture->key.c_str());
+                }
+            }
+        }
+
+        if (!texture)
+        {
+            texture = std::make_shared<TextureResource>();
+            texture->key = key;
+            texture->contentHash = contentHash;
+            texture->target = target;
+            texture->id = 0;
+            texture->width = 0;
+            texture->height = 0;
+            texture->cpuBytes = 0;
+            texture->gpuBytes = 0;
+            texture->attempted = false;
+            texture->succeeded = false;
+            texture->isCompressed = false;
+            byContent[contentHash] = texture;
+        }
+        byPath[key] = texture;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(texture->loadMutex);
+        if (!texture->attempted)
+        {
+            Decode(*texture, paths);
+            texture->attempted = true;
+        }
+        if (!texture->succeeded)
+        {
+            return nullptr;
+        }
+    }
+    return texture;
+}
+
+void TextureManager::Decode(TextureResource& texture, const std::vector<std::string>& paths)
+{
+    if (texture.target == GL_TEXTURE_CUBE_MAP)
+    {
+        texture.isCompressed = texture.compressed.LoadCubemap(paths);
+    }
+    else
+    {
+        texture.isCompressed = texture.compressed.Load(paths[0]);
+    }
+
+    if (texture.isCompressed)
+    {
+        texture.width = texture.compressed.Width();
+        texture.height = texture.compressed.Height();
+        texture.cpuBytes = texture.compressed.DataSize();
+        texture.succeeded = true;
+        cpuBytes += texture.cpuBytes;
+        return;
+    }
+
+    std::vector<std::future<DecodedImage>> decoding = ImageDecoder::GetInstance()->DecodeBatch(paths);
+
+    texture.succeeded = true;
+    for (auto& future : decoding)
+    {
+        DecodedImage image = future.get();
+        if (!image.pixels)
+        {
+            printf("Failed to find: %s\n", image.path.c_str());
+            texture.succeeded = false;
+        }
+        texture.images.push_back(image);
+    }
+
+    if (!texture.succeeded)
+    {
+        for (auto& image : texture.images)
+        {
+            image.Release();
+        }
+        texture.images.clear();
+        return;
+    }
+
+    texture.width = texture.images[0].width;
+    texture.height = texture.images[0].height;
+    for (const auto& image : texture.images)
+    {
+        texture.cpuBytes += (size_t)image.width * image.height * image.channels;
+    }
+    cpuBytes += texture.cpuBytes;
+}
+
+void TextureManager::Forget(const TextureResource& texture)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Only drop entries that still point at this texture, a newer load of the same file may have replaced them
+    for (auto it = byPath.begin(); it != byPath.end();)
+    {
+        if (it->second.expired())
+        {
+            it = byPath.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    auto sameContent = byContent.find(texture.contentHash);
+    if (sameContent != byContent.end() && sameContent->second.expired())
+    {
+        byContent.erase(sameContent);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+#include "CompressedTexture.h"
+#include "ImageDecoder.h"
+
+// A GL texture shared by everything that loaded the same image. The texture is deleted along with the last handle.
+struct TextureResource
+{
+    std::string key;
+    uint64_t contentHash;
+    GLenum target;
+    GLuint id;
+    int width;
+    int height;
+    size_t cpuBytes;
+    size_t gpuBytes;
+
+    ~TextureResource();
+
+private:
+    friend class TextureManager;
+
+    // Decode happens once under loadMutex, other loaders of the same image wait on it
+    std::mutex loadMutex;
+    bool attempted;
+    bool succeeded;
+
+    // Held between decode and upload, one image per face
+    std::vector<DecodedImage> images;
+    CompressedTexture compressed;
+    bool isCompressed;
+};
+
+typedef std::shared_ptr<TextureResource> TextureHandle;
+
+// Loads textures and cubemaps once, keyed by canonical path and by the hash of the file contents, and hands out
+// shared handles. Decoded pixels are freed as soon as they are uploaded.
+class TextureManager
+{
+public:
+    TextureManager();
+
+    // Load, LoadCubemap and LoadBatch don't touch GL. They return null handles for images that can't be loaded.
+    TextureHandle Load(const std::string& path);
+
+    TextureHandle LoadCubemap(const std::vector<std::string>& facePaths);
+
+    // Loads the images concurrently
+    std::vector<TextureHandle> LoadBatch(const std::vector<std::string>& paths);
+
+    // Create the GL texture if no other holder has yet. Must run on the GL thread.
+    void Upload(const TextureHandle& texture);
+
+    size_t CpuBytes() const { return cpuBytes; }
+
+    size_t GpuBytes() const { return gpuBytes; }
+
+    // Print the number of live textures and their CPU and GPU memory
+    void ReportMemory();
+
+    static TextureManager* GetInstance();
+
+private:
+    friend struct TextureResource;
+
+    TextureHandle Acquire(const std::string& key, const std::vector<std::string>& paths, GLenum target);
+
+    void Decode(TextureResource& texture, const std::vector<std::string>& paths);
+
+    void Forget(const TextureResource& texture);
+
+    std::unordered_map<std::string, std::weak_ptr<TextureResource>> byPath;
+    std::unordered_map<uint64_t, std::weak_ptr<TextureResource>> byContent;
+    std::mutex mutex;
+
+    std::atomic<size_t> cpuBytes;
+    std::atomic<size_t> gpuBytes;
+};
@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    stopping = false;
+
+    if (threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount == 0)
+    {
+        threadCount = 4;
+    }
+
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            wakeWorker.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+            if (stopping && jobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+        job();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Shared with the helper jobs, which may only start after this call has returned
+    struct Range
+    {
+        std::function<void(size_t)> job;
+        size_t count;
+        std::atomic<size_t> next;
+        size_t finished;
+        std::mutex finishedMutex;
+        std::condition_variable allFinished;
+    };
+
+    auto range = std::make_shared<Range>();
+    range->job = job;
+    range->count = count;
+    range->next = 0;
+    range->finished = 0;
+
+    auto work = [range]()
+    {
+        size_t item;
+        while ((item = range->next++) < range->count)
+        {
+            range->job(item);
+
+            std::lock_guard<std::mutex> lock(range->finishedMutex);
+            if (++range->finished == range->count)
+            {
+                range->allFinished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min((size_t)ThreadCount(), count - 1);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            jobs.push(work);
+        }
+    }
+    wakeWorker.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(range->finishedMutex);
+    range->allFinished.wait(lock, [&range]() { return range->finished == range->count; });
+}
+
+ThreadPool* ThreadPool::GetInstance()
+{
+    // Function local static so the first call is safe from any thread
+    static ThreadPool* pThreadPool = new ThreadPool();
+    return pThreadPool;
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    wakeWorker.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
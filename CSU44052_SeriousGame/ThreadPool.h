@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads that run submitted jobs in FIFO order
+class ThreadPool
+{
+public:
+    // 0 threads means one per hardware thread
+    ThreadPool(unsigned int threadCount = 0);
+
+    ~ThreadPool();
+
+    // Queue a job and get a future for its result
+    template<typename Job>
+    auto Submit(Job job) -> std::future<decltype(job())>
+    {
+        typedef decltype(job()) Result;
+
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.push([task]() { (*task)(); });
+        }
+        wakeWorker.notify_one();
+        return result;
+    }
+
+    // Run job(0) .. job(count - 1) across the pool and wait for all of them.
+    // The calling thread works through the items too, so this is safe to call from inside a job.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+    unsigned int ThreadCount() const { return (unsigned int)workers.size(); }
+
+    // Pool shared by the loaders
+    static ThreadPool* GetInstance();
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex queueMutex;
+    std::condition_variable wakeWorker;
+    bool stopping;
+};
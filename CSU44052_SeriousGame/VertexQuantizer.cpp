@@ -0,0 +1,186 @@
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <glm/gtc/packing.hpp>
+
+static_assert(sizeof(CompactVertex) == 12, "CompactVertex must stay tightly packed");
+
+namespace
+{
+    bool compactEnabled = true;
+
+    // Octahedral projection of a unit vector onto [-1, 1]^2
+    glm::vec2 OctWrap(const glm::vec3& n)
+    {
+        glm::vec3 v = n / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+        glm::vec2 e(v.x, v.y);
+
+        if (v.z < 0.0f)
+        {
+            e = glm::vec2((1.0f - std::abs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return e;
+    }
+}
+
+CompactBounds VertexQuantizer::ComputeBounds(const float* vertices, unsigned int vertexCount, const Layout& layout)
+{
+    glm::vec3 lower(0.0f);
+    glm::vec3 upper(0.0f);
+    glm::vec2 texcoordLower(0.0f);
+    glm::vec2 texcoordUpper(0.0f);
+
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        const float* vertex = vertices + (size_t)v * layout.stride;
+        glm::vec3 position(vertex[layout.position], vertex[layout.position + 1], vertex[layout.position + 2]);
+        glm::vec2 texcoord(vertex[layout.texcoord], vertex[layout.texcoord + 1]);
+
+        lower = v == 0 ? position : glm::min(lower, position);
+        upper = v == 0 ? position : glm::max(upper, position);
+        texcoordLower = v == 0 ? texcoord : glm::min(texcoordLower, texcoord);
+        texcoordUpper = v == 0 ? texcoord : glm::max(texcoordUpper, texcoord);
+    }
+
+    CompactBounds bounds;
+    bounds.positionOffset = (lower + upper) * 0.5f;
+    bounds.positionScale = (upper - lower) * 0.5f;
+    bounds.texcoordOffset = texcoordLower;
+    bounds.texcoordScale = texcoordUpper - texcoordLower;
+
+    // A flat axis still needs a non zero scale to divide by
+    for (int k = 0; k < 3; k++)
+    {
+        if (bounds.positionScale[k] <= 0.0f)
+        {
+            bounds.positionScale[k] = 1.0f;
+        }
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        if (bounds.texcoordScale[k] <= 0.0f)
+        {
+            bounds.texcoordScale[k] = 1.0f;
+        }
+    }
+    return bounds;
+}
+
+void VertexQuantizer::Encode(const float* vertices, unsigned int vertexCount, const Layout& layout, const CompactBounds& bounds, CompactVertex* out)
+{
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        const float* vertex = vertices + (size_t)v * layout.stride;
+        CompactVertex& compact = out[v];
+
+        for (int k = 0; k < 3; k++)
+        {
+            compact.position[k] = (int16_t)glm::packSnorm1x16((vertex[layout.position + k] - bounds.positionOffset[k]) / bounds.positionScale[k]);
+        }
+
+        EncodeNormal(glm::vec3(vertex[layout.normal], vertex[layout.normal + 1], vertex[layout.normal + 2]), compact.normal);
+
+        for (int k = 0; k < 2; k++)
+        {
+            compact.texcoord[k] = glm::packUnorm1x16((vertex[layout.texcoord + k] - bounds.texcoordOffset[k]) / bounds.texcoordScale[k]);
+        }
+    }
+}
+
+void VertexQuantizer::SetupAttributes(GLuint positionLocation, GLuint normalLocation, GLuint texcoordLocation)
+{
+    glVertexAttribPointer(positionLocation, 3, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(positionLocation);
+
+    // Two components, the shader sees z as 0 and rebuilds it from the octahedral encoding
+    glVertexAttribPointer(normalLocation, 2, GL_BYTE, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(normalLocation);
+
+    glVertexAttribPointer(texcoordLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texcoord));
+    glEnableVertexAttribArray(texcoordLocation);
+}
+
+void VertexQuantizer::SetUniforms(const ShaderProgram& program, const CompactBounds* bounds)
+{
+    if (bounds)
+    {
+        program.positionOffset.Set(bounds->positionOffset);
+        program.positionScale.Set(bounds->positionScale);
+        program.texcoordOffset.Set(bounds->texcoordOffset);
+        program.texcoordScale.Set(bounds->texcoordScale);
+    }
+}
+
+void VertexQuantizer::EncodeNormal(const glm::vec3& normal, int8_t out[2])
+{
+    if (glm::dot(normal, normal) == 0.0f)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    glm::vec3 n = glm::normalize(normal);
+    glm::vec2 e = OctWrap(n);
+
+    // Rounding each component on its own isn't always the closest code, try the four around it
+    float floorX = std::floor(e.x * 127.0f);
+    float floorY = std::floor(e.y * 127.0f);
+    float bestSimilarity = -2.0f;
+
+    for (int i = 0; i < 4; i++)
+    {
+        int8_t candidate[2];
+        candidate[0] = (int8_t)glm::clamp(floorX + (i & 1), -127.0f, 127.0f);
+        candidate[1] = (int8_t)glm::clamp(floorY + (i >> 1), -127.0f, 127.0f);
+
+        float similarity = glm::dot(DecodeNormal(candidate), n);
+        if (similarity > bestSimilarity)
+        {
+            bestSimilarity = similarity;
+            out[0] = candidate[0];
+            out[1] = candidate[1];
+        }
+    }
+}
+
+glm::vec3 VertexQuantizer::DecodeNormal(const int8_t encoded[2])
+{
+    glm::vec2 e(std::max(encoded[0] / 127.0f, -1.0f), std::max(encoded[1] / 127.0f, -1.0f));
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+
+    if (n.z < 0.0f)
+    {
+        n.x = (1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+glm::vec3 VertexQuantizer::DecodePosition(const CompactVertex& vertex, const CompactBounds& bounds)
+{
+    glm::vec3 snorm;
+    for (int k = 0; k < 3; k++)
+    {
+        snorm[k] = glm::unpackSnorm1x16((uint16_t)vertex.position[k]);
+    }
+    return bounds.positionOffset + bounds.positionScale * snorm;
+}
+
+glm::vec2 VertexQuantizer::DecodeTexcoord(const CompactVertex& vertex, const CompactBounds& bounds)
+{
+    glm::vec2 unorm(glm::unpackUnorm1x16(vertex.texcoord[0]), glm::unpackUnorm1x16(vertex.texcoord[1]));
+    return bounds.texcoordOffset + bounds.texcoordScale * unorm;
+}
+
+void VertexQuantizer::SetEnabled(bool enabled)
+{
+    compactEnabled = enabled;
+}
+
+bool VertexQuantizer::IsEnabled()
+{
+    return compactEnabled;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+
+// 12 byte vertex instead of 32: position as snorm16 and texcoord as unorm16 relative to the mesh bounds, and an
+// octahedral snorm8 normal. The vertex shader gets the bounds through uniforms.
+struct CompactVertex
+{
+    int16_t position[3];
+    int8_t normal[2];
+    uint16_t texcoord[2];
+};
+
+// Boxes the attributes are quantized against, position = positionOffset + positionScale * snorm and
+// texcoord = texcoordOffset + texcoordScale * unorm
+struct CompactBounds
+{
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    glm::vec2 texcoordOffset;
+    glm::vec2 texcoordScale;
+};
+
+// Encodes interleaved float vertices into CompactVertex and sets up the matching vertex attributes
+class VertexQuantizer
+{
+public:
+    // Offsets, in floats, of each attribute inside an interleaved float vertex
+    struct Layout
+    {
+        unsigned int stride;
+        unsigned int position;
+        unsigned int normal;
+        unsigned int texcoord;
+    };
+
+    static CompactBounds ComputeBounds(const float* vertices, unsigned int vertexCount, const Layout& layout);
+
+    static void Encode(const float* vertices, unsigned int vertexCount, const Layout& layout, const CompactBounds& bounds, CompactVertex* out);
+
+    // Point the attributes at CompactVertex data in the bound GL_ARRAY_BUFFER
+    static void SetupAttributes(GLuint positionLocation, GLuint normalLocation, GLuint texcoordLocation);
+
+    // Set the bounds on a program built with COMPACT_VERTICES, does nothing for float vertices (null bounds)
+    static void SetUniforms(const ShaderProgram& program, const CompactBounds* bounds);
+
+    // The normal is encoded to the closest of the neighbouring codes so the error stays under a degree
+    static void EncodeNormal(const glm::vec3& normal, int8_t out[2]);
+
+    static glm::vec3 DecodeNormal(const int8_t encoded[2]);
+
+    static glm::vec3 DecodePosition(const CompactVertex& vertex, const CompactBounds& bounds);
+
+    static glm::vec2 DecodeTexcoord(const CompactVertex& vertex, const CompactBounds& bounds);
+
+    // On by default, --full-vertices turns it off to compare against the float format
+    static void SetEnabled(bool enabled);
+
+    static bool IsEnabled();
+};
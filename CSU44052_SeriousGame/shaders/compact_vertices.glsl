@@ -0,0 +1,52 @@
+// Compact vertices store the position and texcoord normalized to the mesh bounds and the normal octahedral encoded,
+// see VertexQuantizer. Without COMPACT_VERTICES the attributes are used as they are.
+#ifdef COMPACT_VERTICES
+#ifdef INSTANCED
+// Set from the draw's record in main
+vec3 positionOffset;
+vec3 positionScale;
+vec2 texcoordOffset;
+vec2 texcoordScale;
+#else
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 texcoordOffset;
+uniform vec2 texcoordScale;
+#endif
+
+vec3 DecodePosition(vec3 position)
+{
+    return positionOffset + positionScale * position;
+}
+
+vec2 DecodeTexcoord(vec2 texcoord)
+{
+    return texcoordOffset + texcoordScale * texcoord;
+}
+
+vec3 DecodeNormal(vec3 normal)
+{
+    vec2 e = normal.xy;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+#else
+vec3 DecodePosition(vec3 position)
+{
+    return position;
+}
+
+vec2 DecodeTexcoord(vec2 texcoord)
+{
+    return texcoord;
+}
+
+vec3 DecodeNormal(vec3 normal)
+{
+    return normal;
+}
+#endif
@@ -0,0 +1,12 @@
+// Values that stay the same for a whole frame, uploaded once by FrameUniforms and shared by every program.
+// FrameUniforms::Data in FrameUniforms.h has to match this layout.
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 sunDirection;
+    vec4 sunColour;
+    // Colour in rgb and density in w
+    vec4 fog;
+};
@@ -0,0 +1,63 @@
+#version 330 core
+
+in vec2 FrameUV[3];
+flat in vec2 FrameCell[3];
+flat in vec3 FrameWeights;
+
+in vec3 WorldPosition;
+flat in vec3 ViewDirection;
+flat in float DepthRange;
+flat in float Fade;
+
+out vec4 FragColor;
+
+// Premultiplied by coverage, so filtering never bleeds the empty background into the edges
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+uniform int impostorGrid;
+
+// Lit like shader_instanced.frag
+const vec3 AMBIENT_INTENSITY = vec3(0.05f);
+
+#include "lighting.glsl"
+
+void main()
+{
+    if (Fade <= DitherThreshold())
+    {
+        discard;
+    }
+
+    vec4 albedo = vec4(0.0);
+    vec4 normalDepth = vec4(0.0);
+
+    for (int k = 0; k < 3; k++)
+    {
+        // Past the edge of a frame there's nothing, sampling would pick up the next frame
+        if (any(lessThan(FrameUV[k], vec2(0.0))) || any(greaterThan(FrameUV[k], vec2(1.0))))
+        {
+            continue;
+        }
+
+        vec2 uv = (FrameCell[k] + FrameUV[k]) / float(impostorGrid);
+        albedo += texture(albedoAtlas, uv) * FrameWeights[k];
+        normalDepth += texture(normalDepthAtlas, uv) * FrameWeights[k];
+    }
+
+    if (albedo.a < 0.5)
+    {
+        discard;
+    }
+
+    vec3 textureColour = albedo.rgb / albedo.a;
+    vec3 normal = normalize(normalDepth.xyz / albedo.a * 2.0 - 1.0);
+    float depth = normalDepth.a / albedo.a * 2.0 - 1.0;
+
+    // Move from the quad to where the surface was, so the tree meets the ground and its neighbours properly
+    vec3 position = WorldPosition + ViewDirection * depth * DepthRange;
+    vec4 eyePosition = view * vec4(position, 1.0);
+    vec4 clipPosition = projection * eyePosition;
+    gl_FragDepth = clipPosition.z / clipPosition.w * 0.5 + 0.5;
+
+    FragColor = ApplyFog(vec4(Shade(textureColour, normal, AMBIENT_INTENSITY), 1.0), eyePosition);
+}
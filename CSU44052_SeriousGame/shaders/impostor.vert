@@ -0,0 +1,103 @@
+#version 330 core
+
+layout(location = 0) in vec2 corner;            // quad corner, -1 to 1
+layout(location = 1) in vec4 instancePosition;  // model origin in xyz, scale in w
+
+// The three frames closest to the view direction, where this corner lands in each and how much each counts
+out vec2 FrameUV[3];
+flat out vec2 FrameCell[3];
+flat out vec3 FrameWeights;
+
+out vec3 WorldPosition;
+flat out vec3 ViewDirection;
+flat out float DepthRange;
+flat out float Fade;
+
+#include "frame_uniforms.glsl"
+
+// Bounding sphere the frames were rendered around, and frames per side of the atlas
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform int impostorGrid;
+
+// Distance range the mesh fades out over
+uniform vec2 impostorFade;
+
+// The sphere looks a little bigger than its radius in perspective
+const float QUAD_PADDING = 1.1;
+
+vec2 HemiOctEncode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    return vec2(d.x + d.z, d.x - d.z);
+}
+
+vec3 HemiOctDecode(vec2 e)
+{
+    vec2 p = vec2(e.x + e.y, e.x - e.y) * 0.5;
+    return normalize(vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y));
+}
+
+// Same as FrameBasis in ImpostorAtlas.cpp
+void FrameBasis(vec3 direction, out vec3 right, out vec3 up)
+{
+    right = cross(vec3(0.0, 1.0, 0.0), direction);
+    right = dot(right, right) > 1e-8 ? normalize(right) : vec3(1.0, 0.0, 0.0);
+    up = cross(direction, right);
+}
+
+void main()
+{
+    float scale = instancePosition.w;
+    vec3 center = instancePosition.xyz + impostorCenter * scale;
+    vec3 toCamera = cameraPosition.xyz - center;
+    vec3 viewDirection = normalize(toCamera);
+
+    // Only the upper hemisphere was baked, a camera below the centre uses the horizon frames
+    vec3 frameView = vec3(viewDirection.x, max(viewDirection.y, 0.0), viewDirection.z);
+    frameView = dot(frameView, frameView) > 1e-8 ? normalize(frameView) : vec3(0.0, 1.0, 0.0);
+
+    // Split the grid cell into two triangles and blend the frames at the corners of the one we're in
+    float last = float(impostorGrid - 1);
+    vec2 grid = (HemiOctEncode(frameView) * 0.5 + 0.5) * last;
+    vec2 cell = min(floor(grid), vec2(last - 1.0));
+    vec2 f = grid - cell;
+
+    if (f.x + f.y <= 1.0)
+    {
+        FrameCell[0] = cell;
+        FrameWeights = vec3(1.0 - f.x - f.y, f.x, f.y);
+    }
+    else
+    {
+        FrameCell[0] = cell + vec2(1.0, 1.0);
+        FrameWeights = vec3(f.x + f.y - 1.0, 1.0 - f.y, 1.0 - f.x);
+    }
+    FrameCell[1] = cell + vec2(1.0, 0.0);
+    FrameCell[2] = cell + vec2(0.0, 1.0);
+
+    // Camera facing quad over the bounding sphere, in model units around the centre
+    vec3 right, up;
+    FrameBasis(viewDirection, right, up);
+    vec3 offset = (right * corner.x + up * corner.y) * impostorRadius * QUAD_PADDING;
+
+    for (int k = 0; k < 3; k++)
+    {
+        vec3 frameDirection = HemiOctDecode(FrameCell[k] / last * 2.0 - 1.0);
+        vec3 frameRight, frameUp;
+        FrameBasis(frameDirection, frameRight, frameUp);
+
+        // Slide the corner along the view ray onto the plane the frame was rendered on
+        vec3 onFrame = offset - viewDirection * dot(offset, frameDirection) / max(dot(viewDirection, frameDirection), 0.1);
+        FrameUV[k] = vec2(dot(onFrame, frameRight), dot(onFrame, frameUp)) / (2.0 * impostorRadius) + 0.5;
+    }
+
+    WorldPosition = center + offset * scale;
+    ViewDirection = viewDirection;
+    DepthRange = impostorRadius * scale;
+    // Measured from the origin like shader_instanced.vert so the two dither patterns line up
+    float originDistance = length(cameraPosition.xyz - instancePosition.xyz);
+    Fade = impostorFade.y > impostorFade.x ? clamp((originDistance - impostorFade.x) / (impostorFade.y - impostorFade.x), 0.0, 1.0) : 1.0;
+
+    gl_Position = projection * view * vec4(WorldPosition, 1.0);
+}
@@ -0,0 +1,39 @@
+#version 330 core
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+smooth in vec4 ioEyeSpacePosition;
+
+// Albedo with coverage in alpha, and the world space normal with the depth from the frame plane in alpha
+layout(location = 0) out vec4 Albedo;
+layout(location = 1) out vec4 NormalDepth;
+
+uniform sampler2D diffuseTexture;
+
+// The bake projection is an orthographic box around the bounding sphere, so it holds the radius. Every variant the
+// model draws with sees it without a uniform of its own. The bake camera sits two radii from the centre.
+#include "frame_uniforms.glsl"
+
+void main()
+{
+    float impostorRadius = 1.0 / projection[0][0];
+
+#ifdef HAS_TEXTURE
+    vec4 textureColour = texture(diffuseTexture, TexCoord);
+#else
+    vec4 textureColour = vec4(1.0);
+#endif
+
+    // There is no blending while baking, so cut the leaf cards out by their alpha
+    if (textureColour.a < 0.5)
+    {
+        discard;
+    }
+
+    // Distance in front of the plane through the centre, -1 to 1 over the bounding sphere
+    float depth = (ioEyeSpacePosition.z / ioEyeSpacePosition.w + 2.0 * impostorRadius) / impostorRadius;
+
+    Albedo = vec4(textureColour.rgb, 1.0);
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, clamp(depth * 0.5 + 0.5, 0.0, 1.0));
+}
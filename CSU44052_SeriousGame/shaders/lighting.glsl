@@ -0,0 +1,51 @@
+// Sun, specular highlight and fog shared by everything lit in the scene, the sun and fog come from FrameUniforms
+
+#include "frame_uniforms.glsl"
+
+const float DIFFUSED_INTENSITY = 0.8f;
+
+// Instanced draws get the material of their draw from the vertex shader
+#ifdef INSTANCED
+flat in float shininess;
+flat in float specularIntensity;
+#else
+uniform float shininess;
+uniform float specularIntensity;
+#endif
+
+vec3 Shade(vec3 albedo, vec3 normal, vec3 ambientIntensity)
+{
+    // Calculate ambient color
+    vec3 ambientColour = sunColour.rgb * albedo * ambientIntensity;
+
+    // Calculate diffuse color
+    float diffuseFactor = max(dot(normal, sunDirection.xyz), 0.0f);
+    vec3 diffuseColorRGB = albedo * DIFFUSED_INTENSITY * diffuseFactor * sunColour.rgb;
+
+    // Calculate specular properties
+    vec3 viewDir = normalize(-vec3(gl_FragCoord));
+    vec3 reflectDir = reflect(-sunDirection.xyz, normal);
+    float specularFactor = pow(max(dot(viewDir, reflectDir), 0.0f), shininess);
+    vec3 specularColorRGB = vec3(1.0) * specularIntensity * specularFactor;
+
+    return ambientColour + diffuseColorRGB + specularColorRGB;
+}
+
+// Blend towards the fog colour with the eye space distance, nothing without FOG
+vec4 ApplyFog(vec4 colour, vec4 eyeSpacePosition)
+{
+#ifdef FOG
+    float fogCoordinate = abs(eyeSpacePosition.z / eyeSpacePosition.w);
+    float fogFactor = 1.0 - clamp(exp(-pow(fog.w * fogCoordinate, 2.0)), 0.0, 1.0);
+    colour = mix(colour, vec4(fog.rgb, 1.0), fogFactor);
+#endif
+    return colour;
+}
+
+// 4x4 ordered dither, the mesh keeps the texels under the fade and the impostor the rest
+float DitherThreshold()
+{
+    const float BAYER[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (BAYER[p.y * 4 + p.x] + 0.5) / 16.0;
+}
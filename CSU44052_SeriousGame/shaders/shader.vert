@@ -8,17 +8,21 @@ layout (location = 2) in vec2 texCoord;
 out vec2 TexCoord;
 out vec3 Normal;
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
+// view and projection come from FrameUniforms
+uniform mat4 model;
 
 smooth out vec4 ioEyeSpacePosition;
 
+#include "frame_uniforms.glsl"
+#include "compact_vertices.glsl"
+
 void main() {
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0);
-    TexCoord = texCoord;
-    Normal = normal;
+    vec3 decodedPosition = DecodePosition(position);
+
+    gl_Position = projection * view * model * vec4(decodedPosition, 1.0);
+    TexCoord = DecodeTexcoord(texCoord);
+    Normal = DecodeNormal(normal);
 
-    mat4 mvMatrix = viewMatrix * modelMatrix;
-    ioEyeSpacePosition = mvMatrix * vec4(position, 1.0);
+    mat4 mvMatrix = view * model;
+    ioEyeSpacePosition = mvMatrix * vec4(decodedPosition, 1.0);
 }
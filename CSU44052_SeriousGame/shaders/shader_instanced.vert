@@ -1,46 +1,118 @@
-#version 330 core
+#version 430 core
 
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec2 tex;
 layout(location = 2) in vec3 norm;
-layout(location = 3) in mat4 instanceModelMatrix; //Model matrix for each instance
+#ifdef INSTANCED
+// Where the draw's record is in drawRecords, the same for all its instances. RenderQueue makes it the command's
+// baseInstance, which is how a multi draw tells its draws apart without gl_DrawID.
+layout(location = 3) in uint drawIndex;
+
+layout(std430) readonly buffer InstanceMatrices
+{
+    mat4 instanceMatrices[];
+};
+
+// Where each instance's model matrix is in instanceMatrices, from the draw's first instance on
+layout(std430) readonly buffer InstanceIndices
+{
+    uint instanceIndices[];
+};
+
+// What the uniforms hold for a single draw, RenderQueue::DrawRecord has to match this layout
+struct DrawRecord
+{
+    mat4 model;
+    vec4 positionOffset;
+    vec4 positionScale;
+    // Offset in xy, scale in zw
+    vec4 texcoordBounds;
+    // Shininess, specular intensity and impostorFade
+    vec4 material;
+    // First instance in instanceIndices in x
+    uvec4 instances;
+};
+
+layout(std430) readonly buffer DrawRecords
+{
+    DrawRecord drawRecords[];
+};
+
+// The fragment shader lights with the draw's material
+flat out float shininess;
+flat out float specularIntensity;
+#endif
 
 // Output variables
 out vec2 TexCoord;
 out vec3 Normal;
 
-// Uniform matrices
-uniform mat4 model; 
-uniform mat4 view;   
-uniform mat4 projection;
+// Uniform matrices, view and projection come from FrameUniforms. Instanced draws take the model from their record.
+#ifdef INSTANCED
+mat4 model;
+#else
+uniform mat4 model;
+#endif
 
 // eye space pos for fog rendering
 smooth out vec4 ioEyeSpacePosition;
 
+#ifdef IMPOSTOR_FADE
+// Distance range an instance fades out over while its impostor fades in
+flat out float Fade;
+
+#ifdef INSTANCED
+vec2 impostorFade;
+#else
+uniform vec2 impostorFade;
+#endif
+#endif
+
+#include "frame_uniforms.glsl"
+#include "compact_vertices.glsl"
+
 void main() 
 {
-    //instance-specific model matrix
-        mat4 newModel;
-    if (any(notEqual(instanceModelMatrix[0], vec4(0.0))) ||
-        any(notEqual(instanceModelMatrix[1], vec4(0.0))) ||
-        any(notEqual(instanceModelMatrix[2], vec4(0.0))) ||
-        any(notEqual(instanceModelMatrix[3], vec4(0.0))))
-    {
-        // Only apply the transformation if instanceModelMatrix is not an identity matrix
-        newModel = model * instanceModelMatrix;
-    }
-    else
-    {
-        // If instanceModelMatrix is an identity matrix, use model directly
-        newModel = model;
-    }
-    
-    vec4 worldPos = newModel * vec4(pos, 1.0);
+#ifdef INSTANCED
+    // Everything per draw comes from its record before anything is decoded
+    DrawRecord draw = drawRecords[drawIndex];
+    model = draw.model;
+#ifdef COMPACT_VERTICES
+    positionOffset = draw.positionOffset.xyz;
+    positionScale = draw.positionScale.xyz;
+    texcoordOffset = draw.texcoordBounds.xy;
+    texcoordScale = draw.texcoordBounds.zw;
+#endif
+#ifdef IMPOSTOR_FADE
+    impostorFade = draw.material.zw;
+#endif
+    shininess = draw.material.x;
+    specularIntensity = draw.material.y;
+
+    //instance-specific model matrix, InstanceGroup already made an all zero one the identity
+    mat4 newModel = model * instanceMatrices[instanceIndices[draw.instances.x + uint(gl_InstanceID)]];
+#else
+    mat4 newModel = model;
+#endif
+
+    vec3 position = DecodePosition(pos);
+
+    vec4 worldPos = newModel * vec4(position, 1.0);
     gl_Position = projection * view * worldPos;
     
-    TexCoord = tex;
-    Normal = mat3(transpose(inverse(newModel))) * norm;
+    TexCoord = DecodeTexcoord(tex);
+
+#ifdef UNIFORM_SCALE
+    // The scale only changes the length, which the fragment shader normalizes away
+    Normal = mat3(newModel) * DecodeNormal(norm);
+#else
+    Normal = mat3(transpose(inverse(newModel))) * DecodeNormal(norm);
+#endif
+
+    ioEyeSpacePosition = view * worldPos;
 
-    mat4 mvMatrix = view * newModel;
-    ioEyeSpacePosition = mvMatrix * vec4(pos, 1.0);
+#ifdef IMPOSTOR_FADE
+    float distance = length(cameraPosition.xyz - newModel[3].xyz);
+    Fade = clamp((distance - impostorFade.x) / (impostorFade.y - impostorFade.x), 0.0, 1.0);
+#endif
 }
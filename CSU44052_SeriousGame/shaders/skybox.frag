@@ -7,14 +7,17 @@ uniform samplerCube skybox;
 
 smooth in vec4 ioEyeSpacePosition;
 
+#include "frame_uniforms.glsl"
+
 void main()
 {    
     FragColor = texture(skybox, texCoords);
 
     // fog rendering
     float fogCoordinate = length(ioEyeSpacePosition.xyz);
+    // Denser than the scene's fog, the sky is only a unit away
     float fogDensity = 1.0;
-    vec3 fogColor = vec3(0.7);
+    vec3 fogColor = fog.rgb;
     float fogFactor = exp(-pow(fogDensity * fogCoordinate, 2.0));
     fogFactor = 1.0 - clamp(fogFactor, 0.0, 1.0);
 
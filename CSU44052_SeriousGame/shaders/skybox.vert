@@ -3,16 +3,18 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 texCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "frame_uniforms.glsl"
 
 smooth out vec4 ioEyeSpacePosition;
 
 void main()
 {
+    // The sky stays around the camera, so leave the translation out of the view
+    mat4 skyView = mat4(mat3(view));
+
     texCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0f);
+    vec4 pos = projection * skyView * vec4(aPos, 1.0f);
     gl_Position = pos.xyww;
     // for fog
-    ioEyeSpacePosition = view * vec4(aPos, 1.0f);
+    ioEyeSpacePosition = skyView * vec4(aPos, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 330 core
+in vec2 TexCoords;
+in vec3 TextColor;
+out vec4 color;
+
+uniform sampler2D text;
+
+// FreeType puts the outline at 128, larger values are inside the glyph
+const float EDGE = 128.0 / 255.0;
+
+void main()
+{    
+    // The distance changes at a fixed rate per texel, so its screen space derivative keeps the edge about one
+    // pixel wide however far the text is scaled
+    float distance = texture(text, TexCoords).r;
+    float width = max(fwidth(distance) * 0.7, 1.0 / 255.0);
+    color = vec4(TextColor, smoothstep(EDGE - width, EDGE + width, distance));
+}